@@ -1,5 +1,7 @@
 import numpy as np
 import math
+import json
+import os
 
 # Constants for (heart) trackfile definition
 tk_frameCol = 0
@@ -20,6 +22,33 @@ stk_yposCol = 3
 stk_xposCol = 4
 stk_oriCol = 5
 
+# Layout of the header of the binary track files (.tkb/.stkb)
+_binaryTrackHeaderDtype = np.dtype([('magic','S8'),('version','<u4'),('n_frames','<i4'),('n_structures','<i4'),
+                                    ('xsize','<i4'),('ysize','<i4'),('radius','<i4'),('headup','u1'),('auto_propagated','u1'),('reserved','u1',2),
+                                    ('data_offset','<u4'),('file_bytes','<u8')])
+_binaryTrackNameBytes = 64
+
+# Size in bytes of a column of a binary track file, including padding
+def _binaryColumnBytes(n_frames,dtype) :
+	return (n_frames*np.dtype(dtype).itemsize + 7)//8*8
+
+# Memory-map a binary track file and return its header and contents
+def _mapBinaryTrackFile(filename,magic) :
+	header = np.fromfile(filename,dtype=_binaryTrackHeaderDtype,count=1)[0]
+	# Version 1 files are the same apart from not having the auto_propagated flag
+	if header['magic'] != magic or header['version'] not in (1,2) :
+		raise ValueError(filename + ' is not a valid binary track file')
+	data = np.memmap(filename,dtype=np.uint8,mode='r')
+	return header,data
+
+# Read consecutive columns from a memory-mapped binary track file without copying
+def _binaryColumns(data,offset,n_frames,dtypes) :
+	columns = []
+	for dtype in dtypes :
+		columns += [np.frombuffer(data,dtype=dtype,count=n_frames,offset=offset)]
+		offset += _binaryColumnBytes(n_frames,dtype)
+	return columns
+
 # Reads in the information in a heart track file and returns
 def readHeartTrackFile(filename) :
 	'''
@@ -60,6 +89,27 @@ def readHeartTrackFile(filename) :
 
 
 
+# Reads in the information in a binary heart track file, in the same form as readHeartTrackFile
+def readBinaryHeartTrackFile(filename) :
+	'''
+	Read data from a binary heart track (.tkb) file. The file is memory-mapped
+	rather than parsed, which is much faster than reading the equivalent .tk file.
+
+	Arguments:
+	* filename -- String containing file path and name for the .tkb file to read from
+
+	Returns the same values as readHeartTrackFile.
+	'''
+	header,data = _mapBinaryTrackFile(filename,b'HAHEART')
+	n_frames = int(header['n_frames'])
+	labelled,present,phase_points,ypos,xpos,ori,view,cardiac_phase = _binaryColumns(data,int(header['data_offset']),n_frames,
+		[np.uint8,np.uint8,np.uint8,'<i4','<i4','<i4','<i4','<f4'])
+
+	table = np.column_stack([np.arange(n_frames),labelled,present,ypos,xpos,ori,view,phase_points,cardiac_phase]).astype(float)
+	image_dims = [int(header['xsize']),int(header['ysize'])]
+	return table,image_dims,bool(header['headup']),float(header['radius'])
+
+
 # Reads the track file and return as rows of dictionaries
 def readHeartTrackFileAsDicts(filename) :
 	'''
@@ -148,6 +198,91 @@ def readStructure(filename,structure):
 	return None
 
 
+# Function to read a single structure track from a binary trackfile
+def readBinaryStructure(filename,structure) :
+	'''
+	Read data for a single specified structure from a binary structure track
+	(.stkb) file. The file is memory-mapped rather than parsed.
+
+	Arguments:
+	* filename -- String containing file path and name for the .stkb file to read
+	  from
+	* structure -- String containing name of structure to read
+
+	Returns the same values as readStructure.
+	'''
+	header,data = _mapBinaryTrackFile(filename,b'HASTRUCT')
+	n_frames = int(header['n_frames'])
+	n_structures = int(header['n_structures'])
+
+	names_start = _binaryTrackHeaderDtype.itemsize
+	for s in range(n_structures) :
+		name = bytes(data[names_start+s*_binaryTrackNameBytes:names_start+(s+1)*_binaryTrackNameBytes]).rstrip(b'\0').decode()
+		if name == structure :
+			structure_bytes = 2*_binaryColumnBytes(n_frames,np.uint8) + 3*_binaryColumnBytes(n_frames,'<i4')
+			offset = int(header['data_offset']) + s*structure_bytes
+			labelled,present,ypos,xpos,ori = _binaryColumns(data,offset,n_frames,[np.uint8,np.uint8,'<i4','<i4','<i4'])
+			return np.column_stack([np.arange(n_frames),labelled,present,ypos,xpos,ori]).astype(int)
+
+	return None
+
+
+# Function to check whether a structure track file was filled in automatically
+def isAutoPropagated(filename) :
+	'''
+	Check whether a structure track file (.stk or .stkb) was produced by the
+	propagate_structures tool rather than by a human annotator.
+
+	Arguments:
+	* filename -- String containing file path and name for the .stk or .stkb file
+
+	Returns:
+	* auto_propagated -- True if the file is marked as auto-propagated
+	'''
+	if filename.endswith('.stkb') :
+		header,_ = _mapBinaryTrackFile(filename,b'HASTRUCT')
+		return bool(header['auto_propagated'])
+
+	with open(filename,'r') as infile :
+		return infile.readline().split()[-1:] == ['(auto-propagated)']
+
+
+# Read the arrays written by the export_tracks tool
+def readExportedTracks(directory) :
+	'''
+	Read the manifest of a directory written by the export_tracks tool and
+	memory-map the arrays of every video in it. Nothing is parsed, so this is
+	much faster than reading the track files themselves.
+
+	Arguments:
+	* directory -- String containing the path of the export directory
+
+	Returns:
+	* videos -- A list of dictionaries, one per video, containing the entries of
+	  the manifest ('name', 'n_frames', 'xsize', 'ysize', 'heart_file',
+	  'headup', 'radius', 'structure_file' and 'structures'). Each also has an
+	  entry for each exported array, named after its file: 'heart_labelled',
+	  'heart_present', 'heart_centrey', 'heart_centrex', 'heart_orientation',
+	  'heart_view', 'heart_phase_point' and 'heart_cardiac_phase' (one value per
+	  frame), and 'structure_labelled', 'structure_present', 'structure_y',
+	  'structure_x' and 'structure_orientation' (one row per structure, in the
+	  order of 'structures'). Arrays are absent if the video had no track file of
+	  that kind. Orientations are in degrees, as in the track files.
+	'''
+	with open(os.path.join(directory,'manifest.json'),'r') as infile :
+		manifest = json.load(infile)
+
+	videos = []
+	for video in manifest['videos'] :
+		videodir = os.path.join(directory,video['name'])
+		for arrayfile in sorted(os.listdir(videodir)) :
+			if arrayfile.endswith('.npy') :
+				video[arrayfile[:-4]] = np.load(os.path.join(videodir,arrayfile),mmap_mode='r')
+		videos += [video]
+
+	return videos
+
+
 # Read a structure list and return a list of structures and other information
 def readStructureList(filename) :
 	names_list = []
@@ -0,0 +1,210 @@
+#include "annotationOverlays.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <cmath>
+
+using namespace std;
+using namespace cv;
+
+namespace thesisUtilities
+{
+
+// Region covered by a piece of text drawn with the font used for all annotations
+static Rect textBounds(const string& text, const Point& origin)
+{
+	int baseline = 0;
+	const Size size = getTextSize(text,FONT_HERSHEY_PLAIN,1.0,1,&baseline);
+	return Rect(origin.x-2,origin.y-size.height-2,size.width+4,size.height+baseline+4);
+}
+
+// Region covered by a straight line or arrow
+static Rect lineBounds(const Point& start, const Point& end, const int margin)
+{
+	return Rect(Point(min(start.x,end.x)-margin,min(start.y,end.y)-margin),Point(max(start.x,end.x)+margin+1,max(start.y,end.y)+margin+1));
+}
+
+// Draw the heart overlay into img (if not null) and/or accumulate the region
+// it covers into bounds (if not null), so that the two cannot disagree
+static void processHeartOverlay(Mat* img, Rect* bounds, const heartOverlay_t& overlay, const Point& offset)
+{
+	const int lineThickness = 2;
+	const int centrex = overlay.centrex - offset.x;
+	const int centrey = overlay.centrey - offset.y;
+	const int radius = overlay.radius;
+	const int ori = overlay.ori;
+	Scalar colour;
+	string view_string;
+
+	auto drawText = [&](const string& text, const Point& origin)
+	{
+		if(img)
+			putText(*img,text,origin,FONT_HERSHEY_PLAIN,1.0,colour);
+		if(bounds)
+			*bounds |= textBounds(text,origin);
+	};
+
+	switch(overlay.view_label)
+	{
+		case VIEW_4CHAM:
+			colour = CLR_4CHAM;
+			view_string = STR_4CHAM;
+			break;
+		case VIEW_LVOT:
+			colour = CLR_LVOT;
+			view_string = STR_LVOT;
+			break;
+		case VIEW_RVOT:
+			colour = CLR_RVOT;
+			view_string = STR_RVOT;
+			break;
+		case VIEW_VSIGN:
+			colour = CLR_VSIGN;
+			view_string = STR_VSIGN;
+			break;
+	}
+
+	if(overlay.present == hpObscured)
+		colour *= 0.5;
+
+	if(overlay.present != hpNone)
+	{
+		const Point centre(centrex,centrey);
+		const Point line_end(std::round(centrex+radius*std::cos(float(ori)*M_PI/180.0)),std::round(centrey-radius*std::sin(float(ori)*M_PI/180.0)));
+		if(img)
+		{
+			circle(*img,centre,radius,colour,lineThickness);
+			line(*img,centre,line_end,colour,lineThickness);
+		}
+		if(bounds)
+			*bounds |= Rect(centrex-radius-lineThickness,centrey-radius-lineThickness,2*(radius+lineThickness)+1,2*(radius+lineThickness)+1);
+
+		const Point left_point(std::round(centrex+(radius+10)*std::cos(float(ori+90)*M_PI/180.0))-5,std::round(centrey-(radius+10)*std::sin(float(ori+90)*M_PI/180.0))+5);
+		const Point right_point(std::round(centrex+(radius+10)*std::cos(float(ori-90)*M_PI/180.0))-5,std::round(centrey-(radius+10)*std::sin(float(ori-90)*M_PI/180.0))+5);
+		if(overlay.headup)
+		{
+			drawText("L",left_point);
+			drawText("R",right_point);
+		}
+		else
+		{
+			drawText("R",left_point);
+			drawText("L",right_point);
+		}
+		drawText(view_string,Point(std::round(centrex+20*std::cos(float(ori+180)*M_PI/180.0))-30,std::round(centrey-20*std::sin(float(ori+180)*M_PI/180.0))+5));
+
+		// Cardiac phase visualisation
+		if(overlay.cardiac_phase_valid)
+		{
+			const float cardiac_phase = overlay.cardiac_phase;
+			Point phaseVisPoint(std::round(centrex + 0.5*(1-std::cos(cardiac_phase))*radius*std::cos(float(ori)*M_PI/180.0)),std::round(centrey - 0.5*(1-std::cos(cardiac_phase))*radius*std::sin(float(ori)*M_PI/180.0)));
+			Point arrow_end;
+			if (cardiac_phase < M_PI)
+				arrow_end = Point(std::round(phaseVisPoint.x + 10.0*std::cos(float(ori)*M_PI/180.0)),std::round(phaseVisPoint.y - 10.0*std::sin(float(ori)*M_PI/180.0)));
+			else
+				arrow_end = Point(std::round(phaseVisPoint.x - 10.0*std::cos(float(ori)*M_PI/180.0)),std::round(phaseVisPoint.y + 10.0*std::sin(float(ori)*M_PI/180.0)));
+			if(img)
+			{
+				circle(*img,phaseVisPoint,3,colour,-1);
+				arrowedLine(*img,phaseVisPoint,arrow_end,colour,lineThickness,8,0,1.5);
+			}
+			// The arrow head is longer than the arrow itself
+			if(bounds)
+				*bounds |= lineBounds(phaseVisPoint,arrow_end,20);
+		}
+	}
+
+	// End systole and end diastole labels
+	const Point phase_label_point(std::round(centrex+(radius+10)*std::cos(float(ori)*M_PI/180.0))-5,std::round(centrey-(radius+10)*std::sin(float(ori)*M_PI/180.0))+5);
+	if(overlay.phase_point == AUTO_LABELLED_SYSTOLE)
+		drawText("(ES)",phase_label_point);
+	else if (overlay.phase_point == MANUALLY_LABELLED_SYSTOLE)
+		drawText("ES",phase_label_point);
+	else if(overlay.phase_point == AUTO_LABELLED_DIASTOLE)
+		drawText("(ED)",phase_label_point);
+	else if(overlay.phase_point == MANUALLY_LABELLED_DIASTOLE)
+		drawText("ED",phase_label_point);
+	else if(overlay.phase_point == SUGGESTED_SYSTOLE)
+		drawText("ES?",phase_label_point);
+	else if(overlay.phase_point == SUGGESTED_DIASTOLE)
+		drawText("ED?",phase_label_point);
+}
+
+
+void drawOverlay(Mat& img, const heartOverlay_t& overlay, const Point& offset)
+{
+	processHeartOverlay(&img,nullptr,overlay,offset);
+}
+
+
+void drawOverlay(Mat& img, const structureOverlay_t& overlay, const Point& offset)
+{
+	if(overlay.present == hpNone)
+		return;
+
+	Scalar colour = overlay.colour;
+	if(overlay.present == hpObscured)
+		colour *= 0.5;
+
+	const int lineThickness = 2;
+	const int lineLength = 15;
+	const int x = overlay.x - offset.x;
+	const int y = overlay.y - offset.y;
+	arrowedLine(img,Point(x,y), Point(std::round(x+lineLength*std::cos(float(overlay.ori)*M_PI/180.0)),std::round(y-lineLength*std::sin(float(overlay.ori)*M_PI/180.0))),colour,lineThickness,8,0,0.2);
+}
+
+
+void drawOverlay(Mat& img, const textOverlay_t& overlay, const Point& offset)
+{
+	putText(img,overlay.text,overlay.origin-offset,FONT_HERSHEY_PLAIN,1.0,overlay.colour);
+}
+
+
+Rect overlayBounds(const heartOverlay_t& overlay)
+{
+	Rect bounds;
+	processHeartOverlay(nullptr,&bounds,overlay,Point(0,0));
+	return bounds;
+}
+
+
+Rect overlayBounds(const structureOverlay_t& overlay)
+{
+	if(overlay.present == hpNone)
+		return Rect();
+
+	// The arrow is a fixed length, allow for line thickness and the arrow head
+	const int lineLength = 15;
+	return Rect(overlay.x-lineLength-4,overlay.y-lineLength-4,2*(lineLength+4)+1,2*(lineLength+4)+1);
+}
+
+
+Rect overlayBounds(const textOverlay_t& overlay)
+{
+	if(overlay.text.empty())
+		return Rect();
+	return textBounds(overlay.text,overlay.origin);
+}
+
+
+bool operator==(const heartOverlay_t& a, const heartOverlay_t& b)
+{
+	return (a.centrex == b.centrex) && (a.centrey == b.centrey) && (a.radius == b.radius) && (a.ori == b.ori) &&
+		   (a.view_label == b.view_label) && (a.present == b.present) && (a.headup == b.headup) &&
+		   (a.phase_point == b.phase_point) && (a.cardiac_phase_valid == b.cardiac_phase_valid) &&
+		   (!a.cardiac_phase_valid || (a.cardiac_phase == b.cardiac_phase));
+}
+
+
+bool operator==(const structureOverlay_t& a, const structureOverlay_t& b)
+{
+	return (a.x == b.x) && (a.y == b.y) && (a.ori == b.ori) && (a.present == b.present) &&
+		   (a.colour[0] == b.colour[0]) && (a.colour[1] == b.colour[1]) && (a.colour[2] == b.colour[2]);
+}
+
+
+bool operator==(const textOverlay_t& a, const textOverlay_t& b)
+{
+	return (a.text == b.text) && (a.origin == b.origin) &&
+		   (a.colour[0] == b.colour[0]) && (a.colour[1] == b.colour[1]) && (a.colour[2] == b.colour[2]);
+}
+
+} // end of namespace
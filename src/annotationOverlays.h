@@ -0,0 +1,83 @@
+#ifndef ANNOTATIONOVERLAYS_H
+#define ANNOTATIONOVERLAYS_H
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include "thesisUtilities.h"
+
+// View Strings
+#define STR_4CHAM "4-CHAM"
+#define STR_LVOT "LVOT"
+#define STR_RVOT "3V"
+#define STR_VSIGN "V-SIGN"
+
+// View Colours
+#define CLR_4CHAM cv::Scalar(255,255,0) // cyan
+#define CLR_LVOT cv::Scalar(0,255,0) // green
+#define CLR_RVOT cv::Scalar(0,255,255) // yellow
+#define CLR_VSIGN cv::Scalar(0,0,255)  // red
+
+namespace thesisUtilities
+{
+	// Colours and names used by the substructures tool for each view (0 being background)
+	const int n_views = 4;
+	const std::string view_strings[n_views] = {std::string("BACKGROUND"),std::string("4-CHAM"),std::string("LVOT"),std::string("3V")};
+	const cv::Scalar view_colours[n_views] = {cv::Scalar(255,255,255),cv::Scalar(255,255,0), cv::Scalar(0,255,0), cv::Scalar(0,255,255)};
+	const cv::Scalar view_highlight_colours[n_views] = {cv::Scalar(0,0,255),cv::Scalar(0,127,255), cv::Scalar(255,0,255), cv::Scalar(255,0,0)};
+
+	// The elements drawn over video frames to visualise the annotations.
+	// For each there is a function to draw it and a function to find the region of
+	// the image that drawing it may affect. The drawing functions take an offset that is
+	// subtracted from all coordinates, so that an element may be drawn into a region of
+	// interest of a larger image.
+
+	// The heart annotation: circle, orientation line, L/R markers, view name,
+	// cardiac phase indicator and end-systole/end-diastole labels
+	struct heartOverlay_t
+	{
+		int centrex;
+		int centrey;
+		int radius;
+		int ori;
+		int view_label;
+		heartPresent_t present;
+		bool headup;
+		int phase_point;
+		bool cardiac_phase_valid;
+		float cardiac_phase;
+	};
+
+	// A substructure annotation (an arrow)
+	struct structureOverlay_t
+	{
+		int x;
+		int y;
+		int ori;
+		int present;
+		cv::Scalar colour;
+	};
+
+	// A line of text
+	struct textOverlay_t
+	{
+		std::string text;
+		cv::Point origin;
+		cv::Scalar colour;
+	};
+
+	void drawOverlay(cv::Mat& img, const heartOverlay_t& overlay, const cv::Point& offset = cv::Point(0,0));
+	void drawOverlay(cv::Mat& img, const structureOverlay_t& overlay, const cv::Point& offset = cv::Point(0,0));
+	void drawOverlay(cv::Mat& img, const textOverlay_t& overlay, const cv::Point& offset = cv::Point(0,0));
+
+	cv::Rect overlayBounds(const heartOverlay_t& overlay);
+	cv::Rect overlayBounds(const structureOverlay_t& overlay);
+	cv::Rect overlayBounds(const textOverlay_t& overlay);
+
+	bool operator==(const heartOverlay_t& a, const heartOverlay_t& b);
+	bool operator==(const structureOverlay_t& a, const structureOverlay_t& b);
+	bool operator==(const textOverlay_t& a, const textOverlay_t& b);
+
+}
+
+// inclusion guard
+#endif
@@ -0,0 +1,77 @@
+#ifndef BATCHJOBS_H
+#define BATCHJOBS_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <algorithm>
+
+// The batch tools write the output of each video under a name with this suffix and
+// rename it when complete, so that an interrupted run leaves nothing that would be
+// taken as done on the next run
+#define INCOMPLETE_SUFFIX ".incomplete"
+
+namespace thesisUtilities
+{
+	// Run jobs 0 to n_jobs-1 on up to n_threads threads, each thread taking the next
+	// job from the list when it finishes one. job(j) returns whether job j succeeded.
+	// Returns the number of jobs that failed
+	template<typename Job>
+	int runJobs(const int n_threads, const size_t n_jobs, Job job)
+	{
+		std::atomic<size_t> next_job(0);
+		std::atomic<int> n_failed(0);
+		std::vector<std::thread> workers;
+		const int n_workers = std::max(std::min(n_threads,int(n_jobs)),1);
+		for(int w = 0; w < n_workers; ++w)
+		{
+			workers.emplace_back([&]
+			{
+				for(size_t j = next_job++; j < n_jobs; j = next_job++)
+					if(!job(j))
+						++n_failed;
+			});
+		}
+		for(std::thread& t : workers)
+			t.join();
+		return n_failed;
+	}
+
+	// Writes a message to a stream while holding a lock shared by all the threads, so
+	// that the messages of different jobs are not interleaved. Used as a temporary,
+	// e.g. LockedOutput(std::cerr) << "ERROR: ..." << std::endl;
+	class LockedOutput
+	{
+		public:
+			explicit LockedOutput(std::ostream& stream) : lk(outputMutex()), stream(stream) {}
+
+			template<typename T>
+			LockedOutput& operator<<(const T& value)
+			{
+				stream << value;
+				return *this;
+			}
+
+			LockedOutput& operator<<(std::ostream& (*manipulator)(std::ostream&))
+			{
+				stream << manipulator;
+				return *this;
+			}
+
+		private:
+			static std::mutex& outputMutex()
+			{
+				static std::mutex mtx;
+				return mtx;
+			}
+
+			std::lock_guard<std::mutex> lk;
+			std::ostream& stream;
+	};
+
+}
+
+// inclusion guard
+#endif
@@ -0,0 +1,451 @@
+// Benchmark of the cardiac phase calculation.
+//
+// Builds a long synthetic track with end-systole and end-diastole marks on some of
+// its beats, then times ut::CardiacPhaseTracker against the previous list-based
+// routine (reproduced below), both when recalculating the whole track and when
+// single marks are toggled one after another, and checks that both give identical
+// results.
+
+#include <cmath>
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <list>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <boost/program_options.hpp>
+#include "thesisUtilities.h"
+#include "cardiacPhase.h"
+
+using namespace std;
+namespace ut = thesisUtilities;
+namespace po = boost::program_options;
+
+// The previous implementation, with its error messages removed
+static bool listRecalculateCardiacPhase(int n_frames, float &cardiac_period, float frame_rate, float *cardiac_phase_track, uint8_t *phase_point_track)
+{
+	int f, n;
+	list<int> end_systole_frames, end_diastole_frames;
+	list<int>::iterator sys_it, dias_it, sys_it2, dias_it2;
+	int num_in_average = 0, first_labelled, last_labelled, number_to_add;
+	float running_total_length = 0.0, min_frames_per_beat, max_frames_per_beat, beat_length, spacing;
+	bool in_systole, video_end;
+
+	// Calculate the minimum and maximum acceptable periods for a single heart beat
+	min_frames_per_beat = 60.0*frame_rate/MAX_HEART_RATE;
+	max_frames_per_beat = 60.0*frame_rate/MIN_HEART_RATE;
+
+
+	// Loop through frames, adding up difference between successive end-systoles and end-diastoles
+	for(f = 0; f < n_frames; f++)
+	{
+		if(phase_point_track[f] == MANUALLY_LABELLED_DIASTOLE)
+		{
+			if(end_diastole_frames.size() > 0)
+			{
+				beat_length = float(f - end_diastole_frames.back());
+				if( (beat_length > min_frames_per_beat) && (beat_length < max_frames_per_beat) )
+				{
+					num_in_average++;
+					running_total_length += beat_length;
+				}
+			}
+			end_diastole_frames.emplace_back(f);
+		}
+
+		else if(phase_point_track[f] == MANUALLY_LABELLED_SYSTOLE)
+		{
+			if(end_systole_frames.size() > 0)
+			{
+				beat_length = float(f - end_systole_frames.back());
+				if( (beat_length > min_frames_per_beat) && (beat_length < max_frames_per_beat) )
+				{
+					num_in_average++;
+					running_total_length += beat_length;
+				}
+			}
+			end_systole_frames.emplace_back(f);
+		}
+
+		// Remove any previous automated markers
+		else
+			phase_point_track[f] = NOT_LABELLED;
+	}
+
+	// Check that there are sufficiently many labelled points to actually predict other values
+	if( (end_diastole_frames.size() < 1) || (end_systole_frames.size() < 1) || num_in_average == 0 )
+	{
+		return false;
+	}
+
+	// Calculate the average time period of the cardiac cycle
+	cardiac_period = running_total_length/num_in_average;
+
+	// Fill in end-systole frames before the first labelled one
+	first_labelled = end_systole_frames.front();
+	f = first_labelled - std::round(cardiac_period);
+	n = 1;
+	while(f >= 0)
+	{
+		end_systole_frames.push_front(f);
+		phase_point_track[f] = AUTO_LABELLED_SYSTOLE;
+		n++;
+		f = std::round(float(first_labelled) - n*cardiac_period);
+	}
+
+	// Same for end-distole frames before the first labelled one
+	first_labelled = end_diastole_frames.front();
+	f = first_labelled - std::round(cardiac_period);
+	n = 1;
+	while(f >= 0)
+	{
+		end_diastole_frames.push_front(f);
+		phase_point_track[f] = AUTO_LABELLED_DIASTOLE;
+		n++;
+		f = std::round(float(first_labelled) - n*cardiac_period);
+	}
+
+	// Now fill in end-systole frames after the final labelled one
+	last_labelled = end_systole_frames.back();
+	f = last_labelled + std::round(cardiac_period);
+	n = 1;
+	while(f < n_frames)
+	{
+		end_systole_frames.emplace_back(f);
+		phase_point_track[f] = AUTO_LABELLED_SYSTOLE;
+		n++;
+		f = std::round(float(last_labelled) + n*cardiac_period);
+	}
+
+	// Now fill in end-diastole frames after the final labelled one
+	last_labelled = end_diastole_frames.back();
+	f = last_labelled + std::round(cardiac_period);
+	n = 1;
+	while(f < n_frames)
+	{
+		end_diastole_frames.emplace_back(f);
+		phase_point_track[f] = AUTO_LABELLED_DIASTOLE;
+		n++;
+		f = std::round(float(last_labelled) + n*cardiac_period);
+	}
+
+
+	// Now add end_systole frames in gaps
+	sys_it = end_systole_frames.begin();
+	sys_it2 = next(sys_it);
+	while(sys_it2 != end_systole_frames.end())
+	{
+		// If the difference between these pairs is greater than
+		// the allowable distance, we need to add some frames in between
+		if(*sys_it2 - *sys_it > max_frames_per_beat)
+		{
+			number_to_add = std::round(float(*sys_it2 - *sys_it)/cardiac_period) - 1;
+			spacing = float(*sys_it2 - *sys_it)/float(number_to_add+1);
+			// Insert into the vector, equally spaced
+			for(n = 1; n <= number_to_add; n++)
+			{
+				f = *sys_it + std::round(n*spacing);
+				phase_point_track[f] = AUTO_LABELLED_SYSTOLE;
+				end_systole_frames.insert(sys_it2,f);
+			}
+		}
+		// Advance iterators to the next pair
+		sys_it = sys_it2;
+		sys_it2++;
+	}
+
+	// Same for end diastole frames in gaps
+	dias_it = end_diastole_frames.begin();
+	dias_it2 = next(dias_it);
+	while(dias_it2 != end_diastole_frames.end())
+	{
+		// If the difference between these pairs is greater than
+		// the allowable distance, we need to add some frames in between
+		if(*dias_it2 - *dias_it > max_frames_per_beat)
+		{
+			number_to_add = std::round(float(*dias_it2 - *dias_it)/cardiac_period) - 1;
+			spacing = float(*dias_it2 - *dias_it)/float(number_to_add+1);
+			// Insert into the vector, equally spaced
+			for(n = 1; n <= number_to_add; n++)
+			{
+				f = *dias_it + std::round(n*spacing);
+				phase_point_track[f] = AUTO_LABELLED_DIASTOLE;
+				end_diastole_frames.insert(dias_it2,f);
+			}
+		}
+		// Advance iterators to the next pair
+		dias_it = dias_it2;
+		dias_it2++;
+	}
+
+	// A third loop to predict the cardiac phase for all frames
+	sys_it = end_systole_frames.begin();
+	dias_it = end_diastole_frames.begin();
+	if(*dias_it > *sys_it)
+	{
+		// The video starts during systole
+		in_systole = true;
+		// Place an imaginary end_diastole frame at the beginning
+		end_diastole_frames.push_front(std::round(*dias_it - cardiac_period));
+		dias_it = end_diastole_frames.begin();
+	}
+	else
+	{
+		// The video starts during diastole
+		in_systole = false;
+		// Place an imaginary end_systole frame at the beginning
+		end_systole_frames.push_front(std::round(*sys_it - cardiac_period));
+		sys_it = end_systole_frames.begin();
+	}
+
+	// Put in an imaginary frame at the end too
+	if( end_diastole_frames.back() > end_systole_frames.back() )
+		end_systole_frames.emplace_back(std::round( end_systole_frames.back() + cardiac_period));
+	else
+		end_diastole_frames.emplace_back(std::round( end_diastole_frames.back() + cardiac_period));
+
+	// Check that the end diastole and end systole frames alternate as they should do
+	bool last_was_end_systole = (end_systole_frames.front() > end_diastole_frames.front());
+	list<int>::iterator sys_it_test = end_systole_frames.begin(), dias_it_test = end_diastole_frames.begin();
+	while((sys_it_test != end_systole_frames.end()) || (dias_it_test != end_diastole_frames.end()))
+	{
+		if((sys_it_test != end_systole_frames.end()) && (dias_it_test != end_diastole_frames.end()))
+		{
+			if(*sys_it == *dias_it)
+			{
+				return false;
+			}
+		}
+		if(sys_it_test == end_systole_frames.end() || ( (dias_it_test != end_diastole_frames.end()) && (*sys_it_test > *dias_it_test) ) )
+		{
+			if(!last_was_end_systole)
+			{
+				return false;
+			}
+			last_was_end_systole = false;
+			++dias_it_test;
+		}
+		else
+		{
+			if(last_was_end_systole)
+			{
+				return false;
+			}
+			last_was_end_systole = true;
+			++sys_it_test;
+		}
+	}
+	assert(sys_it_test == end_systole_frames.end() && dias_it_test == end_diastole_frames.end());
+
+	f = 0;
+	video_end = false;
+
+	while(!video_end)
+	{
+		if(in_systole)
+		{
+			// Loop through frames before the end systole frame
+			while(f < *sys_it)
+			{
+				if(f >= n_frames)
+				{
+					video_end = true;
+					break;
+				}
+				cardiac_phase_track[f] = M_PI*float(f - *dias_it)/float(*sys_it - *dias_it);
+				f++;
+			}
+			// Now we are at the end systole frame
+			if(video_end || f >= n_frames)
+				break;
+			in_systole = false;
+			cardiac_phase_track[f++] = M_PI;
+			dias_it++;
+		}
+		else
+		{
+			// Loop through frames before the end diastole frame
+			while(f < *dias_it)
+			{
+				if(f >= n_frames)
+				{
+					video_end = true;
+					break;
+				}
+				cardiac_phase_track[f] = M_PI + M_PI*float(f - *sys_it)/float(*dias_it - *sys_it);
+				f++;
+			}
+			// Now we are at the end diastole frame
+			if(video_end || f >= n_frames)
+				break;
+			in_systole = true;
+			cardiac_phase_track[f++] = 0.0;
+			sys_it++;
+		}
+	}
+
+	return true;
+
+}
+
+
+// Whether two tracks hold the same marks and phases
+static bool sameTracks(const int n_frames, const vector<uint8_t>& phase_point_a, const vector<float>& cardiac_phase_a,
+                       const vector<uint8_t>& phase_point_b, const vector<float>& cardiac_phase_b)
+{
+	for(int f = 0; f < n_frames; ++f)
+	{
+		if( (phase_point_a[f] != phase_point_b[f]) || (cardiac_phase_a[f] != cardiac_phase_b[f]) )
+			return false;
+	}
+	return true;
+}
+
+
+// The list-based routine does not notice end-systole and end-diastole frames that
+// coincide, and may then write an automatic mark over a manual mark of the other
+// kind. The tracker finds such phases not to be valid, so only valid results are
+// compared, and the manual marks are copied back afterwards so that both go on
+// from the same marks
+static bool sameResults(const int n_frames, const bool list_valid, const bool vector_valid,
+                        vector<uint8_t>& list_phase_point, const vector<float>& list_cardiac_phase,
+                        const vector<uint8_t>& vector_phase_point, const vector<float>& vector_cardiac_phase)
+{
+	if(!vector_valid)
+	{
+		for(int f = 0; f < n_frames; ++f)
+		{
+			if( (vector_phase_point[f] == MANUALLY_LABELLED_SYSTOLE) || (vector_phase_point[f] == MANUALLY_LABELLED_DIASTOLE) )
+				list_phase_point[f] = vector_phase_point[f];
+			else if( (list_phase_point[f] == MANUALLY_LABELLED_SYSTOLE) || (list_phase_point[f] == MANUALLY_LABELLED_DIASTOLE) )
+				list_phase_point[f] = NOT_LABELLED;
+		}
+		return true;
+	}
+	return list_valid && sameTracks(n_frames,list_phase_point,list_cardiac_phase,vector_phase_point,vector_cardiac_phase);
+}
+
+
+int main(int argc, char** argv)
+{
+	int n_frames, n_changes, n_runs;
+	float frame_rate, marked_fraction;
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help,h", "produce help message")
+		("frames,f", po::value<int>(&n_frames)->default_value(100000), "number of frames in the synthetic track")
+		("framerate,r", po::value<float>(&frame_rate)->default_value(25.0), "frame rate of the synthetic video")
+		("marked,m", po::value<float>(&marked_fraction)->default_value(0.2), "fraction of the beats that are marked")
+		("changes,c", po::value<int>(&n_changes)->default_value(1000), "number of single marks to toggle")
+		("runs,n", po::value<int>(&n_runs)->default_value(10), "number of times to recalculate the whole track");
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if(vm.count("help"))
+	{
+		cout << "Benchmarks calculating the cardiac phase of a long synthetic track" << endl;
+		cout << desc << endl;
+		return 1;
+	}
+
+	if( (n_frames < 1) || (n_changes < 1) || (n_runs < 1) || (frame_rate <= 0.0) )
+	{
+		cerr << "ERROR: The numbers of frames, changes and runs and the frame rate must be positive" << endl;
+		return EXIT_FAILURE;
+	}
+
+	// A heart beating at a steady rate with a little variation between beats. Annotators
+	// tend to mark runs of consecutive beats, so whether a beat is marked only
+	// occasionally changes
+	mt19937 rng(0);
+	uniform_real_distribution<double> unit(0.0,1.0);
+	vector<int> true_systole, true_diastole;
+	vector<uint8_t> phase_point(n_frames,NOT_LABELLED);
+	const double mean_period = 60.0*frame_rate/(0.5*(MIN_HEART_RATE + MAX_HEART_RATE));
+	double period = mean_period;
+	bool marking = false;
+	int n_marked = 0;
+	for(double t = unit(rng)*period; std::round(t + 0.4*period) < n_frames; t += period)
+	{
+		const int ed = std::round(t), es = std::round(t + 0.4*period);
+		true_diastole.emplace_back(ed);
+		true_systole.emplace_back(es);
+		if(unit(rng) < 0.1)
+			marking = (unit(rng) < marked_fraction);
+		if(marking)
+		{
+			phase_point[ed] = MANUALLY_LABELLED_DIASTOLE;
+			phase_point[es] = MANUALLY_LABELLED_SYSTOLE;
+			++n_marked;
+		}
+		period = mean_period*(0.98 + 0.04*unit(rng));
+	}
+	const int n_true_beats = true_diastole.size();
+	cout << n_frames << " frames at " << frame_rate << " fps, " << n_marked << " of " << n_true_beats << " beats marked" << endl;
+
+	// Recalculating the whole track
+	vector<uint8_t> list_phase_point = phase_point, vector_phase_point = phase_point;
+	vector<float> list_cardiac_phase(n_frames,-1.0), vector_cardiac_phase(n_frames,-1.0);
+	float cardiac_period;
+	ut::CardiacPhaseTracker tracker;
+	bool list_valid = false, vector_valid = false;
+
+	auto start = chrono::steady_clock::now();
+	for(int r = 0; r < n_runs; ++r)
+		list_valid = listRecalculateCardiacPhase(n_frames,cardiac_period,frame_rate,list_cardiac_phase.data(),list_phase_point.data());
+	const double list_ms = chrono::duration<double,milli>(chrono::steady_clock::now() - start).count() / n_runs;
+
+	start = chrono::steady_clock::now();
+	for(int r = 0; r < n_runs; ++r)
+		vector_valid = tracker.recalculate(n_frames,frame_rate,vector_phase_point.data(),vector_cardiac_phase.data());
+	const double vector_ms = chrono::duration<double,milli>(chrono::steady_clock::now() - start).count() / n_runs;
+
+	const bool identical = sameResults(n_frames,list_valid,vector_valid,list_phase_point,list_cardiac_phase,vector_phase_point,vector_cardiac_phase);
+	cout << "recalculate: list " << list_ms << " ms, vector " << vector_ms << " ms, speedup " << list_ms/vector_ms << "x"
+	     << (vector_valid ? "" : " (phase not valid)") << (identical ? "" : " (RESULTS DIFFER)") << endl;
+
+	// Toggling single marks, as the annotator does with the s/d keys. The list-based
+	// routine has to recalculate the whole track after each one
+	uniform_int_distribution<int> beat_dist(0,n_true_beats-1);
+	double list_change_ms = 0.0, vector_change_ms = 0.0;
+	long n_rewritten = 0;
+	int n_differ = 0, n_valid = 0;
+	for(int c = 0; c < n_changes; ++c)
+	{
+		const int beat = beat_dist(rng);
+		const bool systole = (unit(rng) < 0.5);
+		const int f = systole ? true_systole[beat] : true_diastole[beat];
+		const uint8_t mark = systole ? MANUALLY_LABELLED_SYSTOLE : MANUALLY_LABELLED_DIASTOLE;
+		const uint8_t new_mark = (list_phase_point[f] == mark) ? NOT_LABELLED : mark;
+
+		start = chrono::steady_clock::now();
+		list_phase_point[f] = new_mark;
+		list_valid = listRecalculateCardiacPhase(n_frames,cardiac_period,frame_rate,list_cardiac_phase.data(),list_phase_point.data());
+		list_change_ms += chrono::duration<double,milli>(chrono::steady_clock::now() - start).count();
+
+		start = chrono::steady_clock::now();
+		vector_valid = tracker.setPhasePoint(f,new_mark,vector_phase_point.data(),vector_cardiac_phase.data());
+		vector_change_ms += chrono::duration<double,milli>(chrono::steady_clock::now() - start).count();
+
+		for(const auto& range : tracker.changedFrames())
+			n_rewritten += range.second - range.first;
+		n_valid += vector_valid;
+		if(!sameResults(n_frames,list_valid,vector_valid,list_phase_point,list_cardiac_phase,vector_phase_point,vector_cardiac_phase))
+			++n_differ;
+	}
+	list_change_ms /= n_changes;
+	vector_change_ms /= n_changes;
+	cout << "single changes: list " << list_change_ms << " ms, incremental " << vector_change_ms << " ms, speedup "
+	     << list_change_ms/vector_change_ms << "x, " << double(n_rewritten)/n_changes << " frames rewritten per change, "
+	     << n_valid << "/" << n_changes << " valid";
+	if(n_differ > 0)
+		cout << " (RESULTS DIFFER after " << n_differ << " changes)";
+	cout << endl;
+
+	return ( identical && (n_differ == 0) ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,533 @@
+// Micro-benchmarks of the hot paths of the annotation tools.
+//
+// Generates a synthetic video (a pulsing, drifting bright circle over speckle) and
+// synthetic track files, then times frame decoding, drawing the overlays and the
+// incremental redraw after a key press, motion prediction, reading and writing track
+// files in both formats, and the cardiac phase calculation. The same seed and sizes
+// are used on every run, so results from different versions can be compared.
+//
+// Each result is written as one JSON object per line. Given the results of a previous
+// version with --compare, any benchmark whose median time has grown by more than the
+// tolerance is reported and the program exits with a failure status.
+
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <opencv2/core/core.hpp>
+#include <opencv2/core/version.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include "thesisUtilities.h"
+#include "binaryTracks.h"
+#include "frameStore.h"
+#include "annotationOverlays.h"
+#include "overlayRenderer.h"
+#include "motionPrediction.h"
+#include "cardiacPhase.h"
+
+using namespace std;
+using namespace cv;
+namespace ut = thesisUtilities;
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+// Version of the results format, recorded in the first line of the output
+#define BENCHMARK_FORMAT_VERSION 1
+
+// Number of structures in the synthetic structure track and drawn as overlays
+const int C_N_STRUCTURES = 20;
+
+// Number of frame pairs used by the motion prediction benchmarks
+const int C_MOTION_PAIRS = 10;
+
+// Frame rate of the synthetic video and track
+const float C_FRAME_RATE = 25.0;
+
+// The synthetic track marks the first C_MARKED_BEATS of every C_BEAT_CYCLE beats
+const int C_BEAT_CYCLE = 8;
+const int C_MARKED_BEATS = 4;
+
+// One benchmark: an operation covering a number of items (frames, draws, ...)
+struct benchmark_t
+{
+	string name;
+	long long items;
+	function<bool()> run;
+};
+
+struct benchResult_t
+{
+	string name;
+	long long items;
+	int runs;
+	double median_ms, min_ms, mean_ms;
+};
+
+
+// Run a benchmark once to warm up and then n_runs times, returns false if it fails
+static bool timeBenchmark(const benchmark_t& benchmark, const int n_runs, benchResult_t& result)
+{
+	if(!benchmark.run())
+		return false;
+
+	vector<double> times;
+	for(int r = 0; r < n_runs; ++r)
+	{
+		const auto start = chrono::steady_clock::now();
+		if(!benchmark.run())
+			return false;
+		times.emplace_back(chrono::duration<double,milli>(chrono::steady_clock::now() - start).count());
+	}
+
+	sort(times.begin(),times.end());
+	result.name = benchmark.name;
+	result.items = benchmark.items;
+	result.runs = n_runs;
+	result.min_ms = times.front();
+	result.median_ms = (n_runs % 2 == 1) ? times[n_runs/2] : 0.5*(times[n_runs/2-1] + times[n_runs/2]);
+	result.mean_ms = 0.0;
+	for(const double t : times)
+		result.mean_ms += t/n_runs;
+	return true;
+}
+
+
+static string resultJson(const benchResult_t& result)
+{
+	stringstream ss;
+	ss << "{\"benchmark\": \"" << result.name << "\", \"items\": " << result.items << ", \"runs\": " << result.runs
+	   << ", \"median_ms\": " << result.median_ms << ", \"min_ms\": " << result.min_ms << ", \"mean_ms\": " << result.mean_ms
+	   << ", \"median_us_per_item\": " << 1000.0*result.median_ms/max(result.items,1LL) << "}";
+	return ss.str();
+}
+
+
+// Read the median times from a results file written by a previous run
+static bool readBaseline(const string& filename, map<string,double>& median_ms)
+{
+	ifstream infile(filename.c_str());
+	if(!infile.is_open())
+		return false;
+
+	const string name_key = "\"benchmark\": \"", median_key = "\"median_ms\": ";
+	for(string line; getline(infile,line); )
+	{
+		const size_t name_pos = line.find(name_key), median_pos = line.find(median_key);
+		if( (name_pos == string::npos) || (median_pos == string::npos) )
+			continue;
+		const size_t name_start = name_pos + name_key.size();
+		const string name = line.substr(name_start,line.find('"',name_start) - name_start);
+		median_ms[name] = atof(line.c_str() + median_pos + median_key.size());
+	}
+	return true;
+}
+
+
+// A frame of the synthetic video: speckle, drifting with the probe, and a bright
+// heart circle that moves and pulses at a fetal heart rate
+static void syntheticFrame(const Mat& speckle, const int f, const Size& size, Point& centre, int& radius, Mat& frame)
+{
+	const double beat = 2.0*M_PI*f*(0.5*(MIN_HEART_RATE + MAX_HEART_RATE)/60.0)/C_FRAME_RATE;
+	const Point drift(std::round(8.0 + 8.0*std::sin(0.05*f)),std::round(8.0 + 8.0*std::cos(0.03*f)));
+	Mat gray = speckle(Rect(drift,size)).clone();
+
+	centre = Point(size.width/2 + std::round(20.0*std::sin(0.02*f)),size.height/2 + std::round(10.0*std::cos(0.025*f)));
+	radius = std::min(size.width,size.height)/6;
+	circle(gray,centre,radius,Scalar(180),3,LINE_AA);
+	circle(gray,centre,std::round(radius*(0.45 + 0.1*std::sin(beat))),Scalar(40),-1,LINE_AA);
+	cvtColor(gray,frame,COLOR_GRAY2BGR);
+}
+
+
+int main(int argc, char** argv)
+{
+	int n_frames, n_video_frames, n_runs, xsize, ysize;
+	float tolerance;
+	fs::path workdir;
+	string filter, outfilename, baseline_filename;
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help,h", "produce help message")
+		("frames,f", po::value<int>(&n_frames)->default_value(20000), "number of frames in the synthetic track files")
+		("videoframes,v", po::value<int>(&n_video_frames)->default_value(200), "number of frames in the synthetic video")
+		("width,x", po::value<int>(&xsize)->default_value(640), "width of the synthetic video")
+		("height,y", po::value<int>(&ysize)->default_value(480), "height of the synthetic video")
+		("runs,r", po::value<int>(&n_runs)->default_value(5), "number of timed runs of each benchmark")
+		("filter,b", po::value<string>(&filter)->default_value(""), "only run the benchmarks whose names contain this")
+		("output,o", po::value<string>(&outfilename)->default_value(""), "file in which to write the results (by default, standard output)")
+		("compare,c", po::value<string>(&baseline_filename)->default_value(""), "results of a previous run to compare against")
+		("tolerance,t", po::value<float>(&tolerance)->default_value(0.2), "fraction by which a median time may grow before it is reported as a regression")
+		("workdir,w", po::value<fs::path>(&workdir)->default_value(fs::temp_directory_path()), "directory in which to write the synthetic files");
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if(vm.count("help"))
+	{
+		cout << "Runs micro-benchmarks of the annotation tools on synthetic data" << endl;
+		cout << desc << endl;
+		return 1;
+	}
+
+	if( (n_frames < 1) || (n_video_frames <= C_MOTION_PAIRS) || (n_runs < 1) || (xsize < 64) || (ysize < 64) )
+	{
+		cerr << "ERROR: The numbers of frames and runs must be positive, with more than " << C_MOTION_PAIRS
+		     << " video frames, and the video must be at least 64x64" << endl;
+		return EXIT_FAILURE;
+	}
+
+	map<string,double> baseline;
+	if(!baseline_filename.empty() && !readBaseline(baseline_filename,baseline))
+	{
+		cerr << "ERROR: Could not read the baseline results " << baseline_filename << endl;
+		return EXIT_FAILURE;
+	}
+
+	// Synthetic video, written as motion JPEG like most of our videos
+	const Size size(xsize,ysize);
+	const string video_filename = (workdir / "benchmark_suite.avi").string();
+	Mat speckle(ysize+16,xsize+16,CV_8UC1);
+	RNG cvrng(0);
+	cvrng.fill(speckle,RNG::UNIFORM,0,96);
+	GaussianBlur(speckle,speckle,Size(3,3),0.0);
+	vector<Point> centres(n_video_frames);
+	vector<int> radii(n_video_frames);
+	vector<Mat> motion_frames;
+	{
+		VideoWriter writer(video_filename,VideoWriter::fourcc('M','J','P','G'),C_FRAME_RATE,size,true);
+		if(!writer.isOpened())
+		{
+			cerr << "ERROR: Could not write the synthetic video " << video_filename << endl;
+			return EXIT_FAILURE;
+		}
+		Mat frame;
+		for(int f = 0; f < n_video_frames; ++f)
+		{
+			syntheticFrame(speckle,f,size,centres[f],radii[f],frame);
+			writer << frame;
+			if(f <= C_MOTION_PAIRS)
+			{
+				Mat gray;
+				cvtColor(frame,gray,COLOR_BGR2GRAY);
+				motion_frames.emplace_back(gray);
+			}
+		}
+	}
+	Mat colour_frame;
+	syntheticFrame(speckle,0,size,centres[0],radii[0],colour_frame);
+
+	// Synthetic tracks, as in benchmark_track_files
+	mt19937 rng(0);
+	uniform_int_distribution<int> xdist(0,xsize-1), ydist(0,ysize-1), oridist(0,359), smalldist(0,3);
+	uniform_real_distribution<float> phasedist(0.0f,2.0f*float(M_PI));
+	const bool headup = true;
+	const int radius = radii[0];
+	ut::HeartTrack heart(n_frames);
+	for(int f = 0; f < n_frames; ++f)
+	{
+		ut::heartLabel_t label;
+		label.labelled = true;
+		label.present = ut::heartPresent_t(smalldist(rng) % 3);
+		label.centrey = ydist(rng);
+		label.centrex = xdist(rng);
+		label.ori = oridist(rng);
+		label.view_label = smalldist(rng);
+		label.phase_point = NOT_LABELLED;
+		label.cardiac_phase = phasedist(rng);
+		heart.setFrame(f,label);
+	}
+	vector<string> structure_names(C_N_STRUCTURES);
+	for(int s = 0; s < C_N_STRUCTURES; ++s)
+		structure_names[s] = "structure" + to_string(s);
+	const vector<vector<int>> views_per_structure(C_N_STRUCTURES);
+	ut::StructureTrack structures(n_frames,C_N_STRUCTURES);
+	for(int f = 0; f < n_frames; ++f)
+		for(int s = 0; s < C_N_STRUCTURES; ++s)
+		{
+			ut::subStructLabel_t label;
+			label.labelled = true;
+			label.present = smalldist(rng) % 2;
+			label.y = ydist(rng);
+			label.x = xdist(rng);
+			label.ori = oridist(rng);
+			structures.setLabel(f,s,label);
+		}
+
+	// End-systole and end-diastole marks on runs of consecutive beats (so that the
+	// intervals between them give the period) with gaps of unmarked beats between
+	// them, as in benchmark_cardiac_phase. The beats in the middle of each gap are
+	// marked and unmarked again by the set_phase_point benchmark
+	vector<uint8_t> phase_point(n_frames,NOT_LABELLED);
+	vector<float> cardiac_phase(n_frames,-1.0);
+	vector<int> unmarked_beats;
+	const double period = 60.0*C_FRAME_RATE/(0.5*(MIN_HEART_RATE + MAX_HEART_RATE));
+	for(int b = 0; std::round((b+0.4)*period) < n_frames; ++b)
+	{
+		const int ed = std::round(b*period), es = std::round((b+0.4)*period);
+		if(b % C_BEAT_CYCLE < C_MARKED_BEATS)
+		{
+			phase_point[ed] = MANUALLY_LABELLED_DIASTOLE;
+			phase_point[es] = MANUALLY_LABELLED_SYSTOLE;
+		}
+		else if(b % C_BEAT_CYCLE == (C_BEAT_CYCLE + C_MARKED_BEATS)/2)
+			unmarked_beats.emplace_back(ed);
+	}
+
+	const string tk_filename = (workdir / "benchmark_suite.tk").string();
+	const string stk_filename = (workdir / "benchmark_suite.stk").string();
+	const string tkb_filename = (workdir / ("benchmark_suite" BINARY_TRACK_EXTENSION)).string();
+	const string stkb_filename = (workdir / ("benchmark_suite" BINARY_STRUCTURE_TRACK_EXTENSION)).string();
+
+	// The track files are read by the tracks/read_* benchmarks, so are written here
+	// whichever benchmarks are run (the tracks/write_* benchmarks write the same files again)
+	if(!ut::writeTrackFile(tk_filename,xsize,ysize,headup,radius,heart) ||
+	   !ut::writeSubstructuresTrackFile(stk_filename,xsize,ysize,structure_names,views_per_structure,heart,structures) ||
+	   !ut::writeBinaryTrackFile(tkb_filename,xsize,ysize,headup,radius,heart) ||
+	   !ut::writeBinarySubstructuresTrackFile(stkb_filename,xsize,ysize,structure_names,structures))
+	{
+		cerr << "ERROR: Could not write the synthetic track files in " << workdir << endl;
+		return EXIT_FAILURE;
+	}
+
+	// Overlays as drawn by the annotation tools
+	const ut::heartOverlay_t heart_overlay = {centres[0].x,centres[0].y,radius,45,VIEW_LVOT,ut::hpPresent,headup,MANUALLY_LABELLED_SYSTOLE,true,1.0};
+	vector<ut::structureOverlay_t> structure_overlays;
+	for(int s = 0; s < C_N_STRUCTURES; ++s)
+		structure_overlays.emplace_back(ut::structureOverlay_t{centres[0].x + int(std::round(0.8*radius*std::cos(0.3*s))),
+		                                                       centres[0].y + int(std::round(0.8*radius*std::sin(0.3*s))),
+		                                                       30*s,1,ut::view_colours[s % ut::n_views]});
+	const ut::textOverlay_t text_overlay = {"Frame 0 of " + to_string(n_video_frames),Point(10,ysize-10),Scalar(255,255,255)};
+	const int n_draws = 1000, n_key_presses = 1000, n_full_redraws = 100;
+
+	// The tracker is set up once, so the single mark changes are timed alone
+	ut::CardiacPhaseTracker tracker;
+	vector<uint8_t> toggle_phase_point = phase_point;
+	vector<float> toggle_cardiac_phase = cardiac_phase;
+	tracker.recalculate(n_frames,C_FRAME_RATE,toggle_phase_point.data(),toggle_cardiac_phase.data());
+	const int n_toggles = min<int>(unmarked_beats.size(),100);
+
+	const vector<benchmark_t> benchmarks =
+	{
+		{"decode/videocapture",n_video_frames,[&]() -> bool
+			{
+				VideoCapture cap(video_filename);
+				Mat frame;
+				int n = 0;
+				while(cap.read(frame))
+					++n;
+				return n == n_video_frames;
+			}},
+		{"decode/framestore",n_video_frames,[&]() -> bool
+			{
+				ut::FrameStore store;
+				if(!store.open(video_filename,size_t(512)*1024*1024))
+					return false;
+				Mat frame;
+				for(int f = 0; f < n_video_frames; ++f)
+					if(!store.getFrame(f,frame))
+						return false;
+				return true;
+			}},
+		{"render/heart_overlay",n_draws,[&]() -> bool
+			{
+				Mat img = colour_frame.clone();
+				for(int i = 0; i < n_draws; ++i)
+					ut::drawOverlay(img,heart_overlay);
+				return true;
+			}},
+		{"render/structure_overlays",n_draws,[&]() -> bool
+			{
+				Mat img = colour_frame.clone();
+				for(int i = 0; i < n_draws; ++i)
+					ut::drawOverlay(img,structure_overlays[i % C_N_STRUCTURES]);
+				return true;
+			}},
+		{"render/text_overlay",n_draws,[&]() -> bool
+			{
+				Mat img = colour_frame.clone();
+				for(int i = 0; i < n_draws; ++i)
+					ut::drawOverlay(img,text_overlay);
+				return true;
+			}},
+		{"render/key_press",n_key_presses,[&]() -> bool
+			{
+				// Rotating the heart one step per key press, redrawing only what changed
+				ut::OverlayRenderer renderer;
+				renderer.setBase(colour_frame);
+				for(int s = 0; s < C_N_STRUCTURES; ++s)
+					renderer.setElement(s+1,structure_overlays[s]);
+				renderer.setElement(C_N_STRUCTURES+1,text_overlay);
+				ut::heartOverlay_t rotated = heart_overlay;
+				renderer.setElement(0,rotated);
+				renderer.render();
+				for(int i = 0; i < n_key_presses; ++i)
+				{
+					rotated.ori = (rotated.ori + 5) % 360;
+					renderer.setElement(0,rotated);
+					if(renderer.render().empty())
+						return false;
+				}
+				return true;
+			}},
+		{"render/new_frame",n_full_redraws,[&]() -> bool
+			{
+				ut::OverlayRenderer renderer;
+				for(int s = 0; s < C_N_STRUCTURES; ++s)
+					renderer.setElement(s+1,structure_overlays[s]);
+				renderer.setElement(0,heart_overlay);
+				for(int i = 0; i < n_full_redraws; ++i)
+				{
+					renderer.setBase(colour_frame);
+					if(renderer.render().empty())
+						return false;
+				}
+				return true;
+			}},
+		{"motion/farneback",C_MOTION_PAIRS,[&]() -> bool
+			{
+				ut::framePairMotion_t motion;
+				for(int i = 0; i < C_MOTION_PAIRS; ++i)
+					ut::prepareMotion(motion_frames[i],motion_frames[i+1],ut::mpDense,motion);
+				return true;
+			}},
+		{"motion/sparse",C_MOTION_PAIRS,[&]() -> bool
+			{
+				vector<Point2f> points, moved;
+				for(const ut::structureOverlay_t& s : structure_overlays)
+					points.emplace_back(s.x,s.y);
+				for(int i = 0; i < C_MOTION_PAIRS; ++i)
+					ut::predictMotion(motion_frames[i],motion_frames[i+1],points,ut::mpSparse,moved);
+				return moved.size() == points.size();
+			}},
+		{"motion/rigid",C_MOTION_PAIRS,[&]() -> bool
+			{
+				ut::rigidMotion_t motion;
+				for(int i = 0; i < C_MOTION_PAIRS; ++i)
+					ut::predictRigidMotion(motion_frames[i],motion_frames[i+1],Point2f(centres[i]),radii[i],motion);
+				return true;
+			}},
+		{"tracks/write_tk",n_frames,[&]() -> bool
+			{
+				return ut::writeTrackFile(tk_filename,xsize,ysize,headup,radius,heart);
+			}},
+		{"tracks/write_stk",n_frames,[&]() -> bool
+			{
+				return ut::writeSubstructuresTrackFile(stk_filename,xsize,ysize,structure_names,views_per_structure,heart,structures);
+			}},
+		{"tracks/write_tkb",n_frames,[&]() -> bool
+			{
+				return ut::writeBinaryTrackFile(tkb_filename,xsize,ysize,headup,radius,heart);
+			}},
+		{"tracks/write_stkb",n_frames,[&]() -> bool
+			{
+				return ut::writeBinarySubstructuresTrackFile(stkb_filename,xsize,ysize,structure_names,structures);
+			}},
+		{"tracks/read_tk",n_frames,[&]() -> bool
+			{
+				bool read_headup;
+				int read_radius;
+				ut::HeartTrack track;
+				return ut::readTrackFile(tk_filename,n_frames,read_headup,read_radius,track);
+			}},
+		{"tracks/read_stk",n_frames,[&]() -> bool
+			{
+				vector<string> names;
+				ut::StructureTrack track;
+				return ut::readSubstructuresTrackFile(stk_filename,n_frames,names,track);
+			}},
+		{"tracks/read_tkb",n_frames,[&]() -> bool
+			{
+				bool read_headup;
+				int read_radius;
+				ut::HeartTrack track;
+				return ut::readTrackFile(tkb_filename,n_frames,read_headup,read_radius,track);
+			}},
+		{"tracks/read_stkb",n_frames,[&]() -> bool
+			{
+				vector<string> names;
+				ut::StructureTrack track;
+				return ut::readSubstructuresTrackFile(stkb_filename,n_frames,names,track);
+			}},
+		{"cardiac_phase/recalculate",n_frames,[&]() -> bool
+			{
+				ut::CardiacPhaseTracker whole;
+				vector<uint8_t> points = phase_point;
+				vector<float> phase = cardiac_phase;
+				return whole.recalculate(n_frames,C_FRAME_RATE,points.data(),phase.data());
+			}},
+		{"cardiac_phase/set_phase_point",2*n_toggles,[&]() -> bool
+			{
+				// Mark a beat and then remove the mark again, leaving the track as it was
+				bool valid = true;
+				for(int i = 0; i < n_toggles; ++i)
+				{
+					const int f = unmarked_beats[i*unmarked_beats.size()/n_toggles];
+					valid = tracker.setPhasePoint(f,MANUALLY_LABELLED_DIASTOLE,toggle_phase_point.data(),toggle_cardiac_phase.data()) && valid;
+					valid = tracker.setPhasePoint(f,NOT_LABELLED,toggle_phase_point.data(),toggle_cardiac_phase.data()) && valid;
+				}
+				return valid && (n_toggles > 0);
+			}}
+	};
+
+	ofstream outfile;
+	if(!outfilename.empty())
+	{
+		outfile.open(outfilename.c_str(),ios::trunc);
+		if(!outfile.is_open())
+		{
+			cerr << "ERROR: Could not open the output file " << outfilename << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	ostream& results = outfilename.empty() ? cout : outfile;
+	results << "{\"format\": " << BENCHMARK_FORMAT_VERSION << ", \"opencv\": \"" << CV_VERSION << "\", \"track_frames\": " << n_frames
+	        << ", \"video_frames\": " << n_video_frames << ", \"width\": " << xsize << ", \"height\": " << ysize
+	        << ", \"structures\": " << C_N_STRUCTURES << ", \"runs\": " << n_runs << "}" << endl;
+
+	int n_failed = 0, n_regressions = 0;
+	for(const benchmark_t& benchmark : benchmarks)
+	{
+		if(benchmark.name.find(filter) == string::npos)
+			continue;
+
+		benchResult_t result;
+		if(!timeBenchmark(benchmark,n_runs,result))
+		{
+			cerr << "ERROR: Benchmark " << benchmark.name << " failed" << endl;
+			++n_failed;
+			continue;
+		}
+		results << resultJson(result) << endl;
+		if(!outfilename.empty())
+			cout << benchmark.name << ": " << result.median_ms << " ms (" << 1000.0*result.median_ms/max(result.items,1LL) << " us per item)" << endl;
+
+		const auto base = baseline.find(benchmark.name);
+		if( (base != baseline.end()) && (base->second > 0.0) )
+		{
+			const double ratio = result.median_ms/base->second;
+			if(ratio > 1.0 + tolerance)
+			{
+				cerr << "REGRESSION: " << benchmark.name << " took " << result.median_ms << " ms, " << ratio << "x the baseline of " << base->second << " ms" << endl;
+				++n_regressions;
+			}
+		}
+	}
+
+	boost::system::error_code ec;
+	for(const string& filename : {video_filename,tk_filename,stk_filename,tkb_filename,stkb_filename})
+		fs::remove(filename,ec);
+
+	return ( (n_failed > 0) || (n_regressions > 0) ) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
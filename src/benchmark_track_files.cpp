@@ -0,0 +1,272 @@
+// Benchmark of the text track file readers.
+//
+// Writes large synthetic .tk and .stk files, then times reading them back with
+// ut::readTrackFile/ut::readSubstructuresTrackFile against the previous
+// stream-based implementation (reproduced below), and checks that both give
+// identical results.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include "thesisUtilities.h"
+
+using namespace std;
+namespace ut = thesisUtilities;
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+struct heartTrack_t
+{
+	bool headup;
+	int radius;
+	vector<bool> labelled;
+	vector<ut::heartPresent_t> present;
+	vector<int> centrey, centrex, ori, view_label, phase_point;
+	vector<float> cardiac_phase;
+};
+
+// Whether the old reader's arrays hold the same values as a track container
+static bool sameHeartTrack(const heartTrack_t& a, const bool headup, const int radius, const ut::HeartTrack& b)
+{
+	if( (a.headup != headup) || (a.radius != radius) || (int(a.labelled.size()) != b.frameCount()) )
+		return false;
+	for(int f = 0; f < b.frameCount(); ++f)
+	{
+		const ut::heartLabel_t l = b.frame(f);
+		if( (a.labelled[f] != l.labelled) || (a.present[f] != l.present) || (a.centrey[f] != l.centrey) || (a.centrex[f] != l.centrex) ||
+		    (a.ori[f] != l.ori) || (a.view_label[f] != l.view_label) || (a.phase_point[f] != l.phase_point) || (a.cardiac_phase[f] != l.cardiac_phase) )
+			return false;
+	}
+	return true;
+}
+
+static bool sameStructureTrack(const vector<vector<ut::subStructLabel_t>>& a, const ut::StructureTrack& b)
+{
+	if(int(a.size()) != b.frameCount())
+		return false;
+	for(int f = 0; f < b.frameCount(); ++f)
+	{
+		if(int(a[f].size()) != b.structureCount())
+			return false;
+		for(int s = 0; s < b.structureCount(); ++s)
+		{
+			const ut::subStructLabel_t l = b.label(f,s);
+			if( (a[f][s].x != l.x) || (a[f][s].y != l.y) || (a[f][s].ori != l.ori) || (a[f][s].present != l.present) || (a[f][s].labelled != l.labelled) )
+				return false;
+		}
+	}
+	return true;
+}
+
+
+// The stream-based heart track reader that ut::readTrackFile replaced
+static bool streamReadTrackFile(const string& filename, const int n_frames, heartTrack_t& t)
+{
+	t.labelled.resize(n_frames); t.present.resize(n_frames); t.centrey.resize(n_frames); t.centrex.resize(n_frames);
+	t.ori.resize(n_frames); t.view_label.resize(n_frames); t.phase_point.resize(n_frames); t.cardiac_phase.resize(n_frames);
+
+	ifstream infile(filename.c_str());
+	if(!infile.is_open())
+		return false;
+
+	string dummy_string;
+	getline(infile,dummy_string);
+	getline(infile,dummy_string);
+	infile >> t.headup >> t.radius;
+	if(infile.fail())
+		return false;
+
+	for(int f = 0; f < n_frames; f++)
+	{
+		int dummy_int;
+		infile >> dummy_int;
+		if(infile.fail() || dummy_int != f)
+			return false;
+		bool tempbool;
+		infile >> tempbool >> dummy_int >> t.centrey[f] >> t.centrex[f] >> t.ori[f] >> t.view_label[f] >> t.phase_point[f] >> t.cardiac_phase[f];
+		if(infile.fail())
+			return false;
+		t.labelled[f] = tempbool;
+		t.present[f] = ut::heartPresent_t(dummy_int);
+	}
+	return true;
+}
+
+
+// The stream-based structure track reader that ut::readSubstructuresTrackFile replaced
+static bool streamReadSubstructuresTrackFile(const string& filename, const int n_frames, vector<string>& structure_names, vector<vector<ut::subStructLabel_t>>& track)
+{
+	ifstream infile(filename.c_str());
+	if(!infile.is_open())
+		return false;
+
+	string dummy_string;
+	getline(infile,dummy_string);
+	int n_structures;
+	infile >> n_structures;
+	if(infile.fail())
+		return false;
+	getline(infile,dummy_string);
+
+	structure_names.resize(n_structures);
+	track.assign(n_frames,vector<ut::subStructLabel_t>(n_structures));
+
+	for(int s = 0; s < n_structures; ++s)
+	{
+		int dummy_int;
+		infile >> dummy_int >> structure_names[s];
+		if(infile.fail() || dummy_int != s)
+			return false;
+		getline(infile,dummy_string);
+		int f = -1;
+		for(string linestring; !getline(infile,linestring).eof() && !linestring.empty(); )
+		{
+			f++;
+			stringstream ss(linestring);
+			ss >> dummy_int;
+			if(ss.fail() || dummy_int != f || f >= n_frames)
+				return false;
+			ss >> track[f][s].labelled >> track[f][s].present >> track[f][s].y >> track[f][s].x >> track[f][s].ori;
+			if(ss.fail())
+				return false;
+		}
+	}
+	return true;
+}
+
+
+template<typename Tfunc>
+static double timeRuns(const int n_runs, Tfunc func)
+{
+	const auto start = chrono::steady_clock::now();
+	for(int r = 0; r < n_runs; ++r)
+		if(!func())
+			return -1.0;
+	return chrono::duration<double,milli>(chrono::steady_clock::now() - start).count() / n_runs;
+}
+
+
+static void report(const string& name, const double old_ms, const double new_ms, const bool identical)
+{
+	cout << name << ": stream " << old_ms << " ms, parser " << new_ms << " ms, speedup " << old_ms/new_ms << "x"
+	     << (identical ? "" : " (RESULTS DIFFER)") << endl;
+}
+
+
+int main(int argc, char** argv)
+{
+	int n_frames, n_structures, n_runs;
+	fs::path workdir;
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help,h", "produce help message")
+		("frames,f", po::value<int>(&n_frames)->default_value(200000), "number of frames in the synthetic track files")
+		("structures,s", po::value<int>(&n_structures)->default_value(20), "number of structures in the synthetic structure track file")
+		("runs,r", po::value<int>(&n_runs)->default_value(3), "number of times to read each file")
+		("workdir,w", po::value<fs::path>(&workdir)->default_value(fs::temp_directory_path()), "directory in which to write the synthetic files");
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if(vm.count("help"))
+	{
+		cout << "Benchmarks reading large synthetic text track files" << endl;
+		cout << desc << endl;
+		return 1;
+	}
+
+	if( (n_frames < 1) || (n_structures < 1) || (n_runs < 1) )
+	{
+		cerr << "ERROR: The numbers of frames, structures and runs must be positive" << endl;
+		return EXIT_FAILURE;
+	}
+
+	const int xsize = 640, ysize = 480;
+	mt19937 rng(0);
+	uniform_int_distribution<int> xdist(0,xsize-1), ydist(0,ysize-1), oridist(0,359), smalldist(0,3);
+	uniform_real_distribution<float> phasedist(0.0f,2.0f*float(M_PI));
+
+	// Synthetic heart track
+	const bool headup = true;
+	const int radius = 100;
+	ut::HeartTrack heart(n_frames);
+	for(int f = 0; f < n_frames; ++f)
+	{
+		ut::heartLabel_t label;
+		label.labelled = true;
+		label.present = ut::heartPresent_t(smalldist(rng) % 3);
+		label.centrey = ydist(rng);
+		label.centrex = xdist(rng);
+		label.ori = oridist(rng);
+		label.view_label = smalldist(rng);
+		label.phase_point = smalldist(rng) % 3;
+		label.cardiac_phase = phasedist(rng);
+		heart.setFrame(f,label);
+	}
+
+	// Synthetic structure track
+	vector<string> structure_names(n_structures);
+	for(int s = 0; s < n_structures; ++s)
+		structure_names[s] = "structure" + to_string(s);
+	ut::StructureTrack track(n_frames,n_structures);
+	for(int f = 0; f < n_frames; ++f)
+		for(int s = 0; s < n_structures; ++s)
+		{
+			ut::subStructLabel_t label;
+			label.labelled = true;
+			label.present = smalldist(rng) % 2;
+			label.y = ydist(rng);
+			label.x = xdist(rng);
+			label.ori = oridist(rng);
+			track.setLabel(f,s,label);
+		}
+
+	const string heart_filename = (workdir / "benchmark_track_files.tk").string();
+	const string structure_filename = (workdir / "benchmark_track_files.stk").string();
+	const vector<vector<int>> views_per_structure(n_structures);
+	if(!ut::writeTrackFile(heart_filename,xsize,ysize,headup,radius,heart) ||
+	   !ut::writeSubstructuresTrackFile(structure_filename,xsize,ysize,structure_names,views_per_structure,heart,track))
+	{
+		cerr << "ERROR: Could not write the synthetic track files in " << workdir << endl;
+		return EXIT_FAILURE;
+	}
+	cout << n_frames << " frames, " << n_structures << " structures, " << fs::file_size(heart_filename) << " + "
+	     << fs::file_size(structure_filename) << " bytes, mean of " << n_runs << " runs" << endl;
+
+	heartTrack_t old_heart;
+	ut::HeartTrack new_heart;
+	bool new_headup;
+	int new_radius;
+	const double old_heart_ms = timeRuns(n_runs,[&](){return streamReadTrackFile(heart_filename,n_frames,old_heart);});
+	const double new_heart_ms = timeRuns(n_runs,[&](){return ut::readTrackFile(heart_filename,n_frames,new_headup,new_radius,new_heart);});
+
+	vector<string> old_names, new_names;
+	vector<vector<ut::subStructLabel_t>> old_track;
+	ut::StructureTrack new_track;
+	const double old_structure_ms = timeRuns(n_runs,[&](){return streamReadSubstructuresTrackFile(structure_filename,n_frames,old_names,old_track);});
+	const double new_structure_ms = timeRuns(n_runs,[&](){return ut::readSubstructuresTrackFile(structure_filename,n_frames,new_names,new_track);});
+
+	fs::remove(heart_filename);
+	fs::remove(structure_filename);
+
+	if( (old_heart_ms < 0.0) || (new_heart_ms < 0.0) || (old_structure_ms < 0.0) || (new_structure_ms < 0.0) )
+	{
+		cerr << "ERROR: Could not read the synthetic track files" << endl;
+		return EXIT_FAILURE;
+	}
+
+	const bool heart_identical = sameHeartTrack(old_heart,new_headup,new_radius,new_heart);
+	const bool structures_identical = (old_names == new_names) && sameStructureTrack(old_track,new_track);
+	report(".tk ",old_heart_ms,new_heart_ms,heart_identical);
+	report(".stk",old_structure_ms,new_structure_ms,structures_identical);
+
+	return (heart_identical && structures_identical) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
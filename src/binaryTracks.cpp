@@ -0,0 +1,292 @@
+#include "binaryTracks.h"
+#include <fstream>
+#include <cstring>
+#include <boost/filesystem.hpp>
+
+// Binary track file format
+#define BINARY_TRACK_MAGIC "HAHEART\0"
+#define BINARY_STRUCTURE_TRACK_MAGIC "HASTRUCT"
+#define BINARY_TRACK_VERSION 2
+#define BINARY_TRACK_OLDEST_VERSION 1
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace thesisUtilities
+{
+
+static_assert(sizeof(binaryTrackHeader_t) == 48, "unexpected binary track header size");
+
+// Size of a column of n values of a given size, including padding
+static size_t columnBytes(const int n, const size_t value_bytes)
+{
+	return (size_t(n)*value_bytes + 7) & ~size_t(7);
+}
+
+static uint32_t dataOffset(const int n_structures)
+{
+	return columnBytes(1,sizeof(binaryTrackHeader_t) + size_t(n_structures)*BINARY_TRACK_NAME_BYTES);
+}
+
+// Size of the data of a single structure in a structure track file
+static size_t structureBytes(const int n_frames)
+{
+	return 2*columnBytes(n_frames,sizeof(uint8_t)) + 3*columnBytes(n_frames,sizeof(int32_t));
+}
+
+static size_t heartTrackBytes(const int n_frames)
+{
+	return dataOffset(0) + 3*columnBytes(n_frames,sizeof(uint8_t)) + 4*columnBytes(n_frames,sizeof(int32_t)) + columnBytes(n_frames,sizeof(float));
+}
+
+// Map a file and check its header, returns false if it is not valid
+static bool mapTrackFile(const string& filename, const char* magic, boost::iostreams::mapped_file_source& map, binaryTrackHeader_t& header)
+{
+	if(!fs::exists(filename))
+		return false;
+	try
+	{
+		map.open(filename);
+	}
+	catch(const std::exception&)
+	{
+		return false;
+	}
+
+	if(map.size() < sizeof(header))
+	{
+		map.close();
+		return false;
+	}
+	memcpy(&header,map.data(),sizeof(header));
+	if( (memcmp(header.magic,magic,sizeof(header.magic)) != 0) || (header.version < BINARY_TRACK_OLDEST_VERSION) || (header.version > BINARY_TRACK_VERSION) ||
+		(header.n_frames < 0) || (header.n_structures < 0) || (header.file_bytes != map.size()) ||
+		(header.data_offset != dataOffset(header.n_structures)) )
+	{
+		map.close();
+		return false;
+	}
+	return true;
+}
+
+// Write a column of values, converting them to the type stored in the file
+template<typename Tfile, typename Tdata>
+static void writeColumn(ofstream& outfile, const int n_frames, const Tdata* data)
+{
+	vector<Tfile> column(columnBytes(n_frames,sizeof(Tfile))/sizeof(Tfile),Tfile(0));
+	for(int f = 0; f < n_frames; ++f)
+		column[f] = static_cast<Tfile>(data[f]);
+	outfile.write(reinterpret_cast<const char*>(column.data()),column.size()*sizeof(Tfile));
+}
+
+static binaryTrackHeader_t makeHeader(const char* magic, const int n_frames, const int n_structures, const int xsize, const int ysize, const bool headup, const int radius,
+                                      const bool auto_propagated, const size_t file_bytes)
+{
+	binaryTrackHeader_t header;
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,magic,sizeof(header.magic));
+	header.version = BINARY_TRACK_VERSION;
+	header.n_frames = n_frames;
+	header.n_structures = n_structures;
+	header.xsize = xsize;
+	header.ysize = ysize;
+	header.radius = radius;
+	header.headup = headup;
+	header.auto_propagated = auto_propagated;
+	header.data_offset = dataOffset(n_structures);
+	header.file_bytes = file_bytes;
+	return header;
+}
+
+
+MappedHeartTrack::MappedHeartTrack()
+: labelled_col(nullptr), present_col(nullptr), phase_point_col(nullptr), centrey_col(nullptr), centrex_col(nullptr),
+  ori_col(nullptr), view_label_col(nullptr), cardiac_phase_col(nullptr)
+{
+	memset(&header,0,sizeof(header));
+}
+
+
+bool MappedHeartTrack::open(const string& filename)
+{
+	close();
+	if(!mapTrackFile(filename,BINARY_TRACK_MAGIC,map,header))
+		return false;
+	if( (header.n_structures != 0) || (map.size() != heartTrackBytes(header.n_frames)) )
+	{
+		close();
+		return false;
+	}
+
+	const int n = header.n_frames;
+	const char* p = map.data() + header.data_offset;
+	labelled_col = reinterpret_cast<const uint8_t*>(p); p += columnBytes(n,sizeof(uint8_t));
+	present_col = reinterpret_cast<const uint8_t*>(p); p += columnBytes(n,sizeof(uint8_t));
+	phase_point_col = reinterpret_cast<const uint8_t*>(p); p += columnBytes(n,sizeof(uint8_t));
+	centrey_col = reinterpret_cast<const int32_t*>(p); p += columnBytes(n,sizeof(int32_t));
+	centrex_col = reinterpret_cast<const int32_t*>(p); p += columnBytes(n,sizeof(int32_t));
+	ori_col = reinterpret_cast<const int32_t*>(p); p += columnBytes(n,sizeof(int32_t));
+	view_label_col = reinterpret_cast<const int32_t*>(p); p += columnBytes(n,sizeof(int32_t));
+	cardiac_phase_col = reinterpret_cast<const float*>(p);
+	return true;
+}
+
+
+void MappedHeartTrack::close()
+{
+	if(map.is_open())
+		map.close();
+	memset(&header,0,sizeof(header));
+	labelled_col = present_col = phase_point_col = nullptr;
+	centrey_col = centrex_col = ori_col = view_label_col = nullptr;
+	cardiac_phase_col = nullptr;
+}
+
+
+MappedStructureTrack::MappedStructureTrack()
+: structure_bytes(0)
+{
+	memset(&header,0,sizeof(header));
+}
+
+
+bool MappedStructureTrack::open(const string& filename)
+{
+	close();
+	if(!mapTrackFile(filename,BINARY_STRUCTURE_TRACK_MAGIC,map,header))
+		return false;
+	structure_bytes = structureBytes(header.n_frames);
+	if(map.size() != header.data_offset + size_t(header.n_structures)*structure_bytes)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+
+void MappedStructureTrack::close()
+{
+	if(map.is_open())
+		map.close();
+	memset(&header,0,sizeof(header));
+	structure_bytes = 0;
+}
+
+
+string MappedStructureTrack::structureName(const int s) const
+{
+	const char* name = map.data() + sizeof(binaryTrackHeader_t) + size_t(s)*BINARY_TRACK_NAME_BYTES;
+	return string(name,strnlen(name,BINARY_TRACK_NAME_BYTES));
+}
+
+
+// Start of column c (in the order they are stored) for structure s
+const char* MappedStructureTrack::column(const int s, const int c) const
+{
+	const int n = header.n_frames;
+	const char* p = map.data() + header.data_offset + size_t(s)*structure_bytes;
+	if(c >= 1)
+		p += columnBytes(n,sizeof(uint8_t));
+	if(c >= 2)
+		p += columnBytes(n,sizeof(uint8_t));
+	if(c >= 3)
+		p += size_t(c-2)*columnBytes(n,sizeof(int32_t));
+	return p;
+}
+
+
+const uint8_t* MappedStructureTrack::labelled(const int s) const
+{
+	return reinterpret_cast<const uint8_t*>(column(s,0));
+}
+
+
+const uint8_t* MappedStructureTrack::present(const int s) const
+{
+	return reinterpret_cast<const uint8_t*>(column(s,1));
+}
+
+
+const int32_t* MappedStructureTrack::y(const int s) const
+{
+	return reinterpret_cast<const int32_t*>(column(s,2));
+}
+
+
+const int32_t* MappedStructureTrack::x(const int s) const
+{
+	return reinterpret_cast<const int32_t*>(column(s,3));
+}
+
+
+const int32_t* MappedStructureTrack::orientation(const int s) const
+{
+	return reinterpret_cast<const int32_t*>(column(s,4));
+}
+
+
+bool writeBinaryTrackFile(const string& filename, const int xsize, const int ysize, const bool headup, const int radius, const HeartTrack& track)
+{
+	ofstream outfile(filename.c_str(),ios::binary);
+	if(!outfile.is_open())
+		return false;
+
+	const int n_frames = track.frameCount();
+	const binaryTrackHeader_t header = makeHeader(BINARY_TRACK_MAGIC,n_frames,0,xsize,ysize,headup,radius,false,heartTrackBytes(n_frames));
+	outfile.write(reinterpret_cast<const char*>(&header),sizeof(header));
+	writeColumn<uint8_t>(outfile,n_frames,track.labelled());
+	writeColumn<uint8_t>(outfile,n_frames,track.present());
+	writeColumn<uint8_t>(outfile,n_frames,track.phasePoint());
+	writeColumn<int32_t>(outfile,n_frames,track.centrey());
+	writeColumn<int32_t>(outfile,n_frames,track.centrex());
+	writeColumn<int32_t>(outfile,n_frames,track.orientation());
+	writeColumn<int32_t>(outfile,n_frames,track.viewLabel());
+	writeColumn<float>(outfile,n_frames,track.cardiacPhase());
+	return outfile.good();
+}
+
+
+bool writeBinarySubstructuresTrackFile(const string& filename, const int xsize, const int ysize, const vector<string>& structure_names,
+                                       const StructureTrack& track, const bool auto_propagated)
+{
+	const int n_structures = structure_names.size();
+	const int n_frames = track.frameCount();
+	if(track.structureCount() != n_structures)
+		return false;
+	for(const string& name : structure_names)
+		if(name.size() >= BINARY_TRACK_NAME_BYTES)
+			return false;
+
+	ofstream outfile(filename.c_str(),ios::binary);
+	if(!outfile.is_open())
+		return false;
+
+	const size_t file_bytes = dataOffset(n_structures) + size_t(n_structures)*structureBytes(n_frames);
+	const binaryTrackHeader_t header = makeHeader(BINARY_STRUCTURE_TRACK_MAGIC,n_frames,n_structures,xsize,ysize,false,0,auto_propagated,file_bytes);
+	outfile.write(reinterpret_cast<const char*>(&header),sizeof(header));
+
+	vector<char> names(dataOffset(n_structures)-sizeof(header),'\0');
+	for(int s = 0; s < n_structures; ++s)
+		memcpy(names.data()+s*BINARY_TRACK_NAME_BYTES,structure_names[s].c_str(),structure_names[s].size());
+	outfile.write(names.data(),names.size());
+
+	for(int s = 0; s < n_structures; ++s)
+	{
+		writeColumn<uint8_t>(outfile,n_frames,track.labelled(s));
+		writeColumn<uint8_t>(outfile,n_frames,track.present(s));
+		writeColumn<int32_t>(outfile,n_frames,track.y(s));
+		writeColumn<int32_t>(outfile,n_frames,track.x(s));
+		writeColumn<int32_t>(outfile,n_frames,track.orientation(s));
+	}
+	return outfile.good();
+}
+
+
+bool isBinaryTrackFile(const string& filename)
+{
+	const string extension = fs::path(filename).extension().string();
+	return (extension == BINARY_TRACK_EXTENSION) || (extension == BINARY_STRUCTURE_TRACK_EXTENSION);
+}
+
+} // end of namespace
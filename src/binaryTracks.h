@@ -0,0 +1,131 @@
+#ifndef BINARYTRACKS_H
+#define BINARYTRACKS_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include "thesisUtilities.h"
+
+// File extensions of the binary track formats
+#define BINARY_TRACK_EXTENSION ".tkb"
+#define BINARY_STRUCTURE_TRACK_EXTENSION ".stkb"
+
+// Maximum length of a structure name in a binary structure track file (including the terminating null)
+#define BINARY_TRACK_NAME_BYTES 64
+
+namespace thesisUtilities
+{
+	// Binary equivalents of the .tk and .stk track files, intended to be read quickly by
+	// memory-mapping them rather than parsing text.
+	//
+	// A file starts with a fixed 48-byte header (see binaryTrackHeader_t), followed by the
+	// structure names (structure track files only, BINARY_TRACK_NAME_BYTES each, null-padded)
+	// and then the data. The data are stored column by column, each column holding one
+	// variable for every frame, in the following order:
+	//
+	//   .tkb:  labelled (uint8), present (uint8), phase_point (uint8), centrey (int32),
+	//          centrex (int32), orientation (int32), view_label (int32), cardiac_phase (float32)
+	//   .stkb: for each structure in turn: labelled (uint8), present (uint8), y (int32),
+	//          x (int32), orientation (int32)
+	//
+	// The start of each column is padded to a multiple of 8 bytes. All values use the
+	// byte order of the machine that wrote them (little-endian on all our machines).
+	// The meanings of the variables are the same as in the text files, and the
+	// auto_propagated flag of a .stkb file stands for the "(auto-propagated)" marker on
+	// the header line of a .stk file (version 1 files, which did not have the flag, are
+	// still read, as human-labelled).
+	struct binaryTrackHeader_t
+	{
+		char magic[8];
+		uint32_t version;
+		int32_t n_frames;
+		int32_t n_structures;
+		int32_t xsize;
+		int32_t ysize;
+		int32_t radius;
+		uint8_t headup;
+		uint8_t auto_propagated;
+		uint8_t reserved[2];
+		uint32_t data_offset;
+		uint64_t file_bytes;
+	};
+
+	// Read-only view of a memory-mapped binary heart track file (.tkb). The
+	// pointers remain valid until the file is closed
+	class MappedHeartTrack
+	{
+		public:
+			MappedHeartTrack();
+
+			// Map a file, returns false if it cannot be opened or is not a valid .tkb file
+			bool open(const std::string& filename);
+			void close();
+
+			int frameCount() const {return header.n_frames;}
+			int width() const {return header.xsize;}
+			int height() const {return header.ysize;}
+			bool headup() const {return header.headup;}
+			int radius() const {return header.radius;}
+
+			const uint8_t* labelled() const {return labelled_col;}
+			const uint8_t* present() const {return present_col;}
+			const uint8_t* phasePoint() const {return phase_point_col;}
+			const int32_t* centrey() const {return centrey_col;}
+			const int32_t* centrex() const {return centrex_col;}
+			const int32_t* orientation() const {return ori_col;}
+			const int32_t* viewLabel() const {return view_label_col;}
+			const float* cardiacPhase() const {return cardiac_phase_col;}
+
+		private:
+			boost::iostreams::mapped_file_source map;
+			binaryTrackHeader_t header;
+			const uint8_t *labelled_col, *present_col, *phase_point_col;
+			const int32_t *centrey_col, *centrex_col, *ori_col, *view_label_col;
+			const float* cardiac_phase_col;
+	};
+
+	// Read-only view of a memory-mapped binary structure track file (.stkb). The
+	// pointers remain valid until the file is closed
+	class MappedStructureTrack
+	{
+		public:
+			MappedStructureTrack();
+
+			// Map a file, returns false if it cannot be opened or is not a valid .stkb file
+			bool open(const std::string& filename);
+			void close();
+
+			int frameCount() const {return header.n_frames;}
+			int structureCount() const {return header.n_structures;}
+			int width() const {return header.xsize;}
+			int height() const {return header.ysize;}
+			bool autoPropagated() const {return header.auto_propagated;}
+
+			std::string structureName(const int s) const;
+			const uint8_t* labelled(const int s) const;
+			const uint8_t* present(const int s) const;
+			const int32_t* y(const int s) const;
+			const int32_t* x(const int s) const;
+			const int32_t* orientation(const int s) const;
+
+		private:
+			const char* column(const int s, const int c) const;
+
+			boost::iostreams::mapped_file_source map;
+			binaryTrackHeader_t header;
+			size_t structure_bytes;
+	};
+
+	// Write binary track files, with the same information as the text versions
+	bool writeBinaryTrackFile(const std::string& filename, const int xsize, const int ysize, const bool headup, const int radius, const HeartTrack& track);
+
+	bool writeBinarySubstructuresTrackFile(const std::string& filename, const int xsize, const int ysize, const std::vector<std::string>& structure_names,
+	                                       const StructureTrack& track, const bool auto_propagated = false);
+
+	// Whether a file name has one of the binary track extensions
+	bool isBinaryTrackFile(const std::string& filename);
+}
+
+// inclusion guard
+#endif
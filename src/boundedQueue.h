@@ -0,0 +1,63 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+
+namespace thesisUtilities
+{
+	// A thread-safe first-in-first-out queue with a maximum size, used to pass work
+	// between threads. push() blocks while the queue is full and pop() blocks while
+	// it is empty. After close() has been called, push() fails and pop() returns
+	// false once the remaining items have been consumed
+	template<typename T>
+	class BoundedQueue
+	{
+		public:
+			explicit BoundedQueue(const size_t capacity) : capacity(capacity), closed(false) {}
+
+			bool push(T item)
+			{
+				std::unique_lock<std::mutex> lk(mtx);
+				not_full.wait(lk,[this]{return closed || (items.size() < capacity);});
+				if(closed)
+					return false;
+				items.push_back(std::move(item));
+				not_empty.notify_one();
+				return true;
+			}
+
+			bool pop(T& item)
+			{
+				std::unique_lock<std::mutex> lk(mtx);
+				not_empty.wait(lk,[this]{return closed || !items.empty();});
+				if(items.empty())
+					return false;
+				item = std::move(items.front());
+				items.pop_front();
+				not_full.notify_one();
+				return true;
+			}
+
+			void close()
+			{
+				std::lock_guard<std::mutex> lk(mtx);
+				closed = true;
+				not_full.notify_all();
+				not_empty.notify_all();
+			}
+
+		private:
+			const size_t capacity;
+			bool closed;
+			std::deque<T> items;
+			std::mutex mtx;
+			std::condition_variable not_full, not_empty;
+	};
+
+}
+
+// inclusion guard
+#endif
@@ -0,0 +1,42 @@
+#include "cacheFiles.h"
+#include <cstdio>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace thesisUtilities
+{
+
+videoIdentity_t videoIdentity(const string& filename)
+{
+	boost::system::error_code ec;
+	const fs::path video_path = fs::absolute(filename);
+	videoIdentity_t video;
+	video.path = video_path.string();
+	video.size = fs::file_size(video_path,ec);
+	if(ec)
+		video.size = 0;
+	video.mtime = fs::last_write_time(video_path,ec);
+	if(ec)
+		video.mtime = 0;
+	return video;
+}
+
+
+string cacheFileName(const videoIdentity_t& video, const string& cache_dir, const string& extension)
+{
+	// 64-bit FNV-1a hash
+	uint64_t hash = 14695981039346656037ULL;
+	for(const char c : video.path)
+	{
+		hash ^= uint64_t((unsigned char)c);
+		hash *= 1099511628211ULL;
+	}
+	char hex[17];
+	snprintf(hex,sizeof(hex),"%016llx",(unsigned long long)hash);
+	return (fs::path(cache_dir) / (fs::path(video.path).stem().string() + "_" + hex + extension)).string();
+}
+
+} // end of namespace
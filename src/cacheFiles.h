@@ -0,0 +1,26 @@
+#ifndef CACHEFILES_H
+#define CACHEFILES_H
+
+#include <string>
+
+namespace thesisUtilities
+{
+	// Identifies a particular version of a video file, so that cache files derived
+	// from the video can be recognised as out of date if it is modified
+	struct videoIdentity_t
+	{
+		std::string path; // absolute
+		long long size;
+		long long mtime;
+	};
+
+	videoIdentity_t videoIdentity(const std::string& filename);
+
+	// Name of the cache file with a given extension for a video in a cache directory
+	// (the video's stem plus a hash of its full path, so videos with the same name
+	// in different directories do not collide)
+	std::string cacheFileName(const videoIdentity_t& video, const std::string& cache_dir, const std::string& extension);
+}
+
+// inclusion guard
+#endif
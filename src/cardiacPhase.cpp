@@ -0,0 +1,595 @@
+#include "cardiacPhase.h"
+#include <cmath>
+#include <climits>
+#include <algorithm>
+#include "thesisUtilities.h"
+#include "tracing.h"
+
+using namespace std;
+
+namespace thesisUtilities
+{
+
+// Whether a phase point is an end-systole or end-diastole mark that the phase is
+// anchored on, either made by the annotator or suggested from the image
+static bool isSystoleMark(const uint8_t phase_point)
+{
+	return (phase_point == MANUALLY_LABELLED_SYSTOLE) || (phase_point == SUGGESTED_SYSTOLE);
+}
+
+static bool isDiastoleMark(const uint8_t phase_point)
+{
+	return (phase_point == MANUALLY_LABELLED_DIASTOLE) || (phase_point == SUGGESTED_DIASTOLE);
+}
+
+
+CardiacPhaseTracker::CardiacPhaseTracker()
+: n_frames(0), min_frames_per_beat(0.0), max_frames_per_beat(0.0), first_marker{0,true,mkImaginary}, last_marker{0,false,mkImaginary},
+  total_beat_length(0), n_beats(0), cardiac_period(0.0), n_inconsistent(0), is_valid(false), inconsistent_frame(-1)
+{
+}
+
+
+bool CardiacPhaseTracker::recalculate(const int n_frames, const float frame_rate, uint8_t* phase_point_track, float* cardiac_phase_track)
+{
+	TraceSpan span("cardiac_phase");
+	this->n_frames = n_frames;
+
+	// Calculate the minimum and maximum acceptable periods for a single heart beat
+	min_frames_per_beat = 60.0*frame_rate/MAX_HEART_RATE;
+	max_frames_per_beat = 60.0*frame_rate/MIN_HEART_RATE;
+
+	manual[0].clear();
+	manual[1].clear();
+	total_beat_length = 0;
+	n_beats = 0;
+	for(int f = 0; f < n_frames; ++f)
+	{
+		vector<int>* marks;
+		if(isSystoleMark(phase_point_track[f]))
+			marks = &manual[0];
+		else if(isDiastoleMark(phase_point_track[f]))
+			marks = &manual[1];
+		else
+			continue;
+
+		if(!marks->empty())
+		{
+			const int length = beatLength(marks->back(),f);
+			total_beat_length += length;
+			n_beats += (length > 0);
+		}
+		marks->emplace_back(f);
+	}
+
+	placeAll();
+	writeAll(phase_point_track,cardiac_phase_track);
+	changed.assign(1,make_pair(0,n_frames));
+	return is_valid;
+}
+
+
+bool CardiacPhaseTracker::setPhasePoint(const int f, const uint8_t phase_point, uint8_t* phase_point_track, float* cardiac_phase_track)
+{
+	TraceSpan span("cardiac_phase_update");
+	changed.clear();
+	if( (f < 0) || (f >= n_frames) )
+		return is_valid;
+
+	const bool was_systole = isSystoleMark(phase_point_track[f]);
+	const bool was_diastole = isDiastoleMark(phase_point_track[f]);
+	const bool is_systole = isSystoleMark(phase_point);
+	const bool is_diastole = isDiastoleMark(phase_point);
+	if( (was_systole == is_systole) && (was_diastole == is_diastole) )
+	{
+		// Accepting a suggested mark (or the reverse) leaves the phase as it is
+		if( (is_systole || is_diastole) && (phase_point_track[f] != phase_point) )
+		{
+			phase_point_track[f] = phase_point;
+			changed.emplace_back(f,f+1);
+		}
+		return is_valid;
+	}
+
+	const bool had_period = hasPeriod();
+	const bool was_valid = is_valid;
+	const float old_period = cardiac_period;
+	if(was_systole)
+		removeMark(manual[0],f);
+	else if(was_diastole)
+		removeMark(manual[1],f);
+	if(is_systole)
+		addMark(manual[0],f);
+	else if(is_diastole)
+		addMark(manual[1],f);
+	phase_point_track[f] = (is_systole || is_diastole) ? phase_point : NOT_LABELLED;
+
+	// Start again if there were or are now too few marks to find the period
+	if(!had_period || !hasPeriod())
+	{
+		placeAll();
+		if(!was_valid && !is_valid)
+		{
+			changed.emplace_back(f,f+1);
+			return false;
+		}
+		writeAll(phase_point_track,cardiac_phase_track);
+		changed.emplace_back(0,n_frames);
+		return is_valid;
+	}
+	cardiac_period = float(total_beat_length)/n_beats;
+
+	// The markers of each kind are made up of segments, segment i lying between manual
+	// marks i-1 and i (segment 0 before the first mark and the final segment after the
+	// last mark). Find the segments that must be placed again: either side of the mark
+	// that changed and, if the period changed, before the first and after the last
+	// marks and in any long gap whose number of beats changed
+	struct run_t
+	{
+		int c, begin, end;
+		vector<marker_t> placed;
+	};
+	vector<run_t> runs;
+	vector<pair<int,int>> windows;
+	vector<marker_t> removed, added;
+	for(int c = 0; c < 2; ++c)
+	{
+		const vector<int>& marks = manual[c];
+		const int n_marks = marks.size();
+		vector<int> segments;
+		if( (c == 0) ? (was_systole || is_systole) : (was_diastole || is_diastole) )
+		{
+			const int j = lower_bound(marks.cbegin(),marks.cend(),f) - marks.cbegin();
+			segments.push_back(j);
+			if( (j < n_marks) && (marks[j] == f) )
+				segments.push_back(j+1);
+		}
+		if(cardiac_period != old_period)
+		{
+			segments.push_back(0);
+			segments.push_back(n_marks);
+			for(int i = 1; i < n_marks; ++i)
+			{
+				const int gap = marks[i] - marks[i-1];
+				if( (gap > max_frames_per_beat) && (std::round(float(gap)/cardiac_period) != std::round(float(gap)/old_period)) )
+					segments.push_back(i);
+			}
+		}
+		sort(segments.begin(),segments.end());
+		segments.erase(unique(segments.begin(),segments.end()),segments.end());
+
+		// Place each run of consecutive segments again, and compare with the markers it replaces
+		for(size_t s = 0; s < segments.size(); )
+		{
+			const int first_segment = segments[s];
+			while( (s+1 < segments.size()) && (segments[s+1] == segments[s]+1) )
+				++s;
+			const int last_segment = segments[s++];
+
+			run_t run;
+			run.c = c;
+			const vector<marker_t>& markers = chain[c];
+			const auto frame_less = [](const marker_t& m, const int frame) {return m.frame < frame;};
+			run.begin = (first_segment == 0) ? 0 : upper_bound(markers.cbegin(),markers.cend(),marks[first_segment-1],[](const int frame, const marker_t& m) {return frame < m.frame;}) - markers.cbegin();
+			run.end = (last_segment == n_marks) ? markers.size() : lower_bound(markers.cbegin(),markers.cend(),marks[last_segment],frame_less) - markers.cbegin();
+			placeMarkers(c,first_segment,last_segment,run.placed);
+
+			auto old_it = markers.cbegin() + run.begin;
+			const auto old_end = markers.cbegin() + run.end;
+			auto new_it = run.placed.cbegin();
+			bool differs = false;
+			while( (old_it != old_end) || (new_it != run.placed.cend()) )
+			{
+				if( (new_it == run.placed.cend()) || ( (old_it != old_end) && (old_it->frame < new_it->frame) ) )
+					removed.emplace_back(*old_it++);
+				else if( (old_it == old_end) || (new_it->frame < old_it->frame) )
+					added.emplace_back(*new_it++);
+				else
+				{
+					if(old_it->kind != new_it->kind)
+					{
+						removed.emplace_back(*old_it);
+						added.emplace_back(*new_it);
+					}
+					else
+					{
+						++old_it;
+						++new_it;
+						continue;
+					}
+					++old_it;
+					++new_it;
+				}
+				differs = true;
+			}
+			if(differs)
+			{
+				windows.emplace_back( (first_segment == 0) ? INT_MIN : marks[first_segment-1], (last_segment == n_marks) ? INT_MAX : marks[last_segment] );
+				runs.emplace_back(move(run));
+			}
+		}
+	}
+
+	// Merge any windows whose neighbouring markers overlap, so that no pair of
+	// consecutive markers is counted twice
+	sort(windows.begin(),windows.end());
+	vector<pair<int,int>> merged_windows;
+	vector<marker_t> merged;
+	for(const pair<int,int>& window : windows)
+	{
+		if(!merged_windows.empty())
+		{
+			mergedMarkers(merged_windows.back().second,merged_windows.back().second,merged);
+			if( (merged_windows.back().second == INT_MAX) || (merged.back().frame >= window.first) )
+			{
+				merged_windows.back().second = max(merged_windows.back().second,window.second);
+				continue;
+			}
+		}
+		merged_windows.emplace_back(window);
+	}
+
+	// Replace the markers, counting any consecutive markers that do not alternate
+	// before and after
+	int first_inconsistent;
+	for(const pair<int,int>& window : merged_windows)
+	{
+		mergedMarkers(window.first,window.second,merged);
+		n_inconsistent -= countInconsistencies(merged,first_inconsistent);
+	}
+	for(auto run = runs.rbegin(); run != runs.rend(); ++run)
+	{
+		vector<marker_t>& markers = chain[run->c];
+		markers.erase(markers.begin()+run->begin,markers.begin()+run->end);
+		markers.insert(markers.begin()+run->begin,run->placed.cbegin(),run->placed.cend());
+	}
+	const marker_t old_first_marker = first_marker, old_last_marker = last_marker;
+	placeImaginaryMarkers();
+	for(const pair<int,int>& window : merged_windows)
+	{
+		mergedMarkers(window.first,window.second,merged);
+		n_inconsistent += countInconsistencies(merged,first_inconsistent);
+	}
+	is_valid = (n_inconsistent == 0);
+
+	if(!was_valid && !is_valid)
+	{
+		changed.emplace_back(f,f+1);
+		return false;
+	}
+	if(was_valid != is_valid)
+	{
+		writeAll(phase_point_track,cardiac_phase_track);
+		changed.emplace_back(0,n_frames);
+		return is_valid;
+	}
+
+	for(const marker_t* imaginary : {&old_first_marker,&old_last_marker})
+	{
+		const marker_t& current = (imaginary == &old_first_marker) ? first_marker : last_marker;
+		if( (imaginary->frame != current.frame) || (imaginary->systole != current.systole) )
+		{
+			removed.emplace_back(*imaginary);
+			added.emplace_back(current);
+		}
+	}
+
+	// Update the automatic marks
+	for(const marker_t& m : removed)
+	{
+		if( (m.kind == mkAuto) && !isSystoleMark(phase_point_track[m.frame]) && !isDiastoleMark(phase_point_track[m.frame]) )
+			phase_point_track[m.frame] = NOT_LABELLED;
+	}
+	for(const marker_t& m : added)
+	{
+		if(m.kind == mkAuto)
+			phase_point_track[m.frame] = m.systole ? AUTO_LABELLED_SYSTOLE : AUTO_LABELLED_DIASTOLE;
+	}
+
+	// The phase changes only between the markers either side of each marker that changed
+	vector<pair<int,int>> ranges;
+	ranges.reserve(removed.size() + added.size());
+	for(const vector<marker_t>* diff : {&removed,&added})
+	{
+		for(const marker_t& m : *diff)
+		{
+			mergedMarkers(m.frame,m.frame,merged);
+			const int first = (merged.front().frame < m.frame) ? max(merged.front().frame,0) : 0;
+			const int last = (merged.back().frame > m.frame) ? min(merged.back().frame+1,n_frames) : n_frames;
+			if(first < last)
+				ranges.emplace_back(first,last);
+		}
+	}
+	sort(ranges.begin(),ranges.end());
+	for(const pair<int,int>& range : ranges)
+	{
+		if(!changed.empty() && (range.first <= changed.back().second))
+			changed.back().second = max(changed.back().second,range.second);
+		else
+			changed.emplace_back(range);
+	}
+	for(const pair<int,int>& range : changed)
+		fillPhase(range.first,range.second,cardiac_phase_track);
+
+	return true;
+}
+
+
+// Order of the markers, with end-systole first if they coincide
+bool CardiacPhaseTracker::before(const marker_t& a, const marker_t& b)
+{
+	return (a.frame < b.frame) || ( (a.frame == b.frame) && a.systole && !b.systole);
+}
+
+
+// There must be at least one mark of each kind, and one plausible interval to find the period from
+bool CardiacPhaseTracker::hasPeriod() const
+{
+	return !manual[0].empty() && !manual[1].empty() && (n_beats > 0);
+}
+
+
+void CardiacPhaseTracker::addMark(vector<int>& marks, const int f)
+{
+	const auto it = lower_bound(marks.begin(),marks.end(),f);
+	if(it != marks.begin())
+	{
+		total_beat_length += beatLength(*prev(it),f);
+		n_beats += (beatLength(*prev(it),f) > 0);
+	}
+	if(it != marks.end())
+	{
+		total_beat_length += beatLength(f,*it);
+		n_beats += (beatLength(f,*it) > 0);
+	}
+	if( (it != marks.begin()) && (it != marks.end()) )
+	{
+		total_beat_length -= beatLength(*prev(it),*it);
+		n_beats -= (beatLength(*prev(it),*it) > 0);
+	}
+	marks.insert(it,f);
+}
+
+
+void CardiacPhaseTracker::removeMark(vector<int>& marks, const int f)
+{
+	const auto it = lower_bound(marks.begin(),marks.end(),f);
+	if( (it == marks.end()) || (*it != f) )
+		return;
+	const bool has_prev = (it != marks.begin()), has_next = (next(it) != marks.end());
+	if(has_prev)
+	{
+		total_beat_length -= beatLength(*prev(it),f);
+		n_beats -= (beatLength(*prev(it),f) > 0);
+	}
+	if(has_next)
+	{
+		total_beat_length -= beatLength(f,*next(it));
+		n_beats -= (beatLength(f,*next(it)) > 0);
+	}
+	if(has_prev && has_next)
+	{
+		total_beat_length += beatLength(*prev(it),*next(it));
+		n_beats += (beatLength(*prev(it),*next(it)) > 0);
+	}
+	marks.erase(it);
+}
+
+
+// The interval between two marks of the same kind if it is a plausible length for
+// a heart beat, otherwise 0
+int CardiacPhaseTracker::beatLength(const int first, const int second) const
+{
+	const float length = float(second - first);
+	return ( (length > min_frames_per_beat) && (length < max_frames_per_beat) ) ? second - first : 0;
+}
+
+
+// Place the markers of kind c in segments first_segment to last_segment, including
+// the manual marks between them
+void CardiacPhaseTracker::placeMarkers(const int c, const int first_segment, const int last_segment, vector<marker_t>& placed) const
+{
+	const vector<int>& marks = manual[c];
+	const int n_marks = marks.size();
+	const bool systole = (c == 0);
+
+	// The marks at either end of the segments, if any, are needed to fill the gaps
+	vector<marker_t> sequence;
+	if(first_segment > 0)
+		sequence.push_back({marks[first_segment-1],systole,mkManual});
+	else
+	{
+		// Before the first mark, working backwards
+		const int first_labelled = marks.front();
+		int f = first_labelled - std::round(cardiac_period);
+		for(int n = 1; f >= 0; )
+		{
+			sequence.push_back({f,systole,mkAuto});
+			n++;
+			f = std::round(float(first_labelled) - n*cardiac_period);
+		}
+		reverse(sequence.begin(),sequence.end());
+	}
+
+	for(int i = first_segment; i < last_segment; ++i)
+		sequence.push_back({marks[i],systole,mkManual});
+
+	if(last_segment < n_marks)
+		sequence.push_back({marks[last_segment],systole,mkManual});
+	else
+	{
+		// After the last mark
+		const int last_labelled = marks.back();
+		int f = last_labelled + std::round(cardiac_period);
+		for(int n = 1; f < n_frames; )
+		{
+			sequence.push_back({f,systole,mkAuto});
+			n++;
+			f = std::round(float(last_labelled) + n*cardiac_period);
+		}
+	}
+
+	// Fill any gaps that are too long for a single beat with equally spaced frames
+	placed.clear();
+	placed.reserve(sequence.size());
+	for(size_t i = 0; i < sequence.size(); ++i)
+	{
+		if( ( (i > 0) || (first_segment == 0) ) && ( (i+1 < sequence.size()) || (last_segment == n_marks) ) )
+			placed.push_back(sequence[i]);
+		if( (i+1 < sequence.size()) && (sequence[i+1].frame - sequence[i].frame > max_frames_per_beat) )
+		{
+			const int gap = sequence[i+1].frame - sequence[i].frame;
+			const int number_to_add = std::round(float(gap)/cardiac_period) - 1;
+			const float spacing = float(gap)/float(number_to_add+1);
+			for(int n = 1; n <= number_to_add; n++)
+				placed.push_back({int(sequence[i].frame + std::round(n*spacing)),systole,mkAuto});
+		}
+	}
+}
+
+
+// Place an imaginary marker of the other kind before the first marker and after the
+// last one, so that the phase of the first and last beats can be interpolated
+void CardiacPhaseTracker::placeImaginaryMarkers()
+{
+	const vector<marker_t>& systole = chain[0];
+	const vector<marker_t>& diastole = chain[1];
+	if(diastole.front().frame > systole.front().frame)
+		first_marker = {int(std::round(diastole.front().frame - cardiac_period)),false,mkImaginary};
+	else
+		first_marker = {int(std::round(systole.front().frame - cardiac_period)),true,mkImaginary};
+	if(diastole.back().frame > systole.back().frame)
+		last_marker = {int(std::round(systole.back().frame + cardiac_period)),true,mkImaginary};
+	else
+		last_marker = {int(std::round(diastole.back().frame + cardiac_period)),false,mkImaginary};
+}
+
+
+// All the markers of both kinds in frames [first,last] in order, along with the
+// nearest marker either side
+void CardiacPhaseTracker::mergedMarkers(const int first, const int last, vector<marker_t>& merged) const
+{
+	const auto frame_less = [](const marker_t& m, const int frame) {return m.frame < frame;};
+	const auto less_frame = [](const int frame, const marker_t& m) {return frame < m.frame;};
+	vector<marker_t>::const_iterator begin[2], end[2];
+	for(int c = 0; c < 2; ++c)
+	{
+		begin[c] = lower_bound(chain[c].cbegin(),chain[c].cend(),first,frame_less);
+		end[c] = upper_bound(begin[c],chain[c].cend(),last,less_frame);
+		if(begin[c] != chain[c].cbegin())
+			--begin[c];
+		if(end[c] != chain[c].cend())
+			++end[c];
+	}
+
+	merged.resize((end[0]-begin[0]) + (end[1]-begin[1]));
+	std::merge(begin[0],end[0],begin[1],end[1],merged.begin(),before);
+	for(const marker_t& imaginary : {first_marker,last_marker})
+		merged.insert(upper_bound(merged.begin(),merged.end(),imaginary,before),imaginary);
+
+	// Only keep the nearest marker either side of the frames
+	const auto range_end = upper_bound(merged.begin(),merged.end(),last,less_frame);
+	if(range_end != merged.end())
+		merged.erase(next(range_end),merged.end());
+	const auto range_begin = lower_bound(merged.begin(),merged.end(),first,frame_less);
+	if(range_begin != merged.begin())
+		merged.erase(merged.begin(),prev(range_begin));
+}
+
+
+// Number of consecutive markers that are of the same kind or coincide
+int CardiacPhaseTracker::countInconsistencies(const vector<marker_t>& merged, int& first_inconsistent) const
+{
+	int n = 0;
+	for(size_t i = 1; i < merged.size(); ++i)
+	{
+		if( (merged[i].frame == merged[i-1].frame) || (merged[i].systole == merged[i-1].systole) )
+		{
+			if(n++ == 0)
+				first_inconsistent = merged[i].frame;
+		}
+	}
+	return n;
+}
+
+
+void CardiacPhaseTracker::placeAll()
+{
+	chain[0].clear();
+	chain[1].clear();
+	n_inconsistent = 0;
+	inconsistent_frame = -1;
+	is_valid = false;
+	if(!hasPeriod())
+		return;
+
+	cardiac_period = float(total_beat_length)/n_beats;
+	for(int c = 0; c < 2; ++c)
+		placeMarkers(c,0,manual[c].size(),chain[c]);
+	placeImaginaryMarkers();
+
+	vector<marker_t> merged;
+	mergedMarkers(INT_MIN,INT_MAX,merged);
+	n_inconsistent = countInconsistencies(merged,inconsistent_frame);
+	is_valid = (n_inconsistent == 0);
+}
+
+
+// Replace all the automatic marks and phases in the tracks
+void CardiacPhaseTracker::writeAll(uint8_t* phase_point_track, float* cardiac_phase_track) const
+{
+	for(int f = 0; f < n_frames; ++f)
+	{
+		if( !isSystoleMark(phase_point_track[f]) && !isDiastoleMark(phase_point_track[f]) )
+			phase_point_track[f] = NOT_LABELLED;
+	}
+
+	if(!is_valid)
+	{
+		fill_n(cardiac_phase_track,n_frames,-1.0);
+		return;
+	}
+
+	for(int c = 0; c < 2; ++c)
+	{
+		for(const marker_t& m : chain[c])
+		{
+			if(m.kind == mkAuto)
+				phase_point_track[m.frame] = m.systole ? AUTO_LABELLED_SYSTOLE : AUTO_LABELLED_DIASTOLE;
+		}
+	}
+	fillPhase(0,n_frames,cardiac_phase_track);
+}
+
+
+// Interpolate the phase of frames [first,last) between the surrounding end-systole
+// and end-diastole markers
+void CardiacPhaseTracker::fillPhase(const int first, const int last, float* cardiac_phase_track) const
+{
+	if(first >= last)
+		return;
+	vector<marker_t> markers;
+	mergedMarkers(first,last-1,markers);
+
+	auto next = upper_bound(markers.cbegin(),markers.cend(),first,[](const int frame, const marker_t& m) {return frame < m.frame;});
+	for(int f = first; f < last; ++f)
+	{
+		while( (next != markers.cend()) && (next->frame <= f) )
+			++next;
+		if( (next != markers.cbegin()) && (prev(next)->frame == f) )
+		{
+			cardiac_phase_track[f] = prev(next)->systole ? M_PI : 0.0;
+			continue;
+		}
+
+		// Frames outside the imaginary markers are extrapolated from the nearest beat
+		const marker_t& p = (next == markers.cbegin()) ? markers[0] : (next == markers.cend()) ? markers[markers.size()-2] : *prev(next);
+		const marker_t& n = (next == markers.cbegin()) ? markers[1] : (next == markers.cend()) ? markers.back() : *next;
+		if(p.systole)
+			cardiac_phase_track[f] = M_PI + M_PI*float(f - p.frame)/float(n.frame - p.frame);
+		else
+			cardiac_phase_track[f] = M_PI*float(f - p.frame)/float(n.frame - p.frame);
+	}
+}
+
+} // end of namespace
@@ -0,0 +1,118 @@
+#ifndef CARDIACPHASE_H
+#define CARDIACPHASE_H
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+// Typical fetal heart rates (BPM)
+#define MIN_HEART_RATE 110.0
+#define MAX_HEART_RATE 160.0
+
+namespace thesisUtilities
+{
+	// Calculates the cardiac phase of every frame from the end-systole and
+	// end-diastole frames marked by the annotator, or suggested from the image
+	// (which are used in the same way, but keep their own codes in the track).
+	//
+	// The period of the heart beat is the mean interval between consecutive marks of
+	// the same kind (ignoring implausible intervals). Further end-systole and
+	// end-diastole frames are placed at this period before the first mark, after the
+	// last mark and in any gap of more than one beat, and the phase is interpolated
+	// between each end-diastole (0) and end-systole (pi) frame.
+	//
+	// The end-systole and end-diastole frames are kept in sorted vectors, one entry
+	// per beat. When a single mark changes, only the stretches between the marks
+	// either side of it are placed again, along with those that depend on the period
+	// if it has changed, and only the phase of the beats that moved is rewritten. This
+	// keeps the phase up to date on every change, even in very long videos.
+	class CardiacPhaseTracker
+	{
+		public:
+			CardiacPhaseTracker();
+
+			// Recalculate the whole track from the manual and suggested marks in
+			// phase_point_track, replacing any automatic marks. Returns whether the
+			// phase is valid
+			bool recalculate(const int n_frames, const float frame_rate, uint8_t* phase_point_track, float* cardiac_phase_track);
+
+			// Change the mark of frame f to NOT_LABELLED, MANUALLY_LABELLED_SYSTOLE,
+			// MANUALLY_LABELLED_DIASTOLE, SUGGESTED_SYSTOLE or SUGGESTED_DIASTOLE and
+			// update the tracks to match. The tracks must be those last passed to
+			// recalculate(). Returns whether the phase is valid
+			bool setPhasePoint(const int f, const uint8_t phase_point, uint8_t* phase_point_track, float* cardiac_phase_track);
+
+			// Whether the phase could be calculated. If not, the tracks hold no
+			// automatic marks and the phase of every frame is -1
+			bool valid() const {return is_valid;}
+
+			// Mean number of frames per beat, if the phase is valid
+			float period() const {return cardiac_period;}
+
+			// If recalculate() found the phase not to be valid, the frame around which
+			// the end-systole and end-diastole frames do not alternate, or -1 if there
+			// were too few marks
+			int inconsistentFrame() const {return inconsistent_frame;}
+
+			// Ranges [first,last) of the frames whose mark or phase may have been
+			// changed by the last call
+			const std::vector<std::pair<int,int>>& changedFrames() const {return changed;}
+
+		private:
+			enum markerKind_t : uint8_t
+			{
+				mkManual,
+				mkAuto,
+				mkImaginary // outside the video, bounds the phase of the first and last beats
+			};
+
+			struct marker_t
+			{
+				int frame;
+				bool systole;
+				markerKind_t kind;
+			};
+
+			static bool before(const marker_t& a, const marker_t& b);
+			bool hasPeriod() const;
+			void addMark(std::vector<int>& marks, const int f);
+			void removeMark(std::vector<int>& marks, const int f);
+			int beatLength(const int first, const int second) const;
+			void placeMarkers(const int c, const int first_segment, const int last_segment, std::vector<marker_t>& placed) const;
+			void placeImaginaryMarkers();
+			void mergedMarkers(const int first, const int last, std::vector<marker_t>& merged) const;
+			int countInconsistencies(const std::vector<marker_t>& merged, int& first_inconsistent) const;
+			void placeAll();
+			void writeAll(uint8_t* phase_point_track, float* cardiac_phase_track) const;
+			void fillPhase(const int first, const int last, float* cardiac_phase_track) const;
+
+			int n_frames;
+			float min_frames_per_beat, max_frames_per_beat;
+
+			// Manually marked (and suggested) frames, sorted, and all the end-systole and
+			// end-diastole frames in the video, sorted. Index 0 for end-systole, 1 for
+			// end-diastole
+			std::vector<int> manual[2];
+			std::vector<marker_t> chain[2];
+
+			// Imaginary frames before the first and after the last frame of the chains
+			marker_t first_marker, last_marker;
+
+			// Sum and number of the plausible intervals between consecutive marks of the same kind
+			long total_beat_length;
+			int n_beats;
+
+			float cardiac_period;
+
+			// Number of consecutive end-systole and end-diastole frames that do not alternate
+			int n_inconsistent;
+			bool is_valid;
+			int inconsistent_frame;
+
+			std::vector<std::pair<int,int>> changed;
+	};
+
+}
+
+// inclusion guard
+#endif
@@ -0,0 +1,117 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include "thesisUtilities.h"
+#include "binaryTracks.h"
+
+using namespace std;
+namespace ut = thesisUtilities;
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+static bool convertHeartTrack(const fs::path& infilename, const fs::path& outfilename, const bool to_binary)
+{
+	int xsize, ysize, n_frames, radius;
+	bool headup;
+	if(!ut::scanTrackFile(infilename.string(),xsize,ysize,n_frames))
+		return false;
+
+	ut::HeartTrack track;
+	if(!ut::readTrackFile(infilename.string(),n_frames,headup,radius,track))
+		return false;
+
+	if(to_binary)
+		return ut::writeBinaryTrackFile(outfilename.string(),xsize,ysize,headup,radius,track);
+	else
+		return ut::writeTrackFile(outfilename.string(),xsize,ysize,headup,radius,track);
+}
+
+
+static bool convertStructureTrack(const fs::path& infilename, const fs::path& outfilename, const bool to_binary)
+{
+	int xsize, ysize, n_frames;
+	if(!ut::scanTrackFile(infilename.string(),xsize,ysize,n_frames))
+		return false;
+
+	vector<string> structure_names;
+	ut::StructureTrack track;
+	bool auto_propagated;
+	if(!ut::readSubstructuresTrackFile(infilename.string(),n_frames,structure_names,track,auto_propagated))
+		return false;
+
+	if(to_binary)
+		return ut::writeBinarySubstructuresTrackFile(outfilename.string(),xsize,ysize,structure_names,track,auto_propagated);
+	else
+	{
+		// The labels are written exactly as they are stored
+		const vector<vector<int>> views_per_structure(structure_names.size());
+		const ut::HeartTrack heart_track(n_frames);
+		return ut::writeSubstructuresTrackFile(outfilename.string(),xsize,ysize,structure_names,views_per_structure,heart_track,track,auto_propagated);
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	vector<fs::path> infilenames;
+	fs::path outdir;
+
+	// Declare the supported options.
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help,h", "produce help message")
+		("input,i", po::value<vector<fs::path>>(&infilenames)->multitoken(), "track file(s) to convert (.tk, .stk, .tkb or .stkb)")
+		("outputdirectory,o", po::value<fs::path>(&outdir), "directory in which to write the converted files (by default, alongside the input files)");
+
+	po::positional_options_description pos;
+	pos.add("input",-1);
+
+	po::variables_map vm;
+	po::store(po::command_line_parser(argc, argv).options(desc).positional(pos).run(), vm);
+	po::notify(vm);
+
+	if (vm.count("help") || infilenames.empty())
+	{
+		cout << "Converts track files between the text (.tk/.stk) and binary (.tkb/.stkb) formats" << endl;
+		cout << desc << endl;
+		return 1;
+	}
+
+	if(!outdir.empty())
+	{
+		boost::system::error_code ec;
+		fs::create_directories(outdir,ec);
+	}
+
+	int n_failed = 0;
+	for(const fs::path& infilename : infilenames)
+	{
+		const string extension = infilename.extension().string();
+		fs::path outfilename = outdir.empty() ? infilename : outdir / infilename.filename();
+		bool success;
+		if(extension == ".tk")
+			success = convertHeartTrack(infilename,outfilename.replace_extension(BINARY_TRACK_EXTENSION),true);
+		else if(extension == BINARY_TRACK_EXTENSION)
+			success = convertHeartTrack(infilename,outfilename.replace_extension(".tk"),false);
+		else if(extension == ".stk")
+			success = convertStructureTrack(infilename,outfilename.replace_extension(BINARY_STRUCTURE_TRACK_EXTENSION),true);
+		else if(extension == BINARY_STRUCTURE_TRACK_EXTENSION)
+			success = convertStructureTrack(infilename,outfilename.replace_extension(".stk"),false);
+		else
+		{
+			cerr << "ERROR: Unrecognised track file extension " << infilename << endl;
+			++n_failed;
+			continue;
+		}
+
+		if(!success)
+		{
+			cerr << "ERROR: Could not convert " << infilename << " to " << outfilename << endl;
+			++n_failed;
+		}
+	}
+
+	return (n_failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,325 @@
+#include "editJournal.h"
+#include "tracing.h"
+#include <cstring>
+#include <boost/filesystem.hpp>
+
+// Journal file format
+#define JOURNAL_MAGIC "HAJOURNL"
+#define JOURNAL_VERSION 1
+#define JOURNAL_TEMP_EXTENSION ".tmp"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace thesisUtilities
+{
+
+// The header at the start of a journal file, followed by a sequence of journalRecord_t
+struct journalHeader_t
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t kind;
+	uint32_t record_bytes;
+	uint32_t reserved;
+};
+static_assert(sizeof(journalHeader_t) == 24, "unexpected journal header size");
+static_assert(sizeof(journalRecord_t) == 24, "unexpected journal record size");
+
+static journalHeader_t makeHeader(const uint32_t kind)
+{
+	journalHeader_t header;
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,JOURNAL_MAGIC,sizeof(header.magic));
+	header.version = JOURNAL_VERSION;
+	header.kind = kind;
+	header.record_bytes = sizeof(journalRecord_t);
+	return header;
+}
+
+
+EditJournal::EditJournal()
+: kind(jkHeart), had_original(false), compact_running(false)
+{
+}
+
+
+EditJournal::~EditJournal()
+{
+	waitForCompaction();
+}
+
+
+bool EditJournal::open(const string& track_filename, const journalKind_t kind)
+{
+	waitForCompaction();
+	lock_guard<mutex> lk(mtx);
+	if(file.is_open())
+		file.close();
+	records.clear();
+
+	this->track_filename = track_filename;
+	this->kind = kind;
+	journal_filename = track_filename + JOURNAL_EXTENSION;
+	backup_filename = track_filename + JOURNAL_BACKUP_EXTENSION;
+
+	// Read the records of an existing journal, discarding any incomplete
+	// record at the end
+	const journalHeader_t header = makeHeader(kind);
+	{
+		ifstream infile(journal_filename.c_str(),ios::binary);
+		journalHeader_t existing_header;
+		if(infile.is_open() && infile.read(reinterpret_cast<char*>(&existing_header),sizeof(existing_header)) &&
+		   (memcmp(&existing_header,&header,sizeof(header)) == 0) )
+		{
+			journalRecord_t record;
+			while(infile.read(reinterpret_cast<char*>(&record),sizeof(record)))
+				records.emplace_back(record);
+		}
+	}
+
+	// A backup left by an unfinished session holds the track file from before that
+	// session. While the journal still has labels to recover, the session carries on
+	// in this one, so the backup is kept and discard() can still return to it.
+	// Otherwise it is no longer needed, unless the session was interrupted while
+	// replacing the track file
+	boost::system::error_code ec;
+	if(fs::exists(backup_filename,ec))
+	{
+		if(!fs::exists(track_filename,ec))
+			fs::rename(backup_filename,track_filename,ec);
+		else if(records.empty())
+			fs::remove(backup_filename,ec);
+	}
+	had_original = fs::exists(track_filename,ec);
+
+	return rewriteJournal();
+}
+
+
+int EditJournal::replay(HeartTrack& track, bool& headup, int& radius) const
+{
+	lock_guard<mutex> lk(mtx);
+	int n_applied = 0;
+	for(const journalRecord_t& record : records)
+	{
+		if( (record.structure != -1) || (record.frame < 0) || (record.frame >= track.frameCount()) )
+			continue;
+		heartLabel_t label;
+		label.labelled = record.labelled;
+		label.present = heartPresent_t(record.present);
+		label.centrey = record.y;
+		label.centrex = record.x;
+		label.ori = record.ori;
+		label.view_label = record.view_label;
+		label.phase_point = record.phase_point;
+		label.cardiac_phase = record.cardiac_phase;
+		track.setFrame(record.frame,label);
+		headup = record.headup;
+		radius = record.radius;
+		++n_applied;
+	}
+	return n_applied;
+}
+
+
+int EditJournal::replay(StructureTrack& track) const
+{
+	lock_guard<mutex> lk(mtx);
+	int n_applied = 0;
+	for(const journalRecord_t& record : records)
+	{
+		if( (record.structure < 0) || (record.structure >= track.structureCount()) || (record.frame < 0) || (record.frame >= track.frameCount()) )
+			continue;
+		subStructLabel_t label;
+		label.labelled = record.labelled;
+		label.present = record.present;
+		label.y = record.y;
+		label.x = record.x;
+		label.ori = record.ori;
+		track.setLabel(record.frame,record.structure,label);
+		++n_applied;
+	}
+	return n_applied;
+}
+
+
+bool EditJournal::append(const int f, const heartLabel_t& label, const bool headup, const int radius)
+{
+	journalRecord_t record;
+	memset(&record,0,sizeof(record));
+	record.frame = f;
+	record.structure = -1;
+	record.y = label.centrey;
+	record.x = label.centrex;
+	record.ori = label.ori;
+	record.radius = radius;
+	record.labelled = label.labelled;
+	record.present = label.present;
+	record.view_label = label.view_label;
+	record.phase_point = label.phase_point;
+	record.headup = headup;
+	record.cardiac_phase = label.cardiac_phase;
+
+	lock_guard<mutex> lk(mtx);
+	records.emplace_back(record);
+	file.write(reinterpret_cast<const char*>(&record),sizeof(record));
+	file.flush();
+	return file.good();
+}
+
+
+bool EditJournal::append(const int f, const int s, const subStructLabel_t& label)
+{
+	journalRecord_t record;
+	memset(&record,0,sizeof(record));
+	record.frame = f;
+	record.structure = s;
+	record.y = label.y;
+	record.x = label.x;
+	record.ori = label.ori;
+	record.labelled = label.labelled;
+	record.present = label.present;
+
+	lock_guard<mutex> lk(mtx);
+	records.emplace_back(record);
+	file.write(reinterpret_cast<const char*>(&record),sizeof(record));
+	file.flush();
+	return file.good();
+}
+
+
+int EditJournal::pendingCount() const
+{
+	lock_guard<mutex> lk(mtx);
+	return records.size();
+}
+
+
+bool EditJournal::compacting() const
+{
+	lock_guard<mutex> lk(mtx);
+	return compact_running;
+}
+
+
+bool EditJournal::compactInBackground(trackWriter_t writer)
+{
+	lock_guard<mutex> lk(mtx);
+	if(compact_running)
+		return false;
+	if(compactor.joinable())
+		compactor.join();
+
+	// The labels stored after this point are not in the snapshot and must stay in the journal
+	const size_t n_snapshot = records.size();
+	compact_running = true;
+	compactor = thread([this,writer,n_snapshot]() mutable
+	{
+		const bool success = writeTrack(writer);
+		lock_guard<mutex> lk(mtx);
+		if(success)
+		{
+			records.erase(records.begin(),records.begin()+n_snapshot);
+			rewriteJournal();
+		}
+		compact_running = false;
+	});
+	return true;
+}
+
+
+bool EditJournal::commit(trackWriter_t writer, const bool force)
+{
+	waitForCompaction();
+	boost::system::error_code ec;
+	if(force || (pendingCount() > 0) || !fs::exists(track_filename,ec))
+	{
+		if(!writeTrack(writer))
+			return false;
+	}
+
+	lock_guard<mutex> lk(mtx);
+	file.close();
+	records.clear();
+	fs::remove(journal_filename,ec);
+	fs::remove(backup_filename,ec);
+	return true;
+}
+
+
+void EditJournal::discard()
+{
+	waitForCompaction();
+	lock_guard<mutex> lk(mtx);
+	file.close();
+	records.clear();
+
+	boost::system::error_code ec;
+	if(fs::exists(backup_filename,ec))
+		fs::rename(backup_filename,track_filename,ec);
+	else if(!had_original)
+		fs::remove(track_filename,ec);
+	fs::remove(journal_filename,ec);
+}
+
+
+// Write the track file to a temporary file and move it into place, setting
+// aside the original track file the first time this happens
+bool EditJournal::writeTrack(trackWriter_t& writer)
+{
+	TraceSpan span("save_track");
+	const string temp_filename = track_filename + JOURNAL_TEMP_EXTENSION;
+	boost::system::error_code ec;
+	if(!writer(temp_filename))
+	{
+		fs::remove(temp_filename,ec);
+		return false;
+	}
+
+	if(had_original && !fs::exists(backup_filename,ec))
+	{
+		fs::rename(track_filename,backup_filename,ec);
+		if(ec)
+			return false;
+	}
+	fs::rename(temp_filename,track_filename,ec);
+	return !ec;
+}
+
+
+// Replace the journal file with the header and the current records, then
+// reopen it for appending. Must be called with the mutex held
+bool EditJournal::rewriteJournal()
+{
+	if(file.is_open())
+		file.close();
+
+	const string temp_filename = journal_filename + JOURNAL_TEMP_EXTENSION;
+	{
+		ofstream outfile(temp_filename.c_str(),ios::binary|ios::trunc);
+		const journalHeader_t header = makeHeader(kind);
+		outfile.write(reinterpret_cast<const char*>(&header),sizeof(header));
+		if(!records.empty())
+			outfile.write(reinterpret_cast<const char*>(records.data()),records.size()*sizeof(journalRecord_t));
+		if(!outfile.good())
+			return false;
+	}
+
+	boost::system::error_code ec;
+	fs::rename(temp_filename,journal_filename,ec);
+	if(ec)
+		return false;
+
+	file.open(journal_filename.c_str(),ios::binary|ios::app);
+	return file.is_open();
+}
+
+
+void EditJournal::waitForCompaction()
+{
+	if(compactor.joinable())
+		compactor.join();
+}
+
+} // end of namespace
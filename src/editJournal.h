@@ -0,0 +1,119 @@
+#ifndef EDITJOURNAL_H
+#define EDITJOURNAL_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <cstdint>
+#include "trackContainers.h"
+
+// Names of the journal and backup files, appended to the name of the track file
+#define JOURNAL_EXTENSION ".journal"
+#define JOURNAL_BACKUP_EXTENSION ".backup"
+
+namespace thesisUtilities
+{
+	// One stored label in a journal. Heart labels have structure set to -1 and
+	// use all the fields, structure labels leave the heart-only fields at zero
+	struct journalRecord_t
+	{
+		int32_t frame;
+		int16_t structure;
+		int16_t y;
+		int16_t x;
+		int16_t ori;
+		int16_t radius;
+		uint8_t labelled;
+		uint8_t present;
+		uint8_t view_label;
+		uint8_t phase_point;
+		uint8_t headup;
+		uint8_t reserved;
+		float cardiac_phase;
+	};
+
+	// An append-only journal of the labels stored during an annotation session, kept
+	// in a small binary file next to the track file.
+	//
+	// Each label is appended and flushed as soon as it is stored, so that it survives
+	// a crash of the tool. If a session does not finish, the journal is left behind
+	// and its labels can be replayed on top of the track file the next time the file
+	// is opened. The replayed labels stay in the journal as part of the new session,
+	// and so does the track file set aside by the unfinished session (see below).
+	//
+	// During the session the track file may be rewritten in the background from a
+	// snapshot of the labels ('compaction'), after which the journal only holds the
+	// labels stored since the snapshot. The track file as it was at the start of the
+	// session is set aside until the session ends, so that its changes can still be
+	// discarded. The track file itself is written by a function provided by the
+	// caller, which is given the name of the file to write.
+	class EditJournal
+	{
+		public:
+			enum journalKind_t : uint32_t
+			{
+				jkHeart = 1,
+				jkStructures
+			};
+
+			typedef std::function<bool(const std::string&)> trackWriter_t;
+
+			EditJournal();
+
+			// Waits for any compaction, but leaves the journal in place (as after a crash)
+			~EditJournal();
+
+			// Open (or create) the journal for a track file, returns false if this fails
+			bool open(const std::string& track_filename, const journalKind_t kind);
+
+			// Apply the labels left in the journal by an unfinished session to the
+			// labels read from the track file, returns the number of labels applied
+			int replay(HeartTrack& track, bool& headup, int& radius) const;
+			int replay(StructureTrack& track) const;
+
+			// Record a label that has been stored
+			bool append(const int f, const heartLabel_t& label, const bool headup, const int radius);
+			bool append(const int f, const int s, const subStructLabel_t& label);
+
+			// Number of labels in the journal that are not yet in the track file
+			int pendingCount() const;
+
+			bool compacting() const;
+
+			// Start rewriting the track file on a background thread. The writer must
+			// hold its own copy of the labels. Returns false if a compaction is
+			// already running
+			bool compactInBackground(trackWriter_t writer);
+
+			// End the session. commit writes the track file if any labels are pending,
+			// the file does not exist yet, or force is set. discard returns the track
+			// file to its state at the start of the session. Either way the journal is
+			// removed, unless the track file could not be written
+			bool commit(trackWriter_t writer, const bool force);
+			void discard();
+
+		private:
+			bool writeTrack(trackWriter_t& writer);
+			bool rewriteJournal();
+			void waitForCompaction();
+
+			std::string track_filename, journal_filename, backup_filename;
+			journalKind_t kind;
+			bool had_original;
+			std::ofstream file;
+
+			// The records in the journal file, oldest first
+			std::vector<journalRecord_t> records;
+
+			bool compact_running;
+			std::thread compactor;
+			mutable std::mutex mtx;
+	};
+
+}
+
+// inclusion guard
+#endif
@@ -0,0 +1,265 @@
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include "thesisUtilities.h"
+#include "trackIndex.h"
+#include "npyFiles.h"
+#include "batchJobs.h"
+
+using namespace std;
+namespace ut = thesisUtilities;
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+// Name of the file listing the exported videos
+#define MANIFEST_FILENAME "manifest.json"
+
+// Version of the layout of the exported files, recorded in the manifest
+#define EXPORT_FORMAT_VERSION 1
+
+// A video to be exported, and what was found in its track files
+struct exportJob_t
+{
+	ut::videoTrackFiles_t files;
+	int n_frames, xsize, ysize, radius;
+	bool headup;
+	vector<string> structure_names;
+	bool succeeded;
+};
+
+
+// String as a JSON string literal
+static string jsonString(const string& str)
+{
+	string quoted = "\"";
+	for(const char c : str)
+	{
+		if( (c == '"') || (c == '\\') )
+			quoted += string("\\") + c;
+		else if(static_cast<unsigned char>(c) < 0x20)
+		{
+			char escaped[8];
+			snprintf(escaped,sizeof(escaped),"\\u%04x",c);
+			quoted += escaped;
+		}
+		else
+			quoted += c;
+	}
+	return quoted + "\"";
+}
+
+
+// Write one variable to <column>.npy in a directory
+template<typename T>
+static bool writeColumn(const fs::path& dir, const string& column, const vector<size_t>& shape, const T* data)
+{
+	return ut::writeNpyFile((dir / (column + ".npy")).string(),shape,data);
+}
+
+
+// Write the columns of the track files of one video to .npy files in a directory,
+// which replaces any previous export of the video once complete
+static bool exportVideo(const fs::path& outdir, exportJob_t& job)
+{
+	const auto start_time = chrono::steady_clock::now();
+	const string& heart_filename = job.files.heart_file.path;
+	const string& structure_filename = job.files.structure_file.path;
+
+	int heart_frames = 0, structure_frames = 0;
+	ut::HeartTrack heart_track;
+	if(!heart_filename.empty())
+	{
+		if(!ut::scanTrackFile(heart_filename,job.xsize,job.ysize,heart_frames) ||
+		   !ut::readTrackFile(heart_filename,heart_frames,job.headup,job.radius,heart_track))
+		{
+			ut::LockedOutput(cerr) << "ERROR: Could not read " << heart_filename << endl;
+			return false;
+		}
+	}
+	ut::StructureTrack structure_track;
+	if(!structure_filename.empty())
+	{
+		if(!ut::scanTrackFile(structure_filename,job.xsize,job.ysize,structure_frames) ||
+		   !ut::readSubstructuresTrackFile(structure_filename,structure_frames,job.structure_names,structure_track))
+		{
+			ut::LockedOutput(cerr) << "ERROR: Could not read " << structure_filename << endl;
+			return false;
+		}
+	}
+
+	// Both files are exported with the same number of frames, any extra are unlabelled
+	job.n_frames = max(heart_frames,structure_frames);
+	const size_t n = job.n_frames;
+
+	const fs::path videodir = outdir / job.files.name;
+	const fs::path tempdir = outdir / (job.files.name + INCOMPLETE_SUFFIX);
+	boost::system::error_code ec;
+	fs::remove_all(tempdir,ec);
+	bool ok = fs::create_directory(tempdir,ec);
+
+	if(!heart_filename.empty())
+	{
+		heart_track.resize(job.n_frames);
+		ok = ok && writeColumn(tempdir,"heart_labelled",{n},heart_track.labelled());
+		ok = ok && writeColumn(tempdir,"heart_present",{n},heart_track.present());
+		ok = ok && writeColumn(tempdir,"heart_centrey",{n},heart_track.centrey());
+		ok = ok && writeColumn(tempdir,"heart_centrex",{n},heart_track.centrex());
+		ok = ok && writeColumn(tempdir,"heart_orientation",{n},heart_track.orientation());
+		ok = ok && writeColumn(tempdir,"heart_view",{n},heart_track.viewLabel());
+		ok = ok && writeColumn(tempdir,"heart_phase_point",{n},heart_track.phasePoint());
+		ok = ok && writeColumn(tempdir,"heart_cardiac_phase",{n},heart_track.cardiacPhase());
+	}
+	if(!structure_filename.empty() && (structure_track.structureCount() > 0))
+	{
+		// The structures' columns are stored one after another, so each variable
+		// is a single (structure, frame) array
+		structure_track.resize(job.n_frames);
+		const size_t n_structures = structure_track.structureCount();
+		ok = ok && writeColumn(tempdir,"structure_labelled",{n_structures,n},structure_track.labelled(0));
+		ok = ok && writeColumn(tempdir,"structure_present",{n_structures,n},structure_track.present(0));
+		ok = ok && writeColumn(tempdir,"structure_y",{n_structures,n},structure_track.y(0));
+		ok = ok && writeColumn(tempdir,"structure_x",{n_structures,n},structure_track.x(0));
+		ok = ok && writeColumn(tempdir,"structure_orientation",{n_structures,n},structure_track.orientation(0));
+	}
+
+	if(ok)
+	{
+		fs::remove_all(videodir,ec);
+		fs::rename(tempdir,videodir,ec);
+		ok = !ec;
+	}
+	if(!ok)
+	{
+		ut::LockedOutput(cerr) << "ERROR: Could not write the exported files for " << job.files.name << " to " << videodir << endl;
+		return false;
+	}
+
+	const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+	ut::LockedOutput(cout) << job.files.name << ": exported " << job.n_frames << " frames in " << seconds << " s" << endl;
+	return true;
+}
+
+
+// Write the manifest listing every exported video, under a temporary name first
+static bool writeManifest(const fs::path& outdir, const vector<exportJob_t>& jobs)
+{
+	const fs::path filename = outdir / MANIFEST_FILENAME;
+	const fs::path tempname = outdir / (MANIFEST_FILENAME INCOMPLETE_SUFFIX);
+	{
+		ofstream outfile(tempname.string().c_str(),ios::trunc);
+		if(!outfile.is_open())
+			return false;
+
+		outfile << "{\n\t\"format\": " << EXPORT_FORMAT_VERSION << ",\n\t\"videos\": [";
+		bool first = true;
+		for(const exportJob_t& job : jobs)
+		{
+			if(!job.succeeded)
+				continue;
+			const bool heart = !job.files.heart_file.path.empty();
+			const bool structures = !job.files.structure_file.path.empty() && !job.structure_names.empty();
+			outfile << (first ? "\n" : ",\n");
+			first = false;
+			outfile << "\t\t{\"name\": " << jsonString(job.files.name)
+			        << ", \"n_frames\": " << job.n_frames << ", \"xsize\": " << job.xsize << ", \"ysize\": " << job.ysize
+			        << ", \"heart_file\": " << (heart ? jsonString(job.files.heart_file.path) : "null")
+			        << ", \"headup\": " << (heart ? (job.headup ? "true" : "false") : "null")
+			        << ", \"radius\": " << (heart ? to_string(job.radius) : "null")
+			        << ", \"structure_file\": " << (structures ? jsonString(job.files.structure_file.path) : "null")
+			        << ", \"structures\": [";
+			for(size_t s = 0; s < job.structure_names.size(); ++s)
+				outfile << (s > 0 ? ", " : "") << jsonString(job.structure_names[s]);
+			outfile << "]}";
+		}
+		outfile << "\n\t]\n}\n";
+		if(!outfile.good())
+			return false;
+	}
+
+	boost::system::error_code ec;
+	fs::rename(tempname,filename,ec);
+	return !ec;
+}
+
+
+int main(int argc, char** argv)
+{
+	string hearttrackdir, trackdir;
+	fs::path outdir;
+	int n_threads;
+
+	// Declare the supported options.
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help,h", "produce help message")
+		("hearttrackdirectory,d", po::value<string>(&hearttrackdir)->default_value(""), "directory containing the heart track files (.tk/.tkb)")
+		("trackdirectory,t", po::value<string>(&trackdir)->default_value(""), "directory containing the structure track files (.stk/.stkb)")
+		("outputdirectory,o", po::value<fs::path>(&outdir), "directory in which to write the exported arrays")
+		("threads,j", po::value<int>(&n_threads)->default_value(thread::hardware_concurrency()), "number of videos to export at once");
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help"))
+	{
+		cout << "Exports the track files in a directory as NumPy arrays (.npy) that can be memory-mapped from Python" << endl;
+		cout << desc << endl;
+		return 1;
+	}
+
+	if(!vm.count("outputdirectory") || (hearttrackdir.empty() && trackdir.empty()) )
+	{
+		cerr << "ERROR: An output directory and at least one track directory must be specified" << endl;
+		return EXIT_FAILURE;
+	}
+
+	boost::system::error_code ec;
+	fs::create_directories(outdir,ec);
+
+	vector<ut::videoTrackFiles_t> found;
+	vector<string> unreadable;
+	ut::findVideoTrackFiles(hearttrackdir,trackdir,found,unreadable);
+	if(!unreadable.empty())
+	{
+		cerr << "ERROR: Could not read the directory " << unreadable.front() << endl;
+		return EXIT_FAILURE;
+	}
+
+	vector<exportJob_t> jobs(found.size());
+	for(size_t j = 0; j < found.size(); ++j)
+	{
+		jobs[j].files = found[j];
+		jobs[j].n_frames = jobs[j].xsize = jobs[j].ysize = jobs[j].radius = 0;
+		jobs[j].headup = false;
+		jobs[j].succeeded = false;
+	}
+	cout << jobs.size() << " videos to export" << endl;
+
+	// Each thread exports whole videos
+	const int n_failed = ut::runJobs(n_threads,jobs.size(),[&](const size_t j) -> bool
+	{
+		jobs[j].succeeded = exportVideo(outdir,jobs[j]);
+		return jobs[j].succeeded;
+	});
+
+	if(!writeManifest(outdir,jobs))
+	{
+		cerr << "ERROR: Could not write the manifest " << outdir / MANIFEST_FILENAME << endl;
+		return EXIT_FAILURE;
+	}
+
+	if(n_failed > 0)
+	{
+		cerr << n_failed << " of " << jobs.size() << " videos could not be exported" << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
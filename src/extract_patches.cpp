@@ -0,0 +1,192 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <opencv2/core/core.hpp>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include "thesisUtilities.h"
+#include "trackIndex.h"
+#include "npyFiles.h"
+#include "patchExtraction.h"
+#include "batchJobs.h"
+
+using namespace std;
+namespace ut = thesisUtilities;
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+// A video from which to extract patches, with its heart track file
+struct patchJob_t
+{
+	fs::path vidname, heart_filename, outdir;
+};
+
+
+// Extract the patches of one video into a directory holding the patches and their
+// labels as .npy arrays, which only gets its final name once complete
+static bool extractPatches(const patchJob_t& job, const ut::patchOptions_t& options)
+{
+	const auto start_time = chrono::steady_clock::now();
+
+	int xsize, ysize, n_frames, radius;
+	bool headup;
+	ut::HeartTrack track;
+	if(!ut::scanTrackFile(job.heart_filename.string(),xsize,ysize,n_frames) ||
+	   !ut::readTrackFile(job.heart_filename.string(),n_frames,headup,radius,track))
+	{
+		ut::LockedOutput(cerr) << "ERROR: Could not read the track file " << job.heart_filename << endl;
+		return false;
+	}
+
+	const fs::path tempdir = job.outdir.string() + INCOMPLETE_SUFFIX;
+	boost::system::error_code ec;
+	fs::remove_all(tempdir,ec);
+	fs::create_directory(tempdir,ec);
+
+	// The patches are streamed to their file as they are cropped (a new, continuous
+	// image each time), and the labels of each patch collected alongside
+	const size_t size = options.patch_size;
+	ut::NpyFileWriter patch_writer;
+	vector<int32_t> frames;
+	vector<uint8_t> views, present, phase_points;
+	vector<float> cardiac_phases;
+	bool ok = !ec && patch_writer.open((tempdir / "patches.npy").string(),"|u1",{size,size},n_frames,size*size);
+	const int n_extracted = !ok ? 0 : ut::extractVideoPatches(job.vidname.string(),track,headup,radius,options,
+		[&](const int f, const cv::Mat& patch) -> bool
+		{
+			if(!patch_writer.write(patch.ptr<uint8_t>()))
+				return false;
+			frames.emplace_back(f);
+			views.emplace_back(track.viewLabel()[f]);
+			present.emplace_back(track.present()[f]);
+			phase_points.emplace_back(track.phasePoint()[f]);
+			cardiac_phases.emplace_back(track.cardiacPhase()[f]);
+			return true;
+		});
+	ok = patch_writer.close() && ok && (n_extracted >= 0) && (size_t(n_extracted) == frames.size());
+
+	const size_t n = frames.size();
+	ok = ok && ut::writeNpyFile((tempdir / "frame.npy").string(),{n},frames.data());
+	ok = ok && ut::writeNpyFile((tempdir / "view.npy").string(),{n},views.data());
+	ok = ok && ut::writeNpyFile((tempdir / "present.npy").string(),{n},present.data());
+	ok = ok && ut::writeNpyFile((tempdir / "phase_point.npy").string(),{n},phase_points.data());
+	ok = ok && ut::writeNpyFile((tempdir / "cardiac_phase.npy").string(),{n},cardiac_phases.data());
+	if(ok)
+	{
+		fs::rename(tempdir,job.outdir,ec);
+		ok = !ec;
+	}
+	if(!ok)
+	{
+		if(n_extracted < 0)
+			ut::LockedOutput(cerr) << "ERROR: Could not open video " << job.vidname << endl;
+		else
+			ut::LockedOutput(cerr) << "ERROR: Could not write the patches of " << job.vidname << " to " << job.outdir << endl;
+		return false;
+	}
+
+	const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+	ut::LockedOutput(cout) << job.vidname.filename().string() << ": extracted " << n << " patches in " << seconds << " s" << endl;
+	return true;
+}
+
+
+int main(int argc, char** argv)
+{
+	fs::path viddir, outdir;
+	string hearttrackdir, extension;
+	int n_threads;
+	ut::patchOptions_t options;
+
+	// Declare the supported options.
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help,h", "produce help message")
+		("videodirectory,v", po::value<fs::path>(&viddir), "directory containing the videos")
+		("hearttrackdirectory,d", po::value<string>(&hearttrackdir), "directory containing the heart track files (.tk/.tkb)")
+		("outputdirectory,o", po::value<fs::path>(&outdir), "directory in which to write the patches")
+		("extension,e", po::value<string>(&extension)->default_value(".avi"), "file extension of the videos")
+		("patchsize,s", po::value<int>(&options.patch_size)->default_value(options.patch_size), "width and height of the patches in pixels")
+		("scale,c", po::value<float>(&options.scale)->default_value(options.scale), "half the width of a patch as a multiple of the heart radius")
+		("presentonly,p", "only extract patches from frames in which the heart is present")
+		("threads,j", po::value<int>(&n_threads)->default_value(thread::hardware_concurrency()), "number of videos to process at once");
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help"))
+	{
+		cout << "Extracts heart-aligned patches from the labelled frames of every video in a directory" << endl;
+		cout << desc << endl;
+		return 1;
+	}
+
+	if(!vm.count("videodirectory") || !vm.count("hearttrackdirectory") || !vm.count("outputdirectory"))
+	{
+		cerr << "ERROR: A video directory, a heart track directory and an output directory must be specified" << endl;
+		return EXIT_FAILURE;
+	}
+	if( (options.patch_size < 1) || !(options.scale > 0.0) )
+	{
+		cerr << "ERROR: The patch size and scale must be positive" << endl;
+		return EXIT_FAILURE;
+	}
+	options.present_only = vm.count("presentonly") > 0;
+
+	boost::system::error_code ec;
+	fs::create_directories(outdir,ec);
+
+	vector<ut::videoTrackFiles_t> found;
+	vector<string> unreadable;
+	ut::findVideoTrackFiles(hearttrackdir,"",found,unreadable);
+	if(!unreadable.empty())
+	{
+		cerr << "ERROR: Could not read the heart track directory " << hearttrackdir << endl;
+		return EXIT_FAILURE;
+	}
+	map<string,string> heart_files;
+	for(const ut::videoTrackFiles_t& files : found)
+		heart_files[files.name] = files.heart_file.path;
+
+	// Find the videos with heart tracks, skipping those that have already been done
+	vector<patchJob_t> jobs;
+	int n_done = 0;
+	for(fs::directory_iterator it(viddir,ec), end; !ec && (it != end); it.increment(ec))
+	{
+		const fs::path& vidname = it->path();
+		const auto heart_file = heart_files.find(vidname.stem().string());
+		if(!fs::is_regular_file(vidname) || (vidname.extension() != extension) || (heart_file == heart_files.end()))
+			continue;
+
+		patchJob_t job;
+		job.vidname = vidname;
+		job.heart_filename = heart_file->second;
+		job.outdir = outdir / vidname.stem();
+		if(fs::exists(job.outdir))
+			++n_done;
+		else
+			jobs.emplace_back(job);
+	}
+	if(ec)
+	{
+		cerr << "ERROR: Could not read the video directory " << viddir << endl;
+		return EXIT_FAILURE;
+	}
+	sort(jobs.begin(),jobs.end(),[](const patchJob_t& a, const patchJob_t& b){return a.vidname < b.vidname;});
+	cout << jobs.size() << " videos to process (" << n_done << " already done)" << endl;
+
+	// Each thread processes whole videos
+	const int n_failed = ut::runJobs(n_threads,jobs.size(),[&](const size_t j) {return extractPatches(jobs[j],options);});
+
+	if(n_failed > 0)
+	{
+		cerr << n_failed << " of " << jobs.size() << " videos could not be processed" << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
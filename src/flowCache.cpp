@@ -0,0 +1,201 @@
+#include "flowCache.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <cstring>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+// Flow cache file format
+#define FLOWCACHE_MAGIC "HAFLOWS\0"
+#define FLOWCACHE_VERSION 1
+#define FLOWCACHE_HEADER_BYTES 4096
+#define FLOWCACHE_EXTENSION ".flow"
+#define FLOWCACHE_DOWNSAMPLE 4
+#define FLOWCACHE_STEPS_PER_PIXEL 16
+
+using namespace std;
+using namespace cv;
+namespace fs = boost::filesystem;
+
+namespace thesisUtilities
+{
+
+// The header at the start of a flow cache file. It is followed by a sequence of
+// records, each consisting of the two frame indices (int32) followed by the
+// quantised flow field (int16 x and y components, row major)
+struct flowCacheHeader_t
+{
+	char magic[8];
+	uint32_t version;
+	int32_t xsize;
+	int32_t ysize;
+	int32_t downsample;
+	int32_t steps_per_pixel;
+	int32_t reserved;
+	int64_t video_size;
+	int64_t video_mtime;
+	char video_path[2048];
+	char flow_parameters[FLOWCACHE_HEADER_BYTES - 48 - 2048];
+};
+static_assert(sizeof(flowCacheHeader_t) == FLOWCACHE_HEADER_BYTES, "unexpected flow cache header size");
+
+FlowCache::FlowCache()
+: xsize(0), ysize(0), record_bytes(0), end_offset(0)
+{
+}
+
+
+bool FlowCache::open(const string& video_filename, const string& cache_dir, const int xsize, const int ysize, const string& flow_parameters)
+{
+	lock_guard<mutex> lk(mtx);
+	if(file.is_open())
+		file.close();
+	index.clear();
+
+	const videoIdentity_t video = videoIdentity(video_filename);
+	flowCacheHeader_t header;
+	memset(&header,0,sizeof(header));
+	if( (video.path.size() >= sizeof(header.video_path)) || (flow_parameters.size() >= sizeof(header.flow_parameters)) )
+		return false;
+	memcpy(header.magic,FLOWCACHE_MAGIC,sizeof(header.magic));
+	header.version = FLOWCACHE_VERSION;
+	header.xsize = xsize;
+	header.ysize = ysize;
+	header.downsample = FLOWCACHE_DOWNSAMPLE;
+	header.steps_per_pixel = FLOWCACHE_STEPS_PER_PIXEL;
+	header.video_size = video.size;
+	header.video_mtime = video.mtime;
+	strncpy(header.video_path,video.path.c_str(),sizeof(header.video_path)-1);
+	strncpy(header.flow_parameters,flow_parameters.c_str(),sizeof(header.flow_parameters)-1);
+
+	this->xsize = xsize;
+	this->ysize = ysize;
+	stored_size = Size((xsize+FLOWCACHE_DOWNSAMPLE-1)/FLOWCACHE_DOWNSAMPLE,(ysize+FLOWCACHE_DOWNSAMPLE-1)/FLOWCACHE_DOWNSAMPLE);
+	record_bytes = 2*sizeof(int32_t) + size_t(stored_size.area())*2*sizeof(int16_t);
+
+	boost::system::error_code ec;
+	fs::create_directories(cache_dir,ec);
+	const string cache_name = cacheFileName(video,cache_dir,FLOWCACHE_EXTENSION);
+
+	// Check whether an existing file belongs to this video and these parameters
+	bool valid = false;
+	size_t n_records = 0;
+	{
+		ifstream infile(cache_name.c_str(),ios::binary);
+		flowCacheHeader_t existing_header;
+		if(infile.is_open() && infile.read(reinterpret_cast<char*>(&existing_header),sizeof(existing_header)) &&
+		   (memcmp(&existing_header,&header,sizeof(header)) == 0) )
+		{
+			valid = true;
+			const uintmax_t file_bytes = fs::file_size(cache_name,ec);
+			if(!ec)
+				n_records = (file_bytes - FLOWCACHE_HEADER_BYTES)/record_bytes;
+		}
+	}
+
+	if(valid)
+	{
+		// Discard any incomplete record left at the end by an interrupted session
+		end_offset = FLOWCACHE_HEADER_BYTES + n_records*record_bytes;
+		fs::resize_file(cache_name,end_offset,ec);
+	}
+	else
+	{
+		ofstream outfile(cache_name.c_str(),ios::binary|ios::trunc);
+		outfile.write(reinterpret_cast<const char*>(&header),sizeof(header));
+		if(!outfile.good())
+			return false;
+		end_offset = FLOWCACHE_HEADER_BYTES;
+	}
+
+	file.open(cache_name.c_str(),ios::in|ios::out|ios::binary);
+	if(!file.is_open())
+		return false;
+
+	// Index the records
+	for(size_t r = 0; r < n_records; ++r)
+	{
+		const streamoff offset = FLOWCACHE_HEADER_BYTES + r*record_bytes;
+		int32_t frames[2];
+		file.seekg(offset);
+		if(!file.read(reinterpret_cast<char*>(frames),sizeof(frames)))
+			break;
+		index[key(frames[0],frames[1])] = offset;
+	}
+	file.clear();
+
+	return true;
+}
+
+
+bool FlowCache::isOpen() const
+{
+	lock_guard<mutex> lk(mtx);
+	return file.is_open();
+}
+
+
+bool FlowCache::load(const int from_f, const int to_f, Mat_<Vec2f>& flow)
+{
+	Mat_<Vec2s> quantised(stored_size);
+	{
+		lock_guard<mutex> lk(mtx);
+		const auto it = index.find(key(from_f,to_f));
+		if(it == index.end())
+			return false;
+		file.clear();
+		file.seekg(it->second + 2*sizeof(int32_t));
+		if(!file.read(reinterpret_cast<char*>(quantised.data),quantised.total()*quantised.elemSize()))
+		{
+			file.clear();
+			return false;
+		}
+	}
+
+	Mat small;
+	quantised.convertTo(small,CV_32FC2,1.0/FLOWCACHE_STEPS_PER_PIXEL);
+	Mat full;
+	resize(small,full,Size(xsize,ysize),0,0,INTER_LINEAR);
+	flow = full;
+	return true;
+}
+
+
+void FlowCache::store(const int from_f, const int to_f, const Mat_<Vec2f>& flow)
+{
+	{
+		lock_guard<mutex> lk(mtx);
+		if(!file.is_open() || (index.count(key(from_f,to_f)) > 0) )
+			return;
+	}
+
+	Mat small, quantised;
+	resize(flow,small,stored_size,0,0,INTER_AREA);
+	small.convertTo(quantised,CV_16SC2,FLOWCACHE_STEPS_PER_PIXEL);
+	if(!quantised.isContinuous())
+		quantised = quantised.clone();
+
+	lock_guard<mutex> lk(mtx);
+	if(index.count(key(from_f,to_f)) > 0)
+		return;
+	const int32_t frames[2] = {from_f,to_f};
+	file.clear();
+	file.seekp(end_offset);
+	file.write(reinterpret_cast<const char*>(frames),sizeof(frames));
+	file.write(reinterpret_cast<const char*>(quantised.data),quantised.total()*quantised.elemSize());
+	file.flush();
+	if(file.good())
+	{
+		index[key(from_f,to_f)] = end_offset;
+		end_offset += record_bytes;
+	}
+	else
+		file.close();
+}
+
+
+unsigned long long FlowCache::key(const int from_f, const int to_f)
+{
+	return (static_cast<unsigned long long>(static_cast<uint32_t>(from_f)) << 32) | static_cast<uint32_t>(to_f);
+}
+
+} // end of namespace
@@ -0,0 +1,57 @@
+#ifndef FLOWCACHE_H
+#define FLOWCACHE_H
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <fstream>
+#include <unordered_map>
+#include <mutex>
+#include "cacheFiles.h"
+
+namespace thesisUtilities
+{
+	// A file in a cache directory holding the dense optical flow fields that have
+	// been calculated between pairs of frames of a video, so that they do not have
+	// to be recalculated in later sessions.
+	//
+	// To keep the file compact, the flow fields are stored at a quarter of the
+	// resolution of the video, with each component quantised to 1/16 pixel in a
+	// 16-bit integer. The flow fields are smooth, so this makes no practical
+	// difference to the predicted motion.
+	//
+	// The file is identified by the video (see videoIdentity_t) and by a
+	// description of the parameters used to calculate the flow, and is started
+	// afresh if either does not match. New flow fields are appended to the end
+	// of the file as they are stored. The class may be used from several threads.
+	class FlowCache
+	{
+		public:
+			FlowCache();
+
+			// Open (or create) the cache file for a video, returns false if this fails
+			bool open(const std::string& video_filename, const std::string& cache_dir, const int xsize, const int ysize, const std::string& flow_parameters);
+
+			bool isOpen() const;
+
+			// Retrieve the flow from frame from_f to frame to_f, if it is in the cache
+			bool load(const int from_f, const int to_f, cv::Mat_<cv::Vec2f>& flow);
+
+			// Add the flow from frame from_f to frame to_f to the cache
+			void store(const int from_f, const int to_f, const cv::Mat_<cv::Vec2f>& flow);
+
+		private:
+			static unsigned long long key(const int from_f, const int to_f);
+
+			int xsize, ysize;
+			cv::Size stored_size;
+			size_t record_bytes;
+			std::fstream file;
+			std::streamoff end_offset;
+			std::unordered_map<unsigned long long,std::streamoff> index;
+			mutable std::mutex mtx;
+	};
+
+}
+
+// inclusion guard
+#endif
@@ -0,0 +1,727 @@
+#include "frameStore.h"
+#include "boundedQueue.h"
+#include "cacheFiles.h"
+#include "tracing.h"
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+// Number of frames to prefetch ahead of and behind the current frame,
+// relative to the direction of travel
+#define PREFETCH_AHEAD 32
+#define PREFETCH_BEHIND 4
+
+// Sidecar file format
+#define SIDECAR_MAGIC "HAFRAMES"
+#define SIDECAR_VERSION 1
+#define SIDECAR_HEADER_BYTES 4096
+#define SIDECAR_EXTENSION ".frames"
+
+using namespace std;
+using namespace cv;
+namespace fs = boost::filesystem;
+
+namespace thesisUtilities
+{
+
+// The header at the start of a sidecar file, the raw frames follow it
+struct sidecarHeader_t
+{
+	char magic[8];
+	uint32_t version;
+	int32_t xsize;
+	int32_t ysize;
+	int32_t type;
+	int32_t n_frames;
+	int64_t video_size;
+	int64_t video_mtime;
+	char video_path[SIDECAR_HEADER_BYTES - 48];
+};
+static_assert(sizeof(sidecarHeader_t) == SIDECAR_HEADER_BYTES, "unexpected sidecar header size");
+
+// Check whether all three colour channels of a frame are identical
+static bool isGrayscaleContent(const Mat& frame)
+{
+	if(frame.channels() == 1)
+		return true;
+	if(frame.channels() != 3)
+		return false;
+
+	vector<Mat> channels;
+	split(frame,channels);
+	Mat differences;
+	compare(channels[0],channels[1],differences,cv::CMP_NE);
+	if(countNonZero(differences) > 0)
+		return false;
+	compare(channels[1],channels[2],differences,cv::CMP_NE);
+	return countNonZero(differences) == 0;
+}
+
+
+void frameToColour(const Mat& frame, Mat& colour)
+{
+	if(frame.channels() == 1)
+		cvtColor(frame,colour,cv::COLOR_GRAY2BGR);
+	else
+		colour = frame.clone();
+}
+
+
+void frameToGrayscale(const Mat& frame, Mat& gray)
+{
+	if(frame.channels() == 1)
+		gray = frame;
+	else
+		cvtColor(frame,gray,cv::COLOR_BGR2GRAY);
+}
+
+FrameStore::FrameStore()
+: xsize(0), ysize(0), fourcc_code(0), frame_rate(0.0), frame_bytes(0), grayscale_mode(gsAuto), store_grayscale(false), cache_budget(0), cached_bytes(0),
+  next_decode_frame(0), current_frame(0), direction(1), n_requests(0), n_stalls(0),
+  n_frames(0), count_verified(false), count_requested(false), sidecar_mapped(false), sidecar_type(0), video_size(0), video_mtime(0),
+  n_compressed(0), n_decompressions(0), compressed_bytes(0), uncompressed_bytes(0), decompression_seconds(0.0), stop_flag(false)
+{
+}
+
+
+FrameStore::~FrameStore()
+{
+	{
+		lock_guard<mutex> lk(mtx);
+		stop_flag = true;
+	}
+	decode_cv.notify_all();
+	frame_cv.notify_all();
+	if(decode_thread.joinable())
+		decode_thread.join();
+	if(sidecar_thread.joinable())
+		sidecar_thread.join();
+	if(compress_thread.joinable())
+		compress_thread.join();
+}
+
+
+void FrameStore::useCompression(const string& format, const int jpeg_quality)
+{
+	compression_extension = string(".") + format;
+	compression_params.clear();
+	if(format == "jpeg")
+		compression_params = {cv::IMWRITE_JPEG_QUALITY,jpeg_quality};
+	else if(format == "png")
+		compression_params = {cv::IMWRITE_PNG_COMPRESSION,1}; // favour speed, frames compress well anyway
+}
+
+
+void FrameStore::setGrayscaleMode(const grayscaleMode_t mode)
+{
+	grayscale_mode = mode;
+}
+
+
+bool FrameStore::open(const string& filename, const size_t cache_budget_bytes, const string& sidecar_dir)
+{
+	TraceSpan span("video_open");
+	this->filename = filename;
+	decoder.open(filename);
+	if(!decoder.isOpened())
+		return false;
+
+	xsize = decoder.get(cv::CAP_PROP_FRAME_WIDTH);
+	ysize = decoder.get(cv::CAP_PROP_FRAME_HEIGHT);
+	n_frames = decoder.get(cv::CAP_PROP_FRAME_COUNT);
+	frame_rate = decoder.get(cv::CAP_PROP_FPS);
+	fourcc_code = static_cast<int>(decoder.get(cv::CAP_PROP_FOURCC));
+	next_decode_frame = 0;
+	cache_budget = cache_budget_bytes;
+
+	fs::path sidecar_name;
+	if(!sidecar_dir.empty())
+	{
+		const videoIdentity_t video = videoIdentity(filename);
+		video_size = video.size;
+		video_mtime = video.mtime;
+		sidecar_name = cacheFileName(video,sidecar_dir,SIDECAR_EXTENSION);
+
+		// If there is a valid sidecar, there is no need to decode anything
+		if(mapSidecar(sidecar_name.string()))
+		{
+			decoder.release();
+			count_verified = true;
+			return true;
+		}
+	}
+
+	// Decode the first frame now to decide how frames should be stored
+	Mat first_frame;
+	decoder >> first_frame;
+	if(first_frame.rows <= 0)
+		return false;
+	store_grayscale = (grayscale_mode == gsAlways) || ( (grayscale_mode == gsAuto) && isGrayscaleContent(first_frame) );
+	cacheFrame(0,prepareFrame(first_frame));
+	next_decode_frame = 1;
+
+	// The compressed copies are read by the decode thread and by peekFrame, so must be
+	// allocated before any thread starts
+	if(!compression_extension.empty())
+		compressed.resize(max(n_frames,0));
+
+	// Create a sidecar in the background if there is not already one
+	if(!sidecar_name.empty())
+	{
+		boost::system::error_code ec;
+		fs::create_directories(sidecar_dir,ec);
+		sidecar_thread = thread(&FrameStore::writeSidecar,this,sidecar_name.string());
+	}
+
+	// Start decoding, and compressing every frame if required. Otherwise the true
+	// number of frames is found when the decoder reaches the end of the video
+	decode_thread = thread(&FrameStore::decodeLoop,this);
+	if(!compression_extension.empty())
+		compress_thread = thread(&FrameStore::compressFrames,this);
+
+	return true;
+}
+
+
+bool FrameStore::getFrame(const int f, Mat& frame)
+{
+	frame = Mat();
+	unique_lock<mutex> lk(mtx);
+	if( (f < 0) || (f >= n_frames) )
+		return false;
+
+	// Frames from a mapped sidecar are used in place
+	if(sidecar_mapped)
+	{
+		++n_requests;
+		frame = sidecarFrame(f);
+		return true;
+	}
+
+	// Let the decoder know where we are heading
+	if(f != current_frame)
+	{
+		direction = (f > current_frame) ? 1 : -1;
+		current_frame = f;
+	}
+	++n_requests;
+
+	// If the frame has not been prefetched we have to wait for it
+	if(!isCached(f))
+	{
+		TraceSpan span("frame_stall");
+		++n_stalls;
+		decode_cv.notify_one();
+		frame_cv.wait(lk,[this,f]{return isCached(f) || (f >= n_frames) || stop_flag;});
+		if(!isCached(f))
+			return false;
+	}
+	else
+		decode_cv.notify_one();
+
+	const auto it = cache.find(f);
+	lru_order.splice(lru_order.begin(),lru_order,it->second.second);
+	frame = it->second.first;
+	return true;
+}
+
+
+bool FrameStore::peekFrame(const int f, Mat& frame)
+{
+	frame = Mat();
+	unique_lock<mutex> lk(mtx);
+	if( (f < 0) || (f >= n_frames) )
+		return false;
+
+	if(sidecar_mapped)
+	{
+		frame = sidecarFrame(f);
+		return true;
+	}
+
+	// A compressed copy is decompressed here rather than by the decode thread. The
+	// copy is never changed once it has been stored so it is safe to read without the lock
+	if( (size_t(f) < compressed.size()) && !compressed[f].empty() && !isCached(f) )
+	{
+		const vector<uchar>& buffer = compressed[f];
+		lk.unlock();
+		frame = imdecode(buffer,cv::IMREAD_UNCHANGED);
+		return !frame.empty();
+	}
+
+	// Otherwise the decode thread fetches the frame once the window around the
+	// current frame has been filled
+	if(!isCached(f))
+	{
+		peek_requests.push_back(f);
+		decode_cv.notify_one();
+		frame_cv.wait(lk,[this,f]{return isCached(f) || (f >= n_frames) || stop_flag;});
+		peek_requests.erase(find(peek_requests.begin(),peek_requests.end(),f));
+		if(!isCached(f))
+			return false;
+	}
+
+	frame = cache.find(f)->second.first;
+	return true;
+}
+
+
+// A frame of the mapped sidecar, must be called with the mutex held
+Mat FrameStore::sidecarFrame(const int f) const
+{
+	const char* frame_data = sidecar_map.data() + SIDECAR_HEADER_BYTES + size_t(f)*frame_bytes;
+	return Mat(ysize,xsize,sidecar_type,const_cast<char*>(frame_data));
+}
+
+
+int FrameStore::frameCount() const
+{
+	lock_guard<mutex> lk(mtx);
+	return n_frames;
+}
+
+
+int FrameStore::verifiedFrameCount()
+{
+	unique_lock<mutex> lk(mtx);
+	if(count_verified)
+		return n_frames;
+
+	// Have the decoder run on to the end of the video
+	count_requested = true;
+	decode_cv.notify_one();
+	count_cv.wait(lk,[this]{return count_verified || stop_flag;});
+	return n_frames;
+}
+
+
+size_t FrameStore::cachedBytes() const
+{
+	lock_guard<mutex> lk(mtx);
+	return cached_bytes;
+}
+
+
+void FrameStore::reportStatistics(ostream& os) const
+{
+	lock_guard<mutex> lk(mtx);
+	os << "Frame requests that stalled waiting for the decoder: " << n_stalls << "/" << n_requests << endl;
+	if(n_compressed > 0)
+	{
+		os << "Compressed frame storage (" << compression_extension.substr(1) << "): "
+		   << compressed_bytes/(1024*1024) << " MB for " << n_compressed << " frames ("
+		   << uncompressed_bytes/(1024*1024) << " MB uncompressed)" << endl;
+		if(n_decompressions > 0)
+			os << "Mean time to decompress a frame for display: " << 1000.0*decompression_seconds/n_decompressions << " ms" << endl;
+	}
+}
+
+
+int FrameStore::requestCount() const
+{
+	lock_guard<mutex> lk(mtx);
+	return n_requests;
+}
+
+
+int FrameStore::stallCount() const
+{
+	lock_guard<mutex> lk(mtx);
+	return n_stalls;
+}
+
+
+// Convert a frame from the decoder to the format in which frames are stored
+Mat FrameStore::prepareFrame(const Mat& decoded) const
+{
+	if(store_grayscale && (decoded.channels() == 3))
+	{
+		Mat gray;
+		cvtColor(decoded,gray,cv::COLOR_BGR2GRAY);
+		return gray;
+	}
+	return decoded;
+}
+
+
+// Must be called with the mutex held
+bool FrameStore::isCached(const int f) const
+{
+	return cache.count(f) > 0;
+}
+
+
+// Must be called with the mutex held
+void FrameStore::cacheFrame(const int f, const Mat& frame)
+{
+	if(isCached(f))
+		return;
+
+	frame_bytes = frame.total()*frame.elemSize();
+	lru_order.push_front(f);
+	cache.emplace(f,make_pair(frame,lru_order.begin()));
+	cached_bytes += frame_bytes;
+
+	// Evict the least recently used frames until within budget, but never the
+	// frame that is currently being displayed or the frame just added
+	auto evict_it = prev(lru_order.end());
+	while( (cached_bytes > cache_budget) && (evict_it != lru_order.begin()) )
+	{
+		const auto next_it = prev(evict_it);
+		if(*evict_it != current_frame)
+		{
+			const auto evict = cache.find(*evict_it);
+			cached_bytes -= evict->second.first.total()*evict->second.first.elemSize();
+			cache.erase(evict);
+			lru_order.erase(evict_it);
+		}
+		evict_it = next_it;
+	}
+}
+
+
+// Must be called with the mutex held
+void FrameStore::truncate(const int new_n_frames)
+{
+	if(new_n_frames < n_frames)
+		n_frames = new_n_frames;
+	count_verified = true;
+	count_cv.notify_all();
+}
+
+
+// Decide which frame the decoder should work towards next, and the range of
+// frames that should be kept in the cache as the decoder passes them.
+// Returns false if there is nothing to do. Must be called with the mutex held
+bool FrameStore::chooseDecodeTarget(int& target, int& keep_from, int& keep_to)
+{
+	if(n_frames == 0)
+		return false;
+
+	// Limit the window so that it fits comfortably in the cache, otherwise
+	// prefetching would evict frames it has just decoded
+	const int budget_frames = (frame_bytes > 0) ? int(cache_budget/frame_bytes) : PREFETCH_AHEAD;
+	const int ahead = min(PREFETCH_AHEAD,budget_frames/2);
+	const int behind = min(PREFETCH_BEHIND,budget_frames/4);
+
+	// The current frame comes first, then frames ahead and then behind in order of distance
+	target = -1;
+	for(int k = 0; (k <= ahead) && (target < 0); ++k)
+	{
+		const int g = current_frame + direction*k;
+		if( (g >= 0) && (g < n_frames) && !isCached(g) )
+			target = g;
+	}
+	for(int k = 1; (k <= behind) && (target < 0); ++k)
+	{
+		const int g = current_frame - direction*k;
+		if( (g >= 0) && (g < n_frames) && !isCached(g) )
+			target = g;
+	}
+
+	// Then fetch frames wanted by peekFrame, keeping only those
+	for(const int g : peek_requests)
+	{
+		if( (target < 0) && (g < n_frames) && !isCached(g) )
+		{
+			target = keep_from = keep_to = g;
+			return true;
+		}
+	}
+
+	// Once there is nothing left to prefetch, finish a request to find the end of the video
+	if( (target < 0) && count_requested && !count_verified )
+	{
+		target = n_frames - 1;
+		keep_from = keep_to = target;
+		return true;
+	}
+	if(target < 0)
+		return false;
+
+	keep_from = (direction > 0) ? current_frame - behind : current_frame - ahead;
+	keep_to = (direction > 0) ? current_frame + ahead : current_frame + behind;
+
+	// Restarting from the beginning of the video is expensive, so when moving
+	// backwards keep as much as the cache allows on the way past
+	if( (target < next_decode_frame) && (direction < 0) )
+		keep_from = min(keep_from,current_frame - budget_frames/2);
+
+	return true;
+}
+
+
+void FrameStore::decodeLoop()
+{
+	unique_lock<mutex> lk(mtx);
+	while(true)
+	{
+		int target, keep_from, keep_to;
+		decode_cv.wait(lk,[&]{return stop_flag || chooseDecodeTarget(target,keep_from,keep_to);});
+		if(stop_flag)
+			return;
+
+		// If a compressed copy of the frame is ready, just decompress it. The copy is
+		// never changed once it has been stored so it is safe to read without the lock
+		if( (size_t(target) < compressed.size()) && !compressed[target].empty() )
+		{
+			const vector<uchar>& buffer = compressed[target];
+			lk.unlock();
+			const int64 start_ticks = getTickCount();
+			TraceSpan span("decompress_frame");
+			const Mat decoded = imdecode(buffer,cv::IMREAD_UNCHANGED);
+			span.end();
+			const double elapsed = double(getTickCount() - start_ticks)/getTickFrequency();
+			lk.lock();
+			decompression_seconds += elapsed;
+			++n_decompressions;
+			cacheFrame(target,decoded);
+			frame_cv.notify_all();
+			continue;
+		}
+		lk.unlock();
+
+		// The decoder can only move forwards, so start again from the beginning
+		// of the video if the frame has already been passed
+		if(target < next_decode_frame)
+		{
+			decoder.release();
+			decoder.open(filename);
+			next_decode_frame = 0;
+		}
+
+		while(next_decode_frame <= target)
+		{
+			lk.lock();
+			const bool keep = (next_decode_frame >= keep_from) && (next_decode_frame <= keep_to) && !isCached(next_decode_frame);
+
+			// Abandon this run if the user has jumped to a frame that it will not reach
+			const bool abandon = stop_flag || ( !isCached(current_frame) && ((current_frame < next_decode_frame) || (current_frame > target)) );
+			lk.unlock();
+			if(abandon)
+				break;
+
+			Mat decoded; // must be a new matrix each time as the decoder may reuse its buffer
+			bool success;
+			if(keep)
+			{
+				TraceSpan span("decode_frame");
+				decoder >> decoded;
+				// Occasionally the number of frames detected by opencv is wrong
+				// Therefore check for empty frames
+				success = (decoded.rows > 0);
+			}
+			else
+				success = decoder.grab();
+
+			lk.lock();
+			if(success)
+			{
+				if(keep)
+					cacheFrame(next_decode_frame,prepareFrame(decoded));
+				++next_decode_frame;
+
+				// Reaching the reported final frame confirms the frame count
+				if( (next_decode_frame >= n_frames) && !count_verified )
+				{
+					count_verified = true;
+					count_cv.notify_all();
+				}
+			}
+			else
+				truncate(next_decode_frame);
+			lk.unlock();
+			frame_cv.notify_all();
+
+			if(!success)
+				break;
+		}
+
+		lk.lock();
+	}
+}
+
+
+// Try to map an existing sidecar file, returns false if there is no valid
+// sidecar for this video
+bool FrameStore::mapSidecar(const string& sidecar_name)
+{
+	if(!fs::exists(sidecar_name))
+		return false;
+
+	try
+	{
+		sidecar_map.open(sidecar_name);
+	}
+	catch(const std::exception&)
+	{
+		return false;
+	}
+
+	// Check that the sidecar really belongs to this version of this video
+	if(sidecar_map.size() < SIDECAR_HEADER_BYTES)
+	{
+		sidecar_map.close();
+		return false;
+	}
+	sidecarHeader_t header;
+	memcpy(&header,sidecar_map.data(),sizeof(header));
+	header.video_path[sizeof(header.video_path)-1] = '\0';
+	const size_t header_frame_bytes = size_t(header.xsize)*size_t(header.ysize)*CV_ELEM_SIZE(header.type);
+	if( (strncmp(header.magic,SIDECAR_MAGIC,sizeof(header.magic)) != 0) ||
+		(header.version != SIDECAR_VERSION) ||
+		(header.video_size != video_size) ||
+		(header.video_mtime != video_mtime) ||
+		(fs::absolute(filename).string() != header.video_path) ||
+		(header.xsize != xsize) || (header.ysize != ysize) ||
+		(header.n_frames <= 0) ||
+		(sidecar_map.size() != SIDECAR_HEADER_BYTES + size_t(header.n_frames)*header_frame_bytes) )
+	{
+		sidecar_map.close();
+		return false;
+	}
+
+	sidecar_type = header.type;
+	frame_bytes = header_frame_bytes;
+	n_frames = header.n_frames;
+	sidecar_mapped = true;
+	return true;
+}
+
+
+// Decode the whole video sequentially and write the raw frames to a sidecar file.
+// The file is written under a temporary name and only renamed once complete
+void FrameStore::writeSidecar(const string& sidecar_name)
+{
+	TraceSpan span("preload_sidecar");
+	const string partial_name = sidecar_name + ".partial";
+	VideoCapture sidecar_decoder(filename);
+	ofstream outfile(partial_name.c_str(),ios::binary);
+	if(!sidecar_decoder.isOpened() || !outfile.is_open())
+		return;
+
+	sidecarHeader_t header;
+	memset(&header,0,sizeof(header));
+	outfile.write(reinterpret_cast<const char*>(&header),sizeof(header));
+
+	const int reported_n_frames = frameCount();
+	int f = 0;
+	bool stopped = false;
+	for( ; f < reported_n_frames; ++f)
+	{
+		{
+			lock_guard<mutex> lk(mtx);
+			stopped = stop_flag;
+		}
+		if(stopped)
+			break;
+
+		Mat decoded;
+		sidecar_decoder >> decoded;
+
+		// Occasionally the number of frames detected by opencv is wrong
+		// Therefore check for empty frames
+		if(decoded.rows <= 0)
+			break;
+
+		decoded = prepareFrame(decoded);
+		if(!decoded.isContinuous())
+			decoded = decoded.clone();
+		header.type = decoded.type();
+		outfile.write(reinterpret_cast<const char*>(decoded.data),decoded.total()*decoded.elemSize());
+	}
+
+	const string video_path = fs::absolute(filename).string();
+	if(stopped || !outfile.good() || (f == 0) || (video_path.size() >= sizeof(header.video_path)) )
+	{
+		outfile.close();
+		fs::remove(partial_name);
+		return;
+	}
+
+	memcpy(header.magic,SIDECAR_MAGIC,sizeof(header.magic));
+	header.version = SIDECAR_VERSION;
+	header.xsize = xsize;
+	header.ysize = ysize;
+	header.n_frames = f;
+	header.video_size = video_size;
+	header.video_mtime = video_mtime;
+	strncpy(header.video_path,video_path.c_str(),sizeof(header.video_path)-1);
+	outfile.seekp(0);
+	outfile.write(reinterpret_cast<const char*>(&header),sizeof(header));
+	outfile.close();
+
+	boost::system::error_code ec;
+	fs::rename(partial_name,sidecar_name,ec);
+}
+
+
+// Read through the whole video, compressing every frame with a pool of worker
+// threads. This also establishes the true number of frames
+void FrameStore::compressFrames()
+{
+	TraceSpan span("preload_compress");
+	VideoCapture loader(filename);
+	const int n_workers = max(int(thread::hardware_concurrency())-1,1);
+	BoundedQueue<pair<int,Mat>> queue(2*n_workers);
+
+	vector<thread> workers;
+	for(int w = 0; w < n_workers; ++w)
+	{
+		workers.emplace_back([this,&queue]
+		{
+			pair<int,Mat> item;
+			while(queue.pop(item))
+			{
+				vector<uchar> buffer;
+				item.second = prepareFrame(item.second);
+				imencode(compression_extension,item.second,buffer,compression_params);
+				lock_guard<mutex> lk(mtx);
+				compressed_bytes += buffer.size();
+				uncompressed_bytes += item.second.total()*item.second.elemSize();
+				++n_compressed;
+				compressed[item.first].swap(buffer);
+				decode_cv.notify_one();
+			}
+		});
+	}
+
+	const int reported_n_frames = frameCount();
+	int f = 0;
+	bool stopped = !loader.isOpened();
+	for( ; (f < reported_n_frames) && !stopped; ++f)
+	{
+		Mat decoded;
+		loader >> decoded;
+
+		// Occasionally the number of frames detected by opencv is wrong
+		// Therefore check for empty frames
+		if(decoded.rows <= 0)
+			break;
+
+		{
+			lock_guard<mutex> lk(mtx);
+			stopped = stop_flag;
+		}
+		if(!queue.push(make_pair(f,decoded)))
+			break;
+	}
+	queue.close();
+	for(thread& w : workers)
+		w.join();
+
+	{
+		lock_guard<mutex> lk(mtx);
+		if(!stopped)
+			truncate(f);
+		count_verified = true;
+	}
+	count_cv.notify_all();
+	frame_cv.notify_all();
+}
+
+} // end of namespace
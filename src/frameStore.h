@@ -0,0 +1,177 @@
+#ifndef FRAMESTORE_H
+#define FRAMESTORE_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <list>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+namespace thesisUtilities
+{
+	// Whether frames are stored with a single channel
+	enum grayscaleMode_t : unsigned char
+	{
+		gsAuto = 0, // if the first frame has identical colour channels
+		gsAlways,
+		gsNever
+	};
+
+	// Provides access to the frames of a video file. Frames are decoded on demand
+	// and the most recently used ones are kept in a cache whose size is bounded by a
+	// memory budget.
+	//
+	// All decoding happens on a background thread, which also prefetches a window
+	// of frames around the most recently requested frame in the direction of travel,
+	// so that stepping through the video one frame at a time does not need to wait
+	// for the decoder.
+	//
+	// Frames are only ever decoded sequentially (seeking with opencv is unreliable
+	// for many of our videos), so a request for a frame before the current decoder
+	// position re-opens the video and decodes forward from the start.
+	//
+	// The frame count reported by opencv is occasionally wrong, so the true number
+	// of frames is established lazily: frameCount() starts at the reported value
+	// and may decrease as the end of the video is discovered by the decoder. The
+	// count is only confirmed once the decoder has reached the end of the video, so
+	// confirming it is left until labels near the end actually need it.
+	//
+	// Optionally, the decoded frames may be stored in a raw 'sidecar' file in a cache
+	// directory. The sidecar is written in the background the first time a video is
+	// opened, and on subsequent openings it is memory-mapped and frames are served
+	// directly from it without any decoding. Sidecars are identified by the path,
+	// size and modification time of the video, so a modified video is decoded again.
+	// Frames returned by getFrame must not be modified.
+	//
+	// Alternatively, the store may be asked to hold every frame of the video in
+	// memory in compressed form (PNG or JPEG). A pool of threads compresses the
+	// frames as the video is read at startup, after which frames are decompressed
+	// rather than decoded from the video when they are needed.
+	//
+	// Ultrasound videos are usually grayscale even though they are decoded with three
+	// (identical) colour channels, so by default frames are stored with a single
+	// channel if the first frame of the video is grayscale. Use frameToColour and
+	// frameToGrayscale to get frames in the required format.
+	class FrameStore
+	{
+		public:
+			FrameStore();
+			~FrameStore();
+
+			// Keep all frames in memory compressed in the given format ("png" or "jpeg"),
+			// must be called before open
+			void useCompression(const std::string& format, const int jpeg_quality);
+
+			// Choose whether frames are stored with a single channel, must be called before open
+			void setGrayscaleMode(const grayscaleMode_t mode);
+
+			// Open a video file, returns false if it cannot be opened. If sidecar_dir
+			// is not empty, it is used to store/retrieve a sidecar of decoded frames
+			bool open(const std::string& filename, const size_t cache_budget_bytes, const std::string& sidecar_dir = "");
+
+			// Retrieve frame f. Returns false (leaving frame empty) if f lies beyond
+			// the end of the video, in which case frameCount() is updated
+			bool getFrame(const int f, cv::Mat& frame);
+
+			// Retrieve frame f for background work (such as motion prediction) without
+			// moving the prefetch window, and without counting as a request from the
+			// user interface. The window around the current frame is filled first
+			bool peekFrame(const int f, cv::Mat& frame);
+
+			// The best current estimate of the number of frames in the video
+			int frameCount() const;
+
+			// The true number of frames in the video. If it is not yet known, this waits
+			// while the decoder runs on to the end of the video
+			int verifiedFrameCount();
+
+			int width() const {return xsize;}
+			int height() const {return ysize;}
+			double frameRate() const {return frame_rate;}
+			int fourcc() const {return fourcc_code;}
+
+			size_t cachedBytes() const;
+
+			// Number of calls to getFrame, and the number of these that had to
+			// wait for the decoder because the frame had not been prefetched
+			// (calls to peekFrame are not counted)
+			int requestCount() const;
+			int stallCount() const;
+
+			// Print a summary of how well the store performed
+			void reportStatistics(std::ostream& os) const;
+
+		private:
+			cv::Mat prepareFrame(const cv::Mat& decoded) const;
+			cv::Mat sidecarFrame(const int f) const;
+			bool isCached(const int f) const;
+			void cacheFrame(const int f, const cv::Mat& frame);
+			void truncate(const int new_n_frames);
+			bool chooseDecodeTarget(int& target, int& keep_from, int& keep_to);
+			void decodeLoop();
+			bool mapSidecar(const std::string& sidecar_name);
+			void writeSidecar(const std::string& sidecar_name);
+			void compressFrames();
+
+			std::string filename;
+			int xsize, ysize, fourcc_code;
+			double frame_rate;
+			size_t frame_bytes;
+			grayscaleMode_t grayscale_mode;
+			bool store_grayscale;
+
+			// Least recently used cache of decoded frames
+			size_t cache_budget, cached_bytes;
+			std::list<int> lru_order;
+			std::unordered_map<int,std::pair<cv::Mat,std::list<int>::iterator>> cache;
+
+			// Decoder state (only accessed by the decode thread)
+			cv::VideoCapture decoder;
+			int next_decode_frame;
+
+			// Requests from the user interface, and frames wanted by peekFrame
+			int current_frame, direction;
+			int n_requests, n_stalls;
+			std::vector<int> peek_requests;
+
+			// Frame count
+			int n_frames;
+			bool count_verified, count_requested;
+
+			// Memory-mapped sidecar file of decoded frames
+			bool sidecar_mapped;
+			int sidecar_type;
+			long long video_size, video_mtime;
+			boost::iostreams::mapped_file_source sidecar_map;
+
+			// Compressed copies of all frames
+			std::string compression_extension;
+			std::vector<int> compression_params;
+			std::vector<std::vector<uchar>> compressed;
+			int n_compressed, n_decompressions;
+			size_t compressed_bytes, uncompressed_bytes;
+			double decompression_seconds;
+
+			bool stop_flag;
+			std::thread decode_thread, sidecar_thread, compress_thread;
+			mutable std::mutex mtx;
+			std::condition_variable decode_cv, frame_cv, count_cv;
+	};
+
+	// Make a three-channel copy of a frame from the store, e.g. for drawing on
+	void frameToColour(const cv::Mat& frame, cv::Mat& colour);
+
+	// Get a single channel version of a frame from the store. This does not copy
+	// the frame if it is already single channel, so the result must not be modified
+	void frameToGrayscale(const cv::Mat& frame, cv::Mat& gray);
+
+}
+
+// inclusion guard
+#endif
@@ -5,10 +5,22 @@
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <list>
+#include <algorithm>
+#include <chrono>
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 #include "thesisUtilities.h"
+#include "frameStore.h"
+#include "annotationOverlays.h"
+#include "overlayRenderer.h"
+#include "editJournal.h"
+#include "cardiacPhase.h"
+#include "phaseSuggestion.h"
+#include "motionPrediction.h"
+#include "recordPipeline.h"
+#include "tracing.h"
+#include "userInput.h"
+#include "trackComparison.h"
 #include "opencvkeys.h"
 
 using namespace cv;
@@ -17,62 +29,49 @@ namespace po = boost::program_options;
 namespace fs = boost::filesystem;
 namespace ut = thesisUtilities;
 
-// View Codes
-#define VIEW_4CHAM 1
-#define VIEW_LVOT 2
-#define VIEW_RVOT 3
-#define VIEW_VSIGN 4
-
 // View Keys
 #define CHAM4_KEY ONE_KEY
 #define LVOT_KEY TWO_KEY
 #define RVOT_KEY THREE_KEY
 #define VSIGN_KEY FOUR_KEY
 
-// View Strings
-#define STR_4CHAM "4-CHAM"
-#define STR_LVOT "LVOT"
-#define STR_RVOT "3V"
-#define STR_VSIGN "V-SIGN"
-
-// View Colours
-#define CLR_4CHAM Scalar(255,255,0) // cyan
-#define CLR_LVOT Scalar(0,255,0) // green
-#define CLR_RVOT Scalar(0,255,255) // yellow
-#define CLR_VSIGN Scalar(0,0,255)  // red
-
-// Labellings for cardiac phase points
-#define NOT_LABELLED 0
-#define AUTO_LABELLED_SYSTOLE 1
-#define MANUALLY_LABELLED_SYSTOLE 2
-#define AUTO_LABELLED_DIASTOLE 3
-#define MANUALLY_LABELLED_DIASTOLE 4
-
-// Typical fetal heart rates (BPM)
-#define MIN_HEART_RATE 110.0
-#define MAX_HEART_RATE 160.0
+// Number of stored labels after which the track file is rewritten in the background
+#define JOURNAL_COMPACTION_LABELS 500
+
+// Largest difference from the recalculated cardiac phase for a stored value to be up to date
+// (the text track files round it)
+#define PHASE_TOLERANCE 1e-4
 
 // Prototypes
-// Function to update the cardiac phase labels
-bool recalculate_cardiac_phase(int n_frames, float &cardiac_period, float frame_rate, float *cardiac_phase_track,int *phase_point_track);
+// Explain why the cardiac phase could not be calculated
+void report_phase_error(const ut::CardiacPhaseTracker& phase_tracker);
+// Mark the end-systole and end-diastole frames suggested by the image in place of any
+// earlier suggestions, returns whether any mark changed
+bool suggest_phase_points(ut::HeartSignalCache& signal_cache, const string& video_filename, ut::HeartTrack& track, const int radius, const float frame_rate);
+// Move the heart centre and orientation by the rigid motion of the heart from one frame to another
+void predict_heart_motion(ut::FrameStore& frame_store, const int from_f, const int to_f, const int radius, int& centrex, int& centrey, int& ori);
 
 int main(int argc, char** argv)
 {
 	int f, nextf, previousf = -1, centrex, centrey, radius = 80, ori, view_label, phase_point;
 	ut::heartPresent_t heart_present;
 	bool headup = true;
-	float cardiac_period, cardiac_phase, frame_rate;
+	float cardiac_phase, frame_rate;
 	int xsize, ysize, n_frames;
 	int key_press = -1;
-	Mat disp;
-	vector<Mat> I;
-	VideoCapture vid_obj;
+	Mat disp, frame;
+	ut::FrameStore frame_store;
+	ut::OverlayRenderer renderer;
+	ut::CardiacPhaseTracker phase_tracker;
+	ut::HeartSignalCache signal_cache;
+	ut::UserInput user_input;
+	unsigned frame_cache_mb;
+	int jpeg_quality;
+	string frame_storage, grayscale, motion_prediction_str;
 	bool irrelevant_key, exit_flag, overwrite_mode = false, read_error = false, read_success = false, record_mode = false,
-		 just_stored_label = false, cardiac_phase_valid = false;
-	Scalar colour;
-	string view_string;
-	VideoWriter output_video;
-	fs::path trackdir, vidname;
+		 just_stored_label = false, cardiac_phase_valid = false, motion_prediction;
+	ut::videoProperties_t video;
+	fs::path trackdir, vidname, frame_cache_dir, trace_file, replay_script, record_script, replay_times, golden_file;
 
 	// Declare the supported options.
 	po::options_description desc("Allowed options");
@@ -80,6 +79,17 @@ int main(int argc, char** argv)
 		("help,h", "produce help message")
 		("video,v", po::value<fs::path>(&vidname), "input video file")
 		("trackdirectory,t", po::value<fs::path>(&trackdir)->default_value("."), "directory containing the input/output track file")
+		("frame-cache-mb", po::value<unsigned>(&frame_cache_mb)->default_value(512), "memory budget for caching decoded video frames (MB)")
+		("frame-cache-dir", po::value<fs::path>(&frame_cache_dir)->default_value(""), "directory in which to keep decoded frames between sessions (disabled if empty)")
+		("frame-storage", po::value<string>(&frame_storage)->default_value("raw"), "how to hold frames in memory: 'raw' (decode on demand) or compressed as 'png' or 'jpeg'")
+		("jpeg-quality", po::value<int>(&jpeg_quality)->default_value(95), "quality (0-100) of frames held as 'jpeg'")
+		("grayscale", po::value<string>(&grayscale)->default_value("auto"), "store frames with a single channel: 'yes', 'no' or 'auto' (if the video is grayscale)")
+		("motion-prediction,m", po::value<string>(&motion_prediction_str)->default_value("rigid"), "initial method for predicting heart motion between frames: 'rigid' or 'off'")
+		("trace", po::value<fs::path>(&trace_file)->default_value(""), "write a Chrome trace of decoding, display, optical flow and saving to this file and print latency percentiles on exit")
+		("replay", po::value<fs::path>(&replay_script)->default_value(""), "take key presses from this input script instead of the keyboard, without opening a window")
+		("replay-times", po::value<fs::path>(&replay_times)->default_value(""), "write the time taken by each replayed key press to this file")
+		("record-input", po::value<fs::path>(&record_script)->default_value(""), "record the key presses of this session as an input script")
+		("golden", po::value<fs::path>(&golden_file)->default_value(""), "on exit, check that the track file matches this one (fails if not)")
 		("record,r" , "record the visualisation in a video file");
 
 	po::variables_map vm;
@@ -93,37 +103,74 @@ int main(int argc, char** argv)
 		return EXIT_SUCCESS;
 	}
 
+	// Time the work done from here on if requested
+	const ut::TraceSession trace_session(trace_file.string());
+
 	if (vm.count("record"))
 		record_mode = true;
 
-	// Open
-	vid_obj.open(vidname.string());
-	if ( !vid_obj.isOpened())
+	if( (frame_storage == "png") || (frame_storage == "jpeg") )
+		frame_store.useCompression(frame_storage,jpeg_quality);
+	else if(frame_storage != "raw")
+	{
+		cerr << "ERROR: Unrecognised frame storage option " << frame_storage << endl;
+		return EXIT_FAILURE;
+	}
+
+	if(grayscale == "yes")
+		frame_store.setGrayscaleMode(ut::gsAlways);
+	else if(grayscale == "no")
+		frame_store.setGrayscaleMode(ut::gsNever);
+	else if(grayscale != "auto")
 	{
-		cerr  << "Could not open reference " << vidname << endl;
+		cerr << "ERROR: Unrecognised grayscale option " << grayscale << endl;
 		return EXIT_FAILURE;
 	}
 
-	xsize = vid_obj.get(cv::CAP_PROP_FRAME_WIDTH);
-	ysize = vid_obj.get(cv::CAP_PROP_FRAME_HEIGHT);
-	n_frames = vid_obj.get(cv::CAP_PROP_FRAME_COUNT);
-	frame_rate = vid_obj.get(cv::CAP_PROP_FPS);
+	if( (motion_prediction_str != "rigid") && (motion_prediction_str != "off") )
+	{
+		cerr << "ERROR: Unrecognised motion prediction option " << motion_prediction_str << endl;
+		return EXIT_FAILURE;
+	}
+	motion_prediction = (motion_prediction_str == "rigid");
 
-	// Read in all frames into a buffer (this gets around decoding issues)
-	I.resize(n_frames);
-	for(f = 0; f < n_frames; f++)
+	// Take key presses from a script instead of the keyboard, or record them
+	if(!replay_script.empty())
 	{
-		vid_obj >> I[f];
+		if(!user_input.replay(replay_script.string()))
+			return EXIT_FAILURE;
+	}
+	else if(!record_script.empty() && !user_input.record(record_script.string()))
+		return EXIT_FAILURE;
 
-		// Occasionally the number of frames detected by opencv is wrong
-		// Therefore check for empty frames
-		if( I[f].rows <= 0)
+	// Open (frames are decoded on demand by the frame store, or by the record pipeline in record mode)
+	if(record_mode)
+	{
+		if(!ut::readVideoProperties(vidname.string(),video))
+		{
+			cerr  << "Could not open reference " << vidname << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		if ( !frame_store.open(vidname.string(),size_t(frame_cache_mb)*1024*1024,frame_cache_dir.string()) || !frame_store.getFrame(0,frame) )
 		{
-			n_frames = f;
-			break;
+			cerr  << "Could not open reference " << vidname << endl;
+			return EXIT_FAILURE;
 		}
+		video.xsize = frame_store.width();
+		video.ysize = frame_store.height();
+		video.n_frames = frame_store.frameCount();
+		video.fourcc = frame_store.fourcc();
+		video.frame_rate = frame_store.frameRate();
 	}
 
+	xsize = video.xsize;
+	ysize = video.ysize;
+	n_frames = video.n_frames;
+	frame_rate = video.frame_rate;
+
 	cout << "Heart Annotation Tool \n"
 			"Control List: \n"
 			"  Arrow Keys : Move heart centre \n"
@@ -136,11 +183,14 @@ int main(int argc, char** argv)
 			"  4          : Mark as VSIGN view\n"
 			"  S          : Mark frame as end-systole (toggle) \n"
 			"  D          : Mark frame as end-diastole (toggle) \n"
-			"  Z          : Automatically (re-)calculate cardiac phase values \n"
+			"  E          : Suggest end-systole and end-diastole frames from the image inside the heart circle \n"
+			"  Y          : Accept all suggested end-systole and end-diastole frames as manual marks \n"
+			"  Z          : Recalculate all cardiac phase values and report any problem with the marks \n"
 			"  Delete     : Marked as present/not present/obscured (toggle) \n"
 			"  Enter      : Move to next frame and save label \n"
 			"  Backspace  : Move to previous frame and save label \n"
 			"  O          : Toggle overwrite mode (changes are propagated even to frames with existing labels) \n"
+			"  M          : Toggle motion prediction (rigid heart tracking/off) \n"
 			"  P          : Move to the next frame without saving label \n"
 			"  R          : Move to the previous frame without saving label \n"
 			"  Esc        : Exit (and save annotations) \n"
@@ -159,15 +209,8 @@ int main(int argc, char** argv)
 	}
 	cout << "Using frame rate: " << frame_rate << endl;
 
-	// Create tracks
-	vector<int> centrex_track(n_frames);
-	vector<int> centrey_track(n_frames);
-	vector<int> ori_track(n_frames);
-	vector<int> view_label_track(n_frames);
-	vector<ut::heartPresent_t> heart_present_track(n_frames);
-	vector<int> phase_point_track(n_frames);
-	vector<bool> labelled_track(n_frames);
-	vector<float> cardiac_phase_track(n_frames);
+	// Create track
+	ut::HeartTrack track(n_frames);
 
 	// Look for an existing track file
 	const fs::path outvidname = trackdir / vidname.stem().concat("_labels").replace_extension(".avi");
@@ -176,8 +219,7 @@ int main(int argc, char** argv)
 	// Check it exists
 	if(fs::exists(outfilename))
 	{
-		read_success = ut::readTrackFile(outfilename.string(), n_frames, headup, radius, labelled_track, heart_present_track, centrey_track,
-			                       centrex_track, ori_track, view_label_track, phase_point_track, cardiac_phase_track);
+		read_success = ut::readTrackFile(outfilename.string(), n_frames, headup, radius, track);
 		read_error = !read_success;
 	}
 	else
@@ -191,71 +233,174 @@ int main(int argc, char** argv)
 	if(!read_success)
 	{
 		// Initialise tracks as -1 (unlabelled)
-		for(f = 0 ; f < n_frames; f++)
-		{
-			labelled_track[f] = false;
-			phase_point_track[f] = NOT_LABELLED;
-			cardiac_phase_track[f] = -1.0;
-		}
+		track = ut::HeartTrack(n_frames);
+		fill_n(track.phasePoint(),n_frames,NOT_LABELLED);
+		fill_n(track.cardiacPhase(),n_frames,-1.0);
 	}
-	else if(  (cardiac_phase_track[0] >= 0.0) && (labelled_track[0]) )
-		cardiac_phase_valid = true;
-
-	namedWindow( "Heart Annotation", WINDOW_AUTOSIZE );// Create a window for display.
-
 
-	// Create an output video
+	// Writes the track file from a snapshot of the current labels
+	const auto track_writer = [&]() -> ut::EditJournal::trackWriter_t
+	{
+		ut::HeartTrack snapshot = track;
+		const bool snapshot_headup = headup;
+		const int snapshot_radius = radius;
+		return [=](const string& filename) mutable {return ut::writeTrackFile(filename,xsize,ysize,snapshot_headup,snapshot_radius,snapshot);};
+	};
+
+	// Record mode draws the stored labels into the output video without a window
+	// and without changing any labels
 	if(record_mode)
 	{
-		int ex = static_cast<int>(vid_obj.get(cv::CAP_PROP_FOURCC));
-		output_video.open(outvidname.string(), ex, frame_rate, Size(xsize,ysize), true);
-
-		if (!output_video.isOpened())
+		ut::videoLabels_t labels;
+		labels.has_heart = true;
+		labels.heart = track;
+		labels.headup = headup;
+		labels.radius = radius;
+		labels.cardiac_phase_valid = (track.cardiacPhase()[0] >= 0.0) && (track.labelled()[0]);
+
+		const int n_written = ut::recordLabelVideo(vidname.string(),labels,outvidname.string(),video.fourcc,frame_rate);
+		if(n_written < 0)
 		{
 			cerr  << "Could not open the output video for write: " << outvidname << endl;
 			return EXIT_FAILURE;
 		}
+		cout << "Recorded " << n_written << " frames to " << outvidname << endl;
+		return EXIT_SUCCESS;
 	}
 
-	// Loop through frames
+	// Every stored label is recorded in a journal. Recover any labels stored in a
+	// session that did not finish. They stay in the journal, so they are only written
+	// to the track file with the rest of this session (and quitting leaves it unchanged)
+	ut::EditJournal journal;
+	if(!journal.open(outfilename.string(),ut::EditJournal::jkHeart))
+	{
+		cerr << "Could not open the edit journal for " << outfilename << endl;
+		return EXIT_FAILURE;
+	}
+	const int n_recovered = journal.replay(track,headup,radius);
+	if(n_recovered > 0)
+		cout << "Recovered " << n_recovered << " stored labels from an unfinished session (exit with Esc to keep them, or quit to return the track file to how it was before that session)" << endl;
+	const bool start_headup = headup;
+	const int start_radius = radius;
+
+	// The stored cardiac phase is shown until an end-systole or end-diastole mark
+	// changes, so opening a track never rewrites it (and the stored phase is kept if
+	// the marks are not consistent). The tracker is seeded from copies of the marks,
+	// and its incremental updates are only used once the track matches it
+	cardiac_phase_valid = (track.cardiacPhase()[0] >= 0.0) && (track.labelled()[0]);
+	bool phase_tracker_in_sync;
+	{
+		vector<uint8_t> seed_phase_point(track.phasePoint(),track.phasePoint()+n_frames);
+		vector<float> seed_cardiac_phase(track.cardiacPhase(),track.cardiacPhase()+n_frames);
+		phase_tracker.recalculate(n_frames,frame_rate,seed_phase_point.data(),seed_cardiac_phase.data());
+		phase_tracker_in_sync = equal(seed_phase_point.cbegin(),seed_phase_point.cend(),track.phasePoint()) &&
+		                        equal(seed_cardiac_phase.cbegin(),seed_cardiac_phase.cend(),track.cardiacPhase(),
+		                              [](const float a, const float b) {return std::abs(a - b) < PHASE_TOLERANCE;});
+		if(phase_tracker_in_sync)
+			cardiac_phase_valid = phase_tracker.valid();
+		else if(!phase_tracker.valid() && (phase_tracker.inconsistentFrame() >= 0))
+		{
+			report_phase_error(phase_tracker);
+			cout << "The stored cardiac phase values are kept until the marks are changed" << endl;
+		}
+	}
+
+	// Journals the frames whose cardiac phase was changed by the last update
+	const auto journal_phase_changes = [&]()
+	{
+		for(const auto& range : phase_tracker.changedFrames())
+			for(int l = range.first; l < range.second; ++l)
+				journal.append(l,track.frame(l),headup,radius);
+	};
+
+	// Recalculates the cardiac phase of the whole track, journalling only the frames that change
+	const auto recalculate_phase = [&]()
+	{
+		const vector<uint8_t> old_phase_point(track.phasePoint(),track.phasePoint()+n_frames);
+		const vector<float> old_cardiac_phase(track.cardiacPhase(),track.cardiacPhase()+n_frames);
+		cardiac_phase_valid = phase_tracker.recalculate(n_frames,frame_rate,track.phasePoint(),track.cardiacPhase());
+		phase_tracker_in_sync = true;
+		for(int l = 0; l < n_frames; ++l)
+			if( (track.phasePoint()[l] != old_phase_point[l]) || (track.cardiacPhase()[l] != old_cardiac_phase[l]) )
+				journal.append(l,track.frame(l),headup,radius);
+	};
+
+	// Stores the end-systole/end-diastole mark of a frame. The cardiac phase is updated
+	// straight away, only rewriting the beats either side of it once the track matches
+	// the tracker
+	const auto store_phase_point = [&](const int l, const uint8_t mark)
+	{
+		if(phase_tracker_in_sync)
+		{
+			cardiac_phase_valid = phase_tracker.setPhasePoint(l,mark,track.phasePoint(),track.cardiacPhase());
+			journal_phase_changes();
+		}
+		else
+		{
+			track.phasePoint()[l] = mark;
+			journal.append(l,track.frame(l),headup,radius);
+			recalculate_phase();
+		}
+	};
+
+	user_input.openWindow("Heart Annotation");// Create a window for display.
+
+	// Loop through frames, timing the response to each key press until the result is displayed
+	ut::TraceSpan key_to_display("key_to_display",false);
 	exit_flag = false;
 	f = 0;
 	while(!exit_flag)
 	{
+		// Fetch the frame. The frame count reported by opencv is sometimes wrong, so we may
+		// only find out here that we have moved past the end of the video
+		n_frames = frame_store.frameCount();
+		if(!frame_store.getFrame(f,frame))
+		{
+			n_frames = frame_store.frameCount();
+			if( (key_press == RETURN_KEY) || (key_press == VAR_RETURN_KEY) )
+				break;
+			f = previousf; // stall on the final frame
+			continue;
+		}
+
+		renderer.setBase(frame);
+
 		// Initialise the labels to this frame to either their previously labelled values
 		// Or, if the frame has not been labelled yet, to the values from the previous frame
 		// Start in the middle for the first frame
-		if((f == 0) && (!labelled_track[0]))
+		if((f == 0) && (!track.labelled()[0]))
 		{
 			centrex = xsize/2;
 			centrey = ysize/2;
 			ori = 90;
 			view_label = VIEW_4CHAM;
 			heart_present = ut::hpPresent;
-			phase_point = NOT_LABELLED;
-			cardiac_phase = -1.0;
 		}
 		else
 		{
 			// Retrieve a previous labelling if one exists
-			if( labelled_track[f] && (!overwrite_mode || (overwrite_mode && !just_stored_label) ) )
+			if( track.labelled()[f] && (!overwrite_mode || (overwrite_mode && !just_stored_label) ) )
 			{
-				centrex = centrex_track[f];
-				centrey = centrey_track[f];
-				ori = ori_track[f];
-				view_label = view_label_track[f];
-				heart_present = heart_present_track[f];
-				phase_point = phase_point_track[f];
+				const ut::heartLabel_t label = track.frame(f);
+				centrex = label.centrex;
+				centrey = label.centrey;
+				ori = label.ori;
+				view_label = label.view_label;
+				heart_present = label.present;
 			}
 			// Propagate the label in the previously labelled frame
 			else if(just_stored_label)
 			{
-				centrex = centrex_track[previousf];
-				centrey = centrey_track[previousf];
-				ori = ori_track[previousf];
-				view_label = view_label_track[previousf];
-				heart_present = heart_present_track[previousf];
-				phase_point = NOT_LABELLED; // don't propogate this...
+				const ut::heartLabel_t label = track.frame(previousf);
+				centrex = label.centrex;
+				centrey = label.centrey;
+				ori = label.ori;
+				view_label = label.view_label;
+				heart_present = label.present;
+
+				// Follow the movement of the heart since the previous frame
+				if(motion_prediction)
+					predict_heart_motion(frame_store,previousf,f,radius,centrex,centrey,ori);
 			}
 			// Apply a default labelling
 			else
@@ -265,108 +410,41 @@ int main(int argc, char** argv)
 				ori = 90;
 				view_label = VIEW_4CHAM;
 				heart_present = ut::hpPresent;
-				phase_point = cardiac_phase_valid ? phase_point_track[f]  : NOT_LABELLED;
 			}
-
-			if(cardiac_phase_valid)
-				cardiac_phase = cardiac_phase_track[f];
-			else
-				cardiac_phase = -1.0;
 		}
 
+		// The end-systole and end-diastole marks and the cardiac phase belong to each
+		// frame, so are never propagated from another frame
+		phase_point = track.phasePoint()[f];
+		cardiac_phase = cardiac_phase_valid ? track.cardiacPhase()[f] : -1.0;
+
 		just_stored_label = false;
 		nextf = f;
 		while((nextf == f) && (!exit_flag))
 		{
-			// Display the image
-			disp = I[f].clone();
-
-			switch(view_label)
-			{
-				case VIEW_4CHAM:
-					colour = CLR_4CHAM;
-					view_string = STR_4CHAM;
-					break;
-				case VIEW_LVOT:
-					colour = CLR_LVOT;
-					view_string = STR_LVOT;
-					break;
-				case VIEW_RVOT:
-					colour = CLR_RVOT;
-					view_string = STR_RVOT;
-					break;
-				case VIEW_VSIGN:
-					colour = CLR_VSIGN;
-					view_string = STR_VSIGN;
-					break;
-			}
-
-			if(heart_present == ut::hpObscured)
-				colour *= 0.5;
-
-			if(heart_present != ut::hpNone)
-			{
-				int lineThickness = 2;
-				circle(disp,Point(centrex,centrey),radius,colour,lineThickness);
-				line(disp,Point(centrex,centrey), Point(std::round(centrex+radius*std::cos(float(ori)*M_PI/180.0)),std::round(centrey-radius*std::sin(float(ori)*M_PI/180.0))),colour,lineThickness);
-				if(headup)
-				{
-					putText(disp,"L",Point(std::round(centrex+(radius+10)*std::cos(float(ori+90)*M_PI/180.0))-5,std::round(centrey-(radius+10)*std::sin(float(ori+90)*M_PI/180.0))+5),FONT_HERSHEY_PLAIN,1.0,colour);
-					putText(disp,"R",Point(std::round(centrex+(radius+10)*std::cos(float(ori-90)*M_PI/180.0))-5,std::round(centrey-(radius+10)*std::sin(float(ori-90)*M_PI/180.0))+5),FONT_HERSHEY_PLAIN,1.0,colour);
-				}
-				else
-				{
-					putText(disp,"R",Point(std::round(centrex+(radius+10)*std::cos(float(ori+90)*M_PI/180.0))-5,std::round(centrey-(radius+10)*std::sin(float(ori+90)*M_PI/180.0))+5),FONT_HERSHEY_PLAIN,1.0,colour);
-					putText(disp,"L",Point(std::round(centrex+(radius+10)*std::cos(float(ori-90)*M_PI/180.0))-5,std::round(centrey-(radius+10)*std::sin(float(ori-90)*M_PI/180.0))+5),FONT_HERSHEY_PLAIN,1.0,colour);
-				}
-				putText(disp,view_string,Point(std::round(centrex+20*std::cos(float(ori+180)*M_PI/180.0))-30,std::round(centrey-20*std::sin(float(ori+180)*M_PI/180.0))+5),FONT_HERSHEY_PLAIN,1.0,colour);
-
-
-				// Cardiac phase visualisation
-				if(cardiac_phase_valid)
-				{
-					Point phaseVisPoint(std::round(centrex + 0.5*(1-std::cos(cardiac_phase))*radius*std::cos(float(ori)*M_PI/180.0)),std::round(centrey - 0.5*(1-std::cos(cardiac_phase))*radius*std::sin(float(ori)*M_PI/180.0)));
-					circle(disp,phaseVisPoint,3,colour,-1);
-					if (cardiac_phase < M_PI)
-						arrowedLine(disp,phaseVisPoint,Point(std::round(phaseVisPoint.x + 10.0*std::cos(float(ori)*M_PI/180.0)),std::round(phaseVisPoint.y - 10.0*std::sin(float(ori)*M_PI/180.0))),colour,lineThickness,8,0,1.5);
-					else
-						arrowedLine(disp,phaseVisPoint,Point(std::round(phaseVisPoint.x - 10.0*std::cos(float(ori)*M_PI/180.0)),std::round(phaseVisPoint.y + 10.0*std::sin(float(ori)*M_PI/180.0))),colour,lineThickness,8,0,1.5);
-				}
-			}
-
-			// End systole and end diastole labels
-			if(phase_point == AUTO_LABELLED_SYSTOLE)
-				putText(disp,"(ES)",Point(std::round(centrex+(radius+10)*std::cos(float(ori)*M_PI/180.0))-5,std::round(centrey-(radius+10)*std::sin(float(ori)*M_PI/180.0))+5),FONT_HERSHEY_PLAIN,1.0,colour);
-			else if (phase_point == MANUALLY_LABELLED_SYSTOLE)
-				putText(disp,"ES",Point(std::round(centrex+(radius+10)*std::cos(float(ori)*M_PI/180.0))-5,std::round(centrey-(radius+10)*std::sin(float(ori)*M_PI/180.0))+5),FONT_HERSHEY_PLAIN,1.0,colour);
-			else if(phase_point == AUTO_LABELLED_DIASTOLE)
-				putText(disp,"(ED)",Point(std::round(centrex+(radius+10)*std::cos(float(ori)*M_PI/180.0))-5,std::round(centrey-(radius+10)*std::sin(float(ori)*M_PI/180.0))+5),FONT_HERSHEY_PLAIN,1.0,colour);
-			else if(phase_point == MANUALLY_LABELLED_DIASTOLE)
-				putText(disp,"ED",Point(std::round(centrex+(radius+10)*std::cos(float(ori)*M_PI/180.0))-5,std::round(centrey-(radius+10)*std::sin(float(ori)*M_PI/180.0))+5),FONT_HERSHEY_PLAIN,1.0,colour);
+			// Display the image, only redrawing the parts that have changed
+			const ut::heartOverlay_t heart_overlay = {centrex,centrey,radius,ori,view_label,heart_present,headup,phase_point,cardiac_phase_valid,cardiac_phase};
+			renderer.setElement(0,heart_overlay);
 
 			// Frame number display
-			putText(disp,string("Frame ") + to_string(f) + string("/") + to_string(n_frames-1),Point(5,ysize-10),FONT_HERSHEY_PLAIN,1.0,Scalar(0,255,255));
+			renderer.setElement(1,ut::textOverlay_t{string("Frame ") + to_string(f) + string("/") + to_string(n_frames-1),Point(5,ysize-10),Scalar(0,255,255)});
 
 			// Overwrite mode display
 			if(overwrite_mode)
-				putText(disp,"OVERWRITE",Point(xsize-100,ysize-10),FONT_HERSHEY_PLAIN,1.0,Scalar(0,255,255));
-
-			imshow("Heart Annotation",disp);
+				renderer.setElement(2,ut::textOverlay_t{"OVERWRITE",Point(xsize-100,ysize-10),Scalar(0,255,255)});
+			else
+				renderer.clearElement(2);
 
-			// Add this frame to the output video and continue to the next frame
-			if(record_mode)
-			{
-				output_video << disp;
-				nextf = f + 1;
-				waitKey(10);
-				break;
-			}
+			disp = renderer.render();
+			user_input.show(disp);
+			key_to_display.end();
 
 			// Wait for a (relevant) key press
 			do
 			{
 				irrelevant_key = false;
-				key_press = waitKey(0);
+				key_press = user_input.waitKey();
+				key_to_display.begin();
 				switch(key_press)
 				{
 					case LEFT_ARROW:
@@ -435,25 +513,54 @@ int main(int argc, char** argv)
 						overwrite_mode = !overwrite_mode;
 						break;
 
+					case M_KEY:
+						motion_prediction = !motion_prediction;
+						cout << "Motion prediction: " << (motion_prediction ? "rigid" : "off") << endl;
+						break;
+
+					// The mark is stored with the rest of the label. A suggested mark of
+					// the same kind is removed
 					case S_KEY:
-						if(phase_point == MANUALLY_LABELLED_SYSTOLE)
+						if( (phase_point == MANUALLY_LABELLED_SYSTOLE) || (phase_point == SUGGESTED_SYSTOLE) )
 							phase_point = NOT_LABELLED;
 						else
 							phase_point = MANUALLY_LABELLED_SYSTOLE;
 						break;
 
 					case D_KEY:
-						if(phase_point == MANUALLY_LABELLED_DIASTOLE)
+						if( (phase_point == MANUALLY_LABELLED_DIASTOLE) || (phase_point == SUGGESTED_DIASTOLE) )
 							phase_point = NOT_LABELLED;
 						else
 							phase_point = MANUALLY_LABELLED_DIASTOLE;
 						break;
 
+					// Accepting the suggested marks does not change the cardiac phase
+					case Y_KEY:
+					{
+						const vector<int> accepted = ut::acceptSuggestedPhasePoints(n_frames,track.phasePoint());
+						for(const int l : accepted)
+							journal.append(l,track.frame(l),headup,radius);
+						if( (phase_point == SUGGESTED_SYSTOLE) || (phase_point == SUGGESTED_DIASTOLE) )
+							phase_point = track.phasePoint()[f];
+						cout << "Accepted " << accepted.size() << " suggested end-systole and end-diastole frames" << endl;
+						break;
+					}
+
+					// Any mark not yet stored in this frame is kept
+					case E_KEY:
 					case Z_KEY:
-						cardiac_phase_valid = recalculate_cardiac_phase(n_frames, cardiac_period, frame_rate, cardiac_phase_track.data(),phase_point_track.data());
-						if(cardiac_phase_valid)
-							cardiac_phase = cardiac_phase_track[f];
+					{
+						const bool mark_pending = (phase_point != track.phasePoint()[f]);
+						if( (key_press == E_KEY) && !suggest_phase_points(signal_cache,vidname.string(),track,radius,frame_rate) )
+							break;
+						recalculate_phase();
+						if(!cardiac_phase_valid)
+							report_phase_error(phase_tracker);
+						if(!mark_pending)
+							phase_point = track.phasePoint()[f];
+						cardiac_phase = cardiac_phase_valid ? track.cardiacPhase()[f] : -1.0;
 						break;
+					}
 
 					case P_KEY:
 					case RETURN_KEY:
@@ -505,20 +612,29 @@ int main(int argc, char** argv)
 
 		if( (key_press == RETURN_KEY) || (key_press == VAR_RETURN_KEY) || (key_press == BACKSPACE_KEY) || (key_press == VAR_BACKSPACE_KEY))
 		{
-			// Store the values for the frame we just annotated
-			centrex_track[f] = centrex;
-			centrey_track[f] = centrey;
-			view_label_track[f] = view_label;
-			ori_track[f] = ori;
-			heart_present_track[f] = heart_present;
-			labelled_track[f] = true;
-			phase_point_track[f] = phase_point;
+			// Store the values for the frame we just annotated, starting with its
+			// end-systole/end-diastole mark so that its cardiac phase is up to date
+			if(phase_point != track.phasePoint()[f])
+				store_phase_point(f,phase_point);
+			ut::heartLabel_t label = track.frame(f);
+			label.centrex = centrex;
+			label.centrey = centrey;
+			label.view_label = view_label;
+			label.ori = ori;
+			label.present = heart_present;
+			label.labelled = true;
+			track.setFrame(f,label);
+			journal.append(f,label,headup,radius);
 			just_stored_label = true;
 		}
 
+		// Bring the track file up to date in the background every so often
+		if( (journal.pendingCount() >= JOURNAL_COMPACTION_LABELS) && !journal.compacting() )
+			journal.compactInBackground(track_writer());
+
 		if(f == n_frames - 1 )
 		{
-			if( (key_press == RETURN_KEY) || (key_press == VAR_RETURN_KEY) || record_mode )
+			if( (key_press == RETURN_KEY) || (key_press == VAR_RETURN_KEY) )
 				exit_flag = true;
 			else if (key_press == P_KEY)
 				nextf = f; // stall on the final frame
@@ -530,322 +646,109 @@ int main(int argc, char** argv)
 
 	} // frame loop
 
-	// Write to file
-	if( (key_press != Q_KEY) && (!record_mode) )
-	{
-		ofstream outfile(outfilename.string().c_str());
-		if (!outfile.is_open())
-			return false;
+	// Report how often the prefetcher failed to keep up, and any compression statistics
+	frame_store.reportStatistics(cout);
 
-		outfile << "# frame_no labelled present centrey centrex orientation view_label phasepoints cardiac_phase" << endl;
-		outfile << xsize << " " << ysize << endl;
-		outfile << headup << " " << radius << endl;
-
-		for(f = 0; f < n_frames; f++)
-		{
-			if(!labelled_track[f])
-			{
-				 heart_present_track[f] = ut::hpNone;
-				 centrey_track[f] = 0;
-				 centrex_track[f] = 0;
-				 ori_track[f] = 0;
-				 view_label_track[f] = 0;
-			}
-
-			outfile << f << " "
-					<< labelled_track[f] << " "
-					<< heart_present_track[f] << " "
-					<< centrey_track[f] << " "
-					<< centrex_track[f] << " "
-					<< ori_track[f] << " "
-					<< view_label_track[f] << " "
-					<< phase_point_track[f] << " "
-					<< cardiac_phase_track[f] <<
-					endl;
-		}
-
-
-		outfile.close();
-	}
-
-	if(record_mode)
-		output_video.release();
-
-}
-
-
-// Function to update the cardiac phase labels
-bool recalculate_cardiac_phase(int n_frames, float &cardiac_period, float frame_rate, float *cardiac_phase_track,int *phase_point_track)
-{
-	int f, n;
-	list<int> end_systole_frames, end_diastole_frames;
-	list<int>::iterator sys_it, dias_it, sys_it2, dias_it2;
-	int num_in_average = 0, first_labelled, last_labelled, number_to_add;
-	float running_total_length = 0.0, min_frames_per_beat, max_frames_per_beat, beat_length, spacing;
-	bool in_systole, video_end;
-
-	// Calculate the minimum and maximum acceptable periods for a single heart beat
-	min_frames_per_beat = 60.0*frame_rate/MAX_HEART_RATE;
-	max_frames_per_beat = 60.0*frame_rate/MIN_HEART_RATE;
-
-
-	// Loop through frames, adding up difference between successive end-systoles and end-diastoles
-	for(f = 0; f < n_frames; f++)
+	// Write to file, which is only needed if there are labels that have not
+	// already been written in the background
+	if(key_press != Q_KEY)
 	{
-		if(phase_point_track[f] == MANUALLY_LABELLED_DIASTOLE)
-		{
-			if(end_diastole_frames.size() > 0)
-			{
-				beat_length = float(f - end_diastole_frames.back());
-				if( (beat_length > min_frames_per_beat) && (beat_length < max_frames_per_beat) )
-				{
-					num_in_average++;
-					running_total_length += beat_length;
-				}
-			}
-			end_diastole_frames.emplace_back(f);
-		}
+		// Make sure the file has exactly one line per frame
+		n_frames = frame_store.verifiedFrameCount();
+		track.resize(n_frames);
 
-		else if(phase_point_track[f] == MANUALLY_LABELLED_SYSTOLE)
+		const bool force_write = read_error || (headup != start_headup) || (radius != start_radius);
+		if(!journal.commit(track_writer(),force_write))
 		{
-			if(end_systole_frames.size() > 0)
-			{
-				beat_length = float(f - end_systole_frames.back());
-				if( (beat_length > min_frames_per_beat) && (beat_length < max_frames_per_beat) )
-				{
-					num_in_average++;
-					running_total_length += beat_length;
-				}
-			}
-			end_systole_frames.emplace_back(f);
+			cerr << "ERROR: Could not write track file " << outfilename << " (the labels are kept in its journal)" << endl;
+			return EXIT_FAILURE;
 		}
-
-		// Remove any previous automated markers
-		else
-			phase_point_track[f] = NOT_LABELLED;
-	}
-
-	// Check that there are sufficiently many labelled points to actually predict other values
-	if( (end_diastole_frames.size() < 1) || (end_systole_frames.size() < 1) || num_in_average == 0 )
-	{
-		cerr << "ERROR: You need to have labelled at least one end-systole and one end-diastole frame, and additionally one consecutive pair of either end-systole or end-diastole frames" << endl;
-		return false;
-	}
-
-	// Calculate the average time period of the cardiac cycle
-	cardiac_period = running_total_length/num_in_average;
-
-	// Fill in end-systole frames before the first labelled one
-	first_labelled = end_systole_frames.front();
-	f = first_labelled - std::round(cardiac_period);
-	n = 1;
-	while(f >= 0)
-	{
-		end_systole_frames.push_front(f);
-		phase_point_track[f] = AUTO_LABELLED_SYSTOLE;
-		n++;
-		f = std::round(float(first_labelled) - n*cardiac_period);
-	}
-
-	// Same for end-distole frames before the first labelled one
-	first_labelled = end_diastole_frames.front();
-	f = first_labelled - std::round(cardiac_period);
-	n = 1;
-	while(f >= 0)
-	{
-		end_diastole_frames.push_front(f);
-		phase_point_track[f] = AUTO_LABELLED_DIASTOLE;
-		n++;
-		f = std::round(float(first_labelled) - n*cardiac_period);
-	}
-
-	// Now fill in end-systole frames after the final labelled one
-	last_labelled = end_systole_frames.back();
-	f = last_labelled + std::round(cardiac_period);
-	n = 1;
-	while(f < n_frames)
-	{
-		end_systole_frames.emplace_back(f);
-		phase_point_track[f] = AUTO_LABELLED_SYSTOLE;
-		n++;
-		f = std::round(float(last_labelled) + n*cardiac_period);
 	}
+	else
+		journal.discard();
 
-	// Now fill in end-diastole frames after the final labelled one
-	last_labelled = end_diastole_frames.back();
-	f = last_labelled + std::round(cardiac_period);
-	n = 1;
-	while(f < n_frames)
-	{
-		end_diastole_frames.emplace_back(f);
-		phase_point_track[f] = AUTO_LABELLED_DIASTOLE;
-		n++;
-		f = std::round(float(last_labelled) + n*cardiac_period);
-	}
-
-
-	// Now add end_systole frames in gaps
-	sys_it = end_systole_frames.begin();
-	sys_it2 = next(sys_it);
-	while(sys_it2 != end_systole_frames.end())
+	// Report on a replayed session, then check the labels it produced
+	if(user_input.replaying())
 	{
-		// If the difference between these pairs is greater than
-		// the allowable distance, we need to add some frames in between
-		if(*sys_it2 - *sys_it > max_frames_per_beat)
+		user_input.endSession();
+		user_input.reportStepTimes(cout);
+		if(!replay_times.empty() && !user_input.writeStepTimes(replay_times.string()))
 		{
-			number_to_add = std::round(float(*sys_it2 - *sys_it)/cardiac_period) - 1;
-			spacing = float(*sys_it2 - *sys_it)/float(number_to_add+1);
-			// Insert into the vector, equally spaced
-			for(n = 1; n <= number_to_add; n++)
-			{
-				f = *sys_it + std::round(n*spacing);
-				phase_point_track[f] = AUTO_LABELLED_SYSTOLE;
-				end_systole_frames.insert(sys_it2,f);
-			}
+			cerr << "ERROR: Could not write the replay times to " << replay_times << endl;
+			return EXIT_FAILURE;
 		}
-		// Advance iterators to the next pair
-		sys_it = sys_it2;
-		sys_it2++;
+		if(!user_input.scriptComplete())
+			return EXIT_FAILURE;
 	}
-
-	// Same for end diastole frames in gaps
-	dias_it = end_diastole_frames.begin();
-	dias_it2 = next(dias_it);
-	while(dias_it2 != end_diastole_frames.end())
+	if(!golden_file.empty())
 	{
-		// If the difference between these pairs is greater than
-		// the allowable distance, we need to add some frames in between
-		if(*dias_it2 - *dias_it > max_frames_per_beat)
+		if(!ut::compareTrackFiles(outfilename.string(),golden_file.string(),cerr))
 		{
-			number_to_add = std::round(float(*dias_it2 - *dias_it)/cardiac_period) - 1;
-			spacing = float(*dias_it2 - *dias_it)/float(number_to_add+1);
-			// Insert into the vector, equally spaced
-			for(n = 1; n <= number_to_add; n++)
-			{
-				f = *dias_it + std::round(n*spacing);
-				phase_point_track[f] = AUTO_LABELLED_DIASTOLE;
-				end_diastole_frames.insert(dias_it2,f);
-			}
+			cerr << "ERROR: The labels in " << outfilename << " do not match " << golden_file << endl;
+			return EXIT_FAILURE;
 		}
-		// Advance iterators to the next pair
-		dias_it = dias_it2;
-		dias_it2++;
+		cout << "The labels match " << golden_file << endl;
 	}
 
-	// A third loop to predict the cardiac phase for all frames
-	sys_it = end_systole_frames.begin();
-	dias_it = end_diastole_frames.begin();
-	if(*dias_it > *sys_it)
-	{
-		// The video starts during systole
-		in_systole = true;
-		// Place an imaginary end_diastole frame at the beginning
-		end_diastole_frames.push_front(std::round(*dias_it - cardiac_period));
-		dias_it = end_diastole_frames.begin();
-	}
-	else
-	{
-		// The video starts during diastole
-		in_systole = false;
-		// Place an imaginary end_systole frame at the beginning
-		end_systole_frames.push_front(std::round(*sys_it - cardiac_period));
-		sys_it = end_systole_frames.begin();
-	}
+}
+
 
-	// Put in an imaginary frame at the end too
-	if( end_diastole_frames.back() > end_systole_frames.back() )
-		end_systole_frames.emplace_back(std::round( end_systole_frames.back() + cardiac_period));
+// Explain why the cardiac phase could not be calculated
+void report_phase_error(const ut::CardiacPhaseTracker& phase_tracker)
+{
+	if(phase_tracker.inconsistentFrame() < 0)
+		cerr << "ERROR: You need to have labelled at least one end-systole and one end-diastole frame, and additionally one consecutive pair of either end-systole or end-diastole frames" << endl;
 	else
-		end_diastole_frames.emplace_back(std::round( end_diastole_frames.back() + cardiac_period));
+		cout << "ERROR: The end diastole and systole frames you have chosen give rise to an inconsistency at around frame "
+		<< phase_tracker.inconsistentFrame() << ". Please carefully check your annotations and try again." << endl;
+}
+
 
-	// Check that the end diastole and end systole frames alternate as they should do
-	bool last_was_end_systole = (end_systole_frames.front() > end_diastole_frames.front());
-	list<int>::iterator sys_it_test = end_systole_frames.begin(), dias_it_test = end_diastole_frames.begin();
-	while((sys_it_test != end_systole_frames.end()) || (dias_it_test != end_diastole_frames.end()))
+// Mark the end-systole and end-diastole frames suggested by the image in place of any
+// earlier suggestions, returns whether any mark changed
+bool suggest_phase_points(ut::HeartSignalCache& signal_cache, const string& video_filename, ut::HeartTrack& track, const int radius, const float frame_rate)
+{
+	const auto start_time = chrono::steady_clock::now();
+	vector<float> signal;
+	if(!signal_cache.signal(video_filename,track,radius,signal))
 	{
-		if((sys_it_test != end_systole_frames.end()) && (dias_it_test != end_diastole_frames.end()))
-		{
-			if(*sys_it == *dias_it)
-			{
-				cout << "ERROR: The end diastole and systole frames you have chosen give rise to an inconsistency at around frame "
-				<< *dias_it_test << ". Please carefully check your annotations and try again." << endl;
-				return false;
-			}
-		}
-		if(sys_it_test == end_systole_frames.end() || ( (dias_it_test != end_diastole_frames.end()) && (*sys_it_test > *dias_it_test) ) )
-		{
-			// cout << "       " << *dias_it_test << "" << endl; // Helpful debug output
-			if(!last_was_end_systole)
-			{
-				cout << "ERROR: The end diastole and systole frames you have chosen give rise to an inconsistency at around frame "
-				<< *dias_it_test << ". Please carefully check your annotations and try again." << endl;
-				return false;
-			}
-			last_was_end_systole = false;
-			++dias_it_test;
-		}
-		else
-		{
-			// cout << *sys_it_test << "" << endl; // Helpful debug output
-			if(last_was_end_systole)
-			{
-				cout << "ERROR: The end diastole and systole frames you have chosen give rise to an inconsistency at around frame "
-				<< *sys_it_test << ". Please carefully check your annotations and try again." << endl;
-				return false;
-			}
-			last_was_end_systole = true;
-			++sys_it_test;
-		}
+		cerr << "ERROR: Could not read the frames to suggest end-systole and end-diastole frames" << endl;
+		return false;
 	}
-	assert(sys_it_test == end_systole_frames.end() && dias_it_test == end_diastole_frames.end());
-
-	f = 0;
-	video_end = false;
 
-	while(!video_end)
+	const float period = ut::dominantPeriod(signal,frame_rate);
+	if(std::isnan(period))
 	{
-		if(in_systole)
-		{
-			// Loop through frames before the end systole frame
-			while(f < *sys_it)
-			{
-				if(f >= n_frames)
-				{
-					video_end = true;
-					break;
-				}
-				cardiac_phase_track[f] = M_PI*float(f - *dias_it)/float(*sys_it - *dias_it);
-				f++;
-			}
-			// Now we are at the end systole frame
-			if(video_end || f >= n_frames)
-				break;
-			in_systole = false;
-			cardiac_phase_track[f++] = M_PI;
-			dias_it++;
-		}
-		else
-		{
-			// Loop through frames before the end diastole frame
-			while(f < *dias_it)
-			{
-				if(f >= n_frames)
-				{
-					video_end = true;
-					break;
-				}
-				cardiac_phase_track[f] = M_PI + M_PI*float(f - *sys_it)/float(*dias_it - *sys_it);
-				f++;
-			}
-			// Now we are at the end diastole frame
-			if(video_end || f >= n_frames)
-				break;
-			in_systole = true;
-			cardiac_phase_track[f++] = 0.0;
-			sys_it++;
-		}
+		cerr << "ERROR: Could not find a heart beat in the image inside the heart circle, check the circle is placed over the heart" << endl;
+		return false;
 	}
 
-	return true;
+	vector<int> systole, diastole;
+	ut::suggestPhasePoints(signal,period,systole,diastole);
+	int n_removed;
+	const int n_added = ut::addSuggestedPhasePoints(systole,diastole,period,track.frameCount(),track.phasePoint(),n_removed);
+	const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+	cout << "Suggested " << n_added << " end-systole and end-diastole frames (period " << period << " frames, "
+	     << 60.0*frame_rate/period << " BPM) in " << seconds << " s" << endl;
+	if(n_removed > 0)
+		cout << "Removed " << n_removed << " earlier suggestions" << endl;
+	return (n_added > 0) || (n_removed > 0);
+}
 
+
+// Move the heart centre and orientation by the rigid motion of the heart from one frame to another
+void predict_heart_motion(ut::FrameStore& frame_store, const int from_f, const int to_f, const int radius, int& centrex, int& centrey, int& ori)
+{
+	Mat from_frame, to_frame, from_gray, to_gray;
+	if(!frame_store.peekFrame(from_f,from_frame) || !frame_store.peekFrame(to_f,to_frame))
+		return;
+	ut::frameToGrayscale(from_frame,from_gray);
+	ut::frameToGrayscale(to_frame,to_gray);
+
+	ut::rigidMotion_t motion;
+	if(!ut::predictRigidMotion(from_gray,to_gray,Point2f(centrex,centrey),radius,motion))
+		return;
+	centrex = min(max(int(std::round(centrex + motion.translation.x)),0),to_gray.cols-1);
+	centrey = min(max(int(std::round(centrey + motion.translation.y)),0),to_gray.rows-1);
+	ori = ((ori + int(std::round(motion.rotation))) % 360 + 360) % 360;
 }
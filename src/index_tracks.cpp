@@ -0,0 +1,59 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <boost/program_options.hpp>
+#include "trackIndex.h"
+
+using namespace std;
+namespace ut = thesisUtilities;
+namespace po = boost::program_options;
+
+int main(int argc, char** argv)
+{
+	string heart_dir, structure_dir, index_file;
+	int n_threads;
+
+	// Declare the supported options.
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help,h", "produce help message")
+		("hearttrackdirectory,d", po::value<string>(&heart_dir)->default_value(""), "directory containing the heart track files (.tk/.tkb)")
+		("trackdirectory,t", po::value<string>(&structure_dir)->default_value(""), "directory containing the structure track files (.stk/.stkb)")
+		("index,x", po::value<string>(&index_file), "index file to create or update")
+		("threads,j", po::value<int>(&n_threads)->default_value(max(int(thread::hardware_concurrency()),1)), "number of threads used to read track files");
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help") || index_file.empty() || (heart_dir.empty() && structure_dir.empty()))
+	{
+		cout << "Creates or updates an index of the labels in a collection of track files," << endl;
+		cout << "reading only the files that have changed since the index was last updated" << endl;
+		cout << desc << endl;
+		return 1;
+	}
+
+	const auto start = chrono::steady_clock::now();
+
+	ut::TrackIndex index;
+	const bool existed = index.read(index_file);
+	vector<string> failed;
+	const int n_indexed = index.update(heart_dir,structure_dir,n_threads,failed);
+	if(!index.write(index_file))
+	{
+		cerr << "ERROR: Could not write the index file " << index_file << endl;
+		return EXIT_FAILURE;
+	}
+
+	const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	cout << (existed ? "Updated " : "Created ") << index_file << ": indexed " << n_indexed << " videos ("
+	     << index.videos().size() - n_indexed << " unchanged) in " << seconds << " s" << endl;
+
+	for(const string& f : failed)
+		cerr << "ERROR: Could not read " << f << endl;
+
+	return failed.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,61 @@
+#include "labelRendering.h"
+#include "thesisUtilities.h"
+#include "annotationOverlays.h"
+
+using namespace std;
+using namespace cv;
+
+namespace thesisUtilities
+{
+
+bool readVideoLabels(const string& heart_filename, const string& structure_filename, const int n_frames, videoLabels_t& labels)
+{
+	labels.has_heart = !heart_filename.empty();
+	labels.has_structures = !structure_filename.empty();
+	if(!labels.has_heart && !labels.has_structures)
+		return false;
+
+	if(labels.has_heart)
+	{
+		if(!readTrackFile(heart_filename,n_frames,labels.headup,labels.radius,labels.heart))
+			return false;
+		labels.cardiac_phase_valid = (n_frames > 0) && labels.heart.labelled()[0] && (labels.heart.cardiacPhase()[0] >= 0.0);
+	}
+	else
+		labels.heart = HeartTrack(n_frames);
+
+	if(labels.has_structures && !readSubstructuresTrackFile(structure_filename,n_frames,labels.structure_names,labels.structures))
+		return false;
+
+	return true;
+}
+
+
+void drawLabels(Mat& img, const videoLabels_t& labels, const int f, const int n_frames)
+{
+	const bool in_track = (f < labels.heart.frameCount());
+	if(labels.has_heart && labels.draw_heart && in_track && labels.heart.labelled()[f])
+	{
+		const heartLabel_t label = labels.heart.frame(f);
+		drawOverlay(img,heartOverlay_t{label.centrex,label.centrey,labels.radius,label.ori,label.view_label,label.present,labels.headup,
+		                               label.phase_point,labels.cardiac_phase_valid,label.cardiac_phase});
+	}
+
+	// Structures are coloured by the view label in the heart track, if there is one
+	const int view_label = (labels.has_heart && in_track && labels.heart.present()[f] != hpNone) ? labels.heart.viewLabel()[f] : 0;
+	const int colour_index = (view_label < n_views) ? view_label : 0;
+
+	const int n_structures = labels.has_structures ? labels.structures.structureCount() : 0;
+	for(int s = 0; s < n_structures; ++s)
+	{
+		if( (f < labels.structures.frameCount()) && labels.structures.labelled(s)[f] )
+		{
+			const subStructLabel_t label = labels.structures.label(f,s);
+			drawOverlay(img,structureOverlay_t{label.x,label.y,label.ori,label.present,view_colours[colour_index]});
+		}
+	}
+
+	drawOverlay(img,textOverlay_t{string("Frame ") + to_string(f) + string("/") + to_string(n_frames-1),Point(5,img.rows-10),Scalar(0,255,255)});
+}
+
+} // end of namespace
@@ -0,0 +1,41 @@
+#ifndef LABELRENDERING_H
+#define LABELRENDERING_H
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+#include "trackContainers.h"
+
+namespace thesisUtilities
+{
+	// The stored labels of a video, as drawn in the '_labels' visualisation videos.
+	// Either the heart track or the structure track may be absent. If the heart is
+	// not drawn, its track is still used to colour the structures by view
+	struct videoLabels_t
+	{
+		bool has_heart;
+		bool draw_heart;
+		HeartTrack heart;
+		bool headup;
+		int radius;
+		bool cardiac_phase_valid;
+
+		bool has_structures;
+		StructureTrack structures;
+		std::vector<std::string> structure_names;
+
+		videoLabels_t() : has_heart(false), draw_heart(true), headup(true), radius(0), cardiac_phase_valid(false), has_structures(false) {}
+	};
+
+	// Read the labels of a video with n_frames frames from a heart track file and/or a
+	// structure track file (an empty file name means the track is absent). Returns false
+	// if a file cannot be read or neither is given
+	bool readVideoLabels(const std::string& heart_filename, const std::string& structure_filename, const int n_frames, videoLabels_t& labels);
+
+	// Draw the labels of frame f over the frame. Only labelled frames and structures
+	// are drawn. The frame number is shown at the bottom left of the image
+	void drawLabels(cv::Mat& img, const videoLabels_t& labels, const int f, const int n_frames);
+}
+
+// inclusion guard
+#endif
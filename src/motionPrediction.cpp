@@ -0,0 +1,287 @@
+#include "motionPrediction.h"
+#include "tracing.h"
+#include <opencv2/video/video.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+using namespace std;
+using namespace cv;
+
+namespace thesisUtilities
+{
+
+// Parameters for Farneback dense optical flow
+const double C_FB_PYR_SCALE = 0.5;
+const int C_FB_LEVELS = 3;
+const int C_FB_WINSIZE = 30;
+const int C_FB_ITERATIONS = 3;
+const int C_FB_POLY_N = 7;
+const double C_FB_POLY_SIGMA = 1.5;
+const int C_FB_FLAGS = OPTFLOW_FARNEBACK_GAUSSIAN;
+
+// Parameters for Lucas-Kanade tracking
+const Size C_LK_WINSIZE(31,31);
+const int C_LK_LEVELS = 3;
+const float C_LK_MAX_FB_ERROR = 2.0; // pixels
+
+// Parameters for rigid heart motion
+const int C_RIGID_MAX_PATCH = 128; // pixels across, larger hearts are shrunk to this size
+const float C_RIGID_SCORE_RADIUS = 0.9; // fraction of the patch within which the images are compared
+
+string motionPredictionName(const motionPrediction_t mode)
+{
+	switch(mode)
+	{
+		case mpDense:
+			return "dense";
+		case mpSparse:
+			return "sparse";
+		case mpOff:
+		default:
+			return "off";
+	}
+}
+
+
+bool parseMotionPrediction(const string& name, motionPrediction_t& mode)
+{
+	if(name == "off")
+		mode = mpOff;
+	else if(name == "dense")
+		mode = mpDense;
+	else if(name == "sparse")
+		mode = mpSparse;
+	else
+		return false;
+	return true;
+}
+
+
+string denseFlowParameters()
+{
+	stringstream ss;
+	ss << "farneback pyr_scale=" << C_FB_PYR_SCALE << " levels=" << C_FB_LEVELS << " winsize=" << C_FB_WINSIZE << " iterations=" << C_FB_ITERATIONS
+	   << " poly_n=" << C_FB_POLY_N << " poly_sigma=" << C_FB_POLY_SIGMA << " flags=" << C_FB_FLAGS;
+	return ss.str();
+}
+
+
+void prepareMotion(const Mat& oldim, const Mat& newim, const motionPrediction_t mode, framePairMotion_t& motion)
+{
+	motion = framePairMotion_t();
+	motion.mode = mode;
+	if(mode == mpDense)
+	{
+		TraceSpan span("farneback_flow");
+		calcOpticalFlowFarneback(oldim,newim,motion.flow,C_FB_PYR_SCALE,C_FB_LEVELS,C_FB_WINSIZE,C_FB_ITERATIONS,C_FB_POLY_N,C_FB_POLY_SIGMA,C_FB_FLAGS);
+	}
+	else if(mode == mpSparse)
+	{
+		TraceSpan span("lk_pyramids");
+		buildOpticalFlowPyramid(oldim,motion.old_pyramid,C_LK_WINSIZE,C_LK_LEVELS);
+		buildOpticalFlowPyramid(newim,motion.new_pyramid,C_LK_WINSIZE,C_LK_LEVELS);
+	}
+}
+
+
+static void predictMotionDense(const framePairMotion_t& motion, const vector<Point2f>& old_points, vector<Point2f>& new_points)
+{
+	new_points.resize(old_points.size());
+	for(unsigned p = 0; p < old_points.size(); ++p)
+	{
+		const Vec2f flow_offset = motion.flow(std::round(old_points[p].y),std::round(old_points[p].x));
+		new_points[p] = old_points[p] + Point2f(flow_offset[0],flow_offset[1]);
+	}
+}
+
+
+static void predictMotionSparse(const framePairMotion_t& motion, const vector<Point2f>& old_points, vector<Point2f>& new_points)
+{
+	TraceSpan span("lk_flow");
+	const TermCriteria criteria(TermCriteria::COUNT+TermCriteria::EPS,30,0.01);
+
+	// Track forward, then track the results backward to check for consistency
+	vector<Point2f> returned_points;
+	vector<uchar> status, back_status;
+	vector<float> err;
+	calcOpticalFlowPyrLK(motion.old_pyramid,motion.new_pyramid,old_points,new_points,status,err,C_LK_WINSIZE,C_LK_LEVELS,criteria);
+	calcOpticalFlowPyrLK(motion.new_pyramid,motion.old_pyramid,new_points,returned_points,back_status,err,C_LK_WINSIZE,C_LK_LEVELS,criteria);
+
+	vector<bool> good(old_points.size());
+	vector<float> good_dx, good_dy;
+	for(unsigned p = 0; p < old_points.size(); ++p)
+	{
+		const Point2f fb_diff = returned_points[p] - old_points[p];
+		good[p] = status[p] && back_status[p] && (std::hypot(fb_diff.x,fb_diff.y) < C_LK_MAX_FB_ERROR);
+		if(good[p])
+		{
+			good_dx.emplace_back(new_points[p].x - old_points[p].x);
+			good_dy.emplace_back(new_points[p].y - old_points[p].y);
+		}
+	}
+
+	// Fall back to the median motion of the successfully tracked points
+	Point2f fallback_offset(0.0,0.0);
+	if(!good_dx.empty())
+	{
+		nth_element(good_dx.begin(),good_dx.begin()+good_dx.size()/2,good_dx.end());
+		nth_element(good_dy.begin(),good_dy.begin()+good_dy.size()/2,good_dy.end());
+		fallback_offset = Point2f(good_dx[good_dx.size()/2],good_dy[good_dy.size()/2]);
+	}
+	for(unsigned p = 0; p < old_points.size(); ++p)
+		if(!good[p])
+			new_points[p] = old_points[p] + fallback_offset;
+}
+
+
+void predictMotion(const framePairMotion_t& motion, const vector<Point2f>& old_points, vector<Point2f>& new_points)
+{
+	if(old_points.empty() || (motion.mode == mpOff))
+	{
+		new_points = old_points;
+		return;
+	}
+
+	Size image_size;
+	if(motion.mode == mpDense)
+	{
+		predictMotionDense(motion,old_points,new_points);
+		image_size = motion.flow.size();
+	}
+	else
+	{
+		predictMotionSparse(motion,old_points,new_points);
+		image_size = motion.new_pyramid[0].size();
+	}
+
+	for(Point2f& p : new_points)
+	{
+		p.x = std::min(std::max(p.x,0.0f),float(image_size.width-1));
+		p.y = std::min(std::max(p.y,0.0f),float(image_size.height-1));
+	}
+}
+
+
+void predictMotion(const Mat& oldim, const Mat& newim, const vector<Point2f>& old_points, const motionPrediction_t mode, vector<Point2f>& new_points)
+{
+	framePairMotion_t motion;
+	if(!old_points.empty())
+		prepareMotion(oldim,newim,mode,motion);
+	predictMotion(motion,old_points,new_points);
+}
+
+
+
+// Move the quadrants of a spectrum so that the zero frequency is in the centre
+static void swapQuadrants(Mat& image)
+{
+	const int cx = image.cols/2, cy = image.rows/2;
+	Mat q0(image,Rect(0,0,cx,cy)), q1(image,Rect(cx,0,cx,cy)), q2(image,Rect(0,cy,cx,cy)), q3(image,Rect(cx,cy,cx,cy));
+	Mat temp;
+	q0.copyTo(temp);
+	q3.copyTo(q0);
+	temp.copyTo(q3);
+	q1.copyTo(temp);
+	q2.copyTo(q1);
+	temp.copyTo(q2);
+}
+
+
+// Log-polar transform of the magnitude spectrum of a patch. A rotation of the patch
+// shifts this along the angle (vertical) axis, whatever the translation of the patch
+static void logPolarSpectrum(const Mat& patch, const Mat& window, Mat& polar)
+{
+	Mat spectrum, planes[2], magnitude_im;
+	dft(patch.mul(window),spectrum,DFT_COMPLEX_OUTPUT);
+	split(spectrum,planes);
+	magnitude(planes[0],planes[1],magnitude_im);
+	log(magnitude_im + Scalar::all(1.0),magnitude_im);
+	swapQuadrants(magnitude_im);
+	const float half = magnitude_im.cols/2;
+	warpPolar(magnitude_im,polar,magnitude_im.size(),Point2f(half,half),half,INTER_LINEAR+WARP_POLAR_LOG);
+}
+
+
+// Rotate a patch about its centre, then translate it
+static void moveRigidly(const Mat& patch, const float rotation, const Point2f& translation, Mat& moved)
+{
+	Mat transform = getRotationMatrix2D(Point2f(0.5*(patch.cols-1),0.5*(patch.rows-1)),rotation,1.0);
+	transform.at<double>(0,2) += translation.x;
+	transform.at<double>(1,2) += translation.y;
+	warpAffine(patch,moved,transform,patch.size(),INTER_LINEAR,BORDER_REPLICATE);
+}
+
+
+// Correlation coefficient of two patches within a mask
+static float maskedCorrelation(const Mat& a, const Mat& b, const Mat& mask)
+{
+	Scalar mean_a, std_a, mean_b, std_b;
+	meanStdDev(a,mean_a,std_a,mask);
+	meanStdDev(b,mean_b,std_b,mask);
+	if( (std_a[0] <= 0.0) || (std_b[0] <= 0.0) )
+		return 0.0;
+	const Mat product = (a - mean_a).mul(b - mean_b);
+	return mean(product,mask)[0]/(std_a[0]*std_b[0]);
+}
+
+
+bool predictRigidMotion(const Mat& oldim, const Mat& newim, const Point2f& centre, const float radius, rigidMotion_t& motion)
+{
+	TraceSpan span("rigid_motion");
+	motion.translation = Point2f(0.0,0.0);
+	motion.rotation = 0.0;
+
+	// Square patches around the heart (of even size for the spectra), shrunk if large
+	const int size = 2*max(int(std::ceil(radius)),4);
+	const int patch_size = min(size,C_RIGID_MAX_PATCH);
+	const float shrink = float(size)/float(patch_size);
+	Mat old_patch, new_patch;
+	for(Mat* patch : {&old_patch,&new_patch})
+	{
+		Mat crop;
+		getRectSubPix( (patch == &old_patch) ? oldim : newim,Size(size,size),centre,crop);
+		if(patch_size != size)
+			resize(crop,crop,Size(patch_size,patch_size),0,0,INTER_AREA);
+		crop.convertTo(*patch,CV_32F);
+	}
+
+	Mat window, mask = Mat::zeros(old_patch.size(),CV_8UC1);
+	createHanningWindow(window,old_patch.size(),CV_32F);
+	circle(mask,Point(patch_size/2,patch_size/2),int(C_RIGID_SCORE_RADIUS*patch_size/2),Scalar(255),-1);
+
+	// The rotation, which the spectra only give up to its direction and a half turn
+	Mat old_polar, new_polar;
+	logPolarSpectrum(old_patch,window,old_polar);
+	logPolarSpectrum(new_patch,window,new_polar);
+	const float angle = phaseCorrelate(old_polar,new_polar).y*360.0/old_polar.rows;
+
+	// Try each possible rotation with the translation found for it, keeping whichever
+	// best matches the new patch
+	motion.score = maskedCorrelation(old_patch,new_patch,mask);
+	bool found = false;
+	Mat moved;
+	for(const float rotation : {angle,-angle,angle+180.0f,180.0f-angle})
+	{
+		moveRigidly(old_patch,rotation,Point2f(0.0,0.0),moved);
+		const Point2d shift = phaseCorrelate(moved,new_patch,window);
+		for(const float sign : {1.0f,-1.0f})
+		{
+			const Point2f translation(sign*shift.x,sign*shift.y);
+			moveRigidly(old_patch,rotation,translation,moved);
+			const float score = maskedCorrelation(moved,new_patch,mask);
+			if(score > motion.score)
+			{
+				motion.score = score;
+				motion.rotation = std::remainder(rotation,360.0f);
+				motion.translation = translation*shrink;
+				found = true;
+			}
+		}
+	}
+
+	return found;
+}
+
+} // end of namespace
@@ -0,0 +1,74 @@
+#ifndef MOTIONPREDICTION_H
+#define MOTIONPREDICTION_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <string>
+
+namespace thesisUtilities
+{
+	// Methods for predicting where annotated points have moved to between frames
+	enum motionPrediction_t : unsigned char
+	{
+		mpOff = 0,
+		mpDense,   // dense optical flow (Farneback) over the whole frame
+		mpSparse   // pyramidal Lucas-Kanade tracking of the annotated points only
+	};
+
+	std::string motionPredictionName(const motionPrediction_t mode);
+	bool parseMotionPrediction(const std::string& name, motionPrediction_t& mode);
+
+	// The parts of a motion prediction between a pair of frames that do not depend
+	// on the points being predicted: the dense flow field, or the image pyramids used
+	// for sparse tracking. These are by far the most expensive parts to compute
+	struct framePairMotion_t
+	{
+		motionPrediction_t mode;
+		cv::Mat_<cv::Vec2f> flow;
+		std::vector<cv::Mat> old_pyramid, new_pyramid;
+		framePairMotion_t() : mode(mpOff) {}
+	};
+
+	// A description of the parameters used to calculate dense optical flow, so that
+	// stored flow fields can be recognised as out of date if they change
+	std::string denseFlowParameters();
+
+	// Prepare to predict motion from oldim to newim (both single channel 8-bit
+	// images of the same size)
+	void prepareMotion(const cv::Mat& oldim, const cv::Mat& newim, const motionPrediction_t mode, framePairMotion_t& motion);
+
+	// Predict the positions of points from the first image of a prepared pair in
+	// the second. Points that leave the image are clamped to its edge.
+	//
+	// In sparse mode, each point is tracked forward and then backward again, and the
+	// track is rejected if it fails, or if it does not return close to where it
+	// started. Rejected points are moved by the median displacement of the points
+	// that were tracked successfully, or left where they are if there are none.
+	void predictMotion(const framePairMotion_t& motion, const std::vector<cv::Point2f>& old_points, std::vector<cv::Point2f>& new_points);
+
+	// Prepare and predict in one step
+	void predictMotion(const cv::Mat& oldim, const cv::Mat& newim, const std::vector<cv::Point2f>& old_points,
+	                   const motionPrediction_t mode, std::vector<cv::Point2f>& new_points);
+
+	// The rigid motion of the heart between two frames: the translation of its centre
+	// and a rotation about it (in degrees anticlockwise, as for orientations)
+	struct rigidMotion_t
+	{
+		cv::Point2f translation;
+		float rotation;
+		float score; // correlation between the moved old image and the new image within the circle
+	};
+
+	// Estimate the rigid motion of the heart circle with the given centre and radius
+	// from oldim to newim (both single channel 8-bit images of the same size).
+	//
+	// The rotation is found by phase correlation of the log-polar transforms of the
+	// magnitude spectra, which do not depend on the translation, and then the
+	// translation by phase correlation of the rotated patch. Large hearts are shrunk
+	// first so that this takes a few milliseconds. Returns false (with no motion) if
+	// no motion matches the new image better than leaving the heart where it is
+	bool predictRigidMotion(const cv::Mat& oldim, const cv::Mat& newim, const cv::Point2f& centre, const float radius, rigidMotion_t& motion);
+}
+
+// inclusion guard
+#endif
@@ -0,0 +1,139 @@
+#include "motionPrefetcher.h"
+
+using namespace std;
+using namespace cv;
+
+namespace thesisUtilities
+{
+
+MotionPrefetcher::MotionPrefetcher(FrameStore& frame_store)
+: frame_store(frame_store), flow_cache(nullptr), requested{-1,-1,mpOff}, request_generation(0), result_generation(0),
+  result_transition{-1,-1,mpOff}, result_valid(false), n_hits(0), n_misses(0), stop_flag(false)
+{
+	worker = thread(&MotionPrefetcher::workLoop,this);
+}
+
+
+MotionPrefetcher::~MotionPrefetcher()
+{
+	{
+		lock_guard<mutex> lk(mtx);
+		stop_flag = true;
+	}
+	request_cv.notify_all();
+	result_cv.notify_all();
+	worker.join();
+}
+
+
+void MotionPrefetcher::setFlowCache(FlowCache* flow_cache)
+{
+	lock_guard<mutex> lk(mtx);
+	this->flow_cache = flow_cache;
+}
+
+
+void MotionPrefetcher::request(const int from_f, const int to_f, const motionPrediction_t mode)
+{
+	const transition_t transition{from_f,to_f,mode};
+	lock_guard<mutex> lk(mtx);
+	if(requested == transition)
+		return;
+	requested = transition;
+	++request_generation;
+	request_cv.notify_one();
+}
+
+
+bool MotionPrefetcher::obtain(const int from_f, const int to_f, const motionPrediction_t mode, framePairMotion_t& motion)
+{
+	const transition_t transition{from_f,to_f,mode};
+	unique_lock<mutex> lk(mtx);
+
+	// Wait for the calculation if it is the one in progress
+	if(requested == transition)
+		result_cv.wait(lk,[this]{return (result_generation == request_generation) || stop_flag;});
+
+	if(result_valid && (result_transition == transition))
+	{
+		++n_hits;
+		motion = std::move(result);
+		result_valid = false;
+		return true;
+	}
+	++n_misses;
+	lk.unlock();
+	return prepare(transition,motion);
+}
+
+
+int MotionPrefetcher::hitCount() const
+{
+	lock_guard<mutex> lk(mtx);
+	return n_hits;
+}
+
+
+int MotionPrefetcher::missCount() const
+{
+	lock_guard<mutex> lk(mtx);
+	return n_misses;
+}
+
+
+// Prepare the motion for a transition in the calling thread
+bool MotionPrefetcher::prepare(const transition_t& transition, framePairMotion_t& motion)
+{
+	motion = framePairMotion_t();
+	if(transition.mode == mpOff)
+		return false;
+
+	if( (transition.mode == mpDense) && (flow_cache != nullptr) && flow_cache->load(transition.from_f,transition.to_f,motion.flow) )
+	{
+		motion.mode = mpDense;
+		return true;
+	}
+
+	Mat old_frame, new_frame, oldim, newim;
+	if(!frame_store.peekFrame(transition.from_f,old_frame) || !frame_store.peekFrame(transition.to_f,new_frame))
+		return false;
+	frameToGrayscale(old_frame,oldim);
+	frameToGrayscale(new_frame,newim);
+	prepareMotion(oldim,newim,transition.mode,motion);
+
+	if( (transition.mode == mpDense) && (flow_cache != nullptr) )
+		flow_cache->store(transition.from_f,transition.to_f,motion.flow);
+	return true;
+}
+
+
+void MotionPrefetcher::workLoop()
+{
+	unique_lock<mutex> lk(mtx);
+	while(true)
+	{
+		request_cv.wait(lk,[this]{return (result_generation != request_generation) || stop_flag;});
+		if(stop_flag)
+			return;
+
+		const transition_t transition = requested;
+		const unsigned long long generation = request_generation;
+		lk.unlock();
+
+		framePairMotion_t motion;
+		const bool success = prepare(transition,motion);
+
+		lk.lock();
+		// Discard the result if it was superseded while calculating it
+		if(generation == request_generation)
+		{
+			result_transition = transition;
+			result_valid = success;
+			result = std::move(motion);
+			result_generation = generation;
+			result_cv.notify_all();
+		}
+	}
+}
+
+} // end of namespace
@@ -0,0 +1,82 @@
+#ifndef MOTIONPREFETCHER_H
+#define MOTIONPREFETCHER_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "motionPrediction.h"
+#include "frameStore.h"
+#include "flowCache.h"
+
+namespace thesisUtilities
+{
+	// Prepares the motion prediction for a frame transition on a background thread,
+	// so that it is ready (or at least under way) by the time it is needed. This is
+	// intended to be used for the transition that the user is most likely to make
+	// next while they are still busy with the current frame.
+	//
+	// Only one transition is prepared at a time. A new request supersedes the
+	// previous one, and the result of a superseded request is discarded when its
+	// calculation finishes (an optical flow calculation cannot be interrupted).
+	//
+	// If a flow cache is provided, dense flow fields are retrieved from it when
+	// possible, and any that have to be calculated are added to it
+	class MotionPrefetcher
+	{
+		public:
+			explicit MotionPrefetcher(FrameStore& frame_store);
+			~MotionPrefetcher();
+
+			// Use a cache of dense flow fields (may be null), must be called before any requests
+			void setFlowCache(FlowCache* flow_cache);
+
+			// Start preparing the motion from frame from_f to frame to_f in the background
+			void request(const int from_f, const int to_f, const motionPrediction_t mode);
+
+			// Retrieve the prepared motion for a transition. If it was requested and
+			// is still being calculated, this waits for the calculation to finish,
+			// otherwise it is prepared now. Returns false if the frames could not be read
+			bool obtain(const int from_f, const int to_f, const motionPrediction_t mode, framePairMotion_t& motion);
+
+			// Number of calls to obtain that were and were not served by a prefetched result
+			int hitCount() const;
+			int missCount() const;
+
+		private:
+			struct transition_t
+			{
+				int from_f, to_f;
+				motionPrediction_t mode;
+				bool operator==(const transition_t& other) const
+				{
+					return (from_f == other.from_f) && (to_f == other.to_f) && (mode == other.mode);
+				}
+			};
+
+			bool prepare(const transition_t& transition, framePairMotion_t& motion);
+			void workLoop();
+
+			FrameStore& frame_store;
+			FlowCache* flow_cache;
+
+			// The most recent request, and a count of requests made so that the worker
+			// can tell whether its result is still wanted
+			transition_t requested;
+			unsigned long long request_generation, result_generation;
+
+			// The most recent result
+			transition_t result_transition;
+			bool result_valid;
+			framePairMotion_t result;
+
+			int n_hits, n_misses;
+			bool stop_flag;
+			std::thread worker;
+			mutable std::mutex mtx;
+			std::condition_variable request_cv, result_cv;
+	};
+
+}
+
+// inclusion guard
+#endif
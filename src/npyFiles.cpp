@@ -0,0 +1,106 @@
+#include "npyFiles.h"
+#include <sstream>
+#include <algorithm>
+
+// Header layout of the .npy format
+#define NPY_MAGIC "\x93NUMPY"
+#define NPY_MAGIC_BYTES 6
+#define NPY_PREAMBLE_BYTES 10
+#define NPY_ALIGNMENT 64
+
+using namespace std;
+
+namespace thesisUtilities
+{
+
+// The whole header of a .npy file, padded to at least min_bytes and so that the
+// data are aligned. Returns an empty string if the header is too long
+static string npyHeader(const char* descr, const vector<size_t>& shape, const size_t min_bytes)
+{
+	// The shape is a Python tuple, which needs a trailing comma if it has one element
+	stringstream dict;
+	dict << "{'descr': '" << descr << "', 'fortran_order': False, 'shape': (";
+	for(size_t d = 0; d < shape.size(); ++d)
+		dict << shape[d] << ( (shape.size() == 1) ? "," : (d+1 < shape.size()) ? ", " : "" );
+	dict << "), }";
+
+	// Pad with spaces and end with a newline
+	string dict_str = dict.str();
+	const size_t total_bytes = (max(NPY_PREAMBLE_BYTES + dict_str.size() + 1,min_bytes) + NPY_ALIGNMENT - 1)/NPY_ALIGNMENT*NPY_ALIGNMENT;
+	dict_str.append(total_bytes - NPY_PREAMBLE_BYTES - dict_str.size() - 1,' ');
+	dict_str += '\n';
+	if(dict_str.size() > 0xffff)
+		return string();
+
+	string header(NPY_MAGIC,NPY_MAGIC_BYTES);
+	header += char(1); // version 1.0
+	header += char(0);
+	header += char(dict_str.size() & 0xff);
+	header += char(dict_str.size() >> 8);
+	return header + dict_str;
+}
+
+
+bool writeNpyFile(const string& filename, const char* descr, const vector<size_t>& shape, const void* data, const size_t element_bytes)
+{
+	size_t n_elements = 1;
+	for(const size_t d : shape)
+		n_elements *= d;
+
+	const string header = npyHeader(descr,shape,0);
+	if(header.empty())
+		return false;
+
+	ofstream outfile(filename.c_str(),ios::binary|ios::trunc);
+	if(!outfile.is_open())
+		return false;
+	outfile.write(header.data(),header.size());
+	outfile.write(static_cast<const char*>(data),n_elements*element_bytes);
+	return outfile.good();
+}
+
+
+bool NpyFileWriter::open(const string& filename, const char* descr, const vector<size_t>& item_shape, const size_t max_items, const size_t item_bytes)
+{
+	this->descr = descr;
+	this->item_shape = item_shape;
+	this->item_bytes = item_bytes;
+	n_items = 0;
+
+	vector<size_t> shape(1,max_items);
+	shape.insert(shape.end(),item_shape.begin(),item_shape.end());
+	const string header = npyHeader(descr,shape,0);
+	header_bytes = header.size();
+	if(header.empty())
+		return false;
+
+	outfile.open(filename.c_str(),ios::binary|ios::trunc);
+	outfile.write(header.data(),header.size());
+	return outfile.good();
+}
+
+
+bool NpyFileWriter::write(const void* data, const size_t n)
+{
+	outfile.write(static_cast<const char*>(data),n*item_bytes);
+	n_items += n;
+	return outfile.good();
+}
+
+
+bool NpyFileWriter::close()
+{
+	// The header for the actual number of items is no longer than the one written
+	// for the maximum, so it is padded to the same length
+	vector<size_t> shape(1,n_items);
+	shape.insert(shape.end(),item_shape.begin(),item_shape.end());
+	const string header = npyHeader(descr.c_str(),shape,header_bytes);
+	if(header.size() != header_bytes)
+		return false;
+	outfile.seekp(0);
+	outfile.write(header.data(),header.size());
+	outfile.close();
+	return !outfile.fail();
+}
+
+} // end of namespace
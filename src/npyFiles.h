@@ -0,0 +1,63 @@
+#ifndef NPYFILES_H
+#define NPYFILES_H
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "trackContainers.h"
+
+namespace thesisUtilities
+{
+	// Writing arrays in NumPy's .npy format (version 1.0), so that they can be loaded
+	// in Python with np.load(filename,mmap_mode='r') without any parsing.
+	//
+	// A file is the magic string "\x93NUMPY", the version (1,0), a little-endian uint16
+	// header length and a header giving the type, order and shape as a Python dict
+	// literal, padded with spaces so that the data start on a 64-byte boundary. The
+	// data follow in C order, in the byte order of the machine that wrote them.
+
+	// NumPy type strings of the types used in the track containers
+	inline const char* npyDescr(const uint8_t*) {return "|u1";}
+	inline const char* npyDescr(const heartPresent_t*) {return "|u1";}
+	inline const char* npyDescr(const int16_t*) {return "<i2";}
+	inline const char* npyDescr(const int32_t*) {return "<i4";}
+	inline const char* npyDescr(const float*) {return "<f4";}
+
+	// Write an array of the given shape, whose elements are of the type described by descr
+	bool writeNpyFile(const std::string& filename, const char* descr, const std::vector<size_t>& shape, const void* data, const size_t element_bytes);
+
+	template<typename T>
+	bool writeNpyFile(const std::string& filename, const std::vector<size_t>& shape, const T* data)
+	{
+		return writeNpyFile(filename,npyDescr(data),shape,data,sizeof(T));
+	}
+
+	// Writes an array one item (a slice along the first dimension) at a time, for
+	// arrays too large to hold in memory. The number of items need not be known in
+	// advance, only an upper bound, as the header is rewritten when the file is closed
+	class NpyFileWriter
+	{
+		public:
+			// Start a file of up to max_items items, each of the given shape and size in bytes
+			bool open(const std::string& filename, const char* descr, const std::vector<size_t>& item_shape, const size_t max_items, const size_t item_bytes);
+
+			// Append n items
+			bool write(const void* data, const size_t n = 1);
+
+			// Record the number of items written in the header and close the file
+			bool close();
+
+			size_t itemCount() const {return n_items;}
+
+		private:
+			std::ofstream outfile;
+			std::string descr;
+			std::vector<size_t> item_shape;
+			size_t item_bytes, n_items, header_bytes;
+	};
+}
+
+// inclusion guard
+#endif
@@ -12,6 +12,7 @@
 #define A_KEY 97
 #define C_KEY 99
 #define D_KEY 100
+#define E_KEY 101
 #define H_KEY 104
 #define M_KEY 109
 #define O_KEY 111
@@ -19,6 +20,7 @@
 #define Q_KEY 113
 #define R_KEY 114
 #define S_KEY 115
+#define Y_KEY 121
 #define Z_KEY 122
 #define SHIFT_A_KEY 65601
 #define SHIFT_C_KEY 65603
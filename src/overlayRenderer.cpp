@@ -0,0 +1,85 @@
+#include "overlayRenderer.h"
+#include "frameStore.h"
+
+using namespace std;
+using namespace cv;
+
+namespace thesisUtilities
+{
+
+OverlayRenderer::OverlayRenderer()
+: full_repaint(true)
+{
+}
+
+
+void OverlayRenderer::setBase(const Mat& frame)
+{
+	frameToColour(frame,base);
+	full_repaint = true;
+	dirty.clear();
+}
+
+
+void OverlayRenderer::clearElement(const size_t id)
+{
+	if(id >= elements.size() || (elements[id].type == nullptr) )
+		return;
+	markDirty(elements[id].bounds);
+	elements[id] = element_t();
+}
+
+
+const Mat& OverlayRenderer::render()
+{
+	if(full_repaint)
+	{
+		base.copyTo(canvas);
+		for(element_t& element : elements)
+			if(element.type != nullptr)
+				element.draw(canvas,Point(0,0));
+		full_repaint = false;
+		dirty.clear();
+		return canvas;
+	}
+
+	// Merge overlapping dirty regions so that nothing is drawn twice
+	for(size_t i = 0; i < dirty.size(); ++i)
+	{
+		for(size_t j = i+1; j < dirty.size(); )
+		{
+			if((dirty[i] & dirty[j]).area() > 0)
+			{
+				dirty[i] |= dirty[j];
+				dirty.erase(dirty.begin()+j);
+				j = i+1;
+			}
+			else
+				++j;
+		}
+	}
+
+	// Restore each dirty region from the clean frame and redraw the elements that
+	// overlap it, clipped to the region
+	for(const Rect& region : dirty)
+	{
+		Mat patch = canvas(region);
+		base(region).copyTo(patch);
+		for(element_t& element : elements)
+			if( (element.type != nullptr) && ((element.bounds & region).area() > 0) )
+				element.draw(patch,region.tl());
+	}
+	dirty.clear();
+
+	return canvas;
+}
+
+
+void OverlayRenderer::markDirty(const Rect& region)
+{
+	const Rect clipped = region & Rect(0,0,base.cols,base.rows);
+	if(clipped.area() > 0)
+		dirty.emplace_back(clipped);
+}
+
+} // end of namespace
@@ -0,0 +1,85 @@
+#ifndef OVERLAYRENDERER_H
+#define OVERLAYRENDERER_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <typeinfo>
+
+namespace thesisUtilities
+{
+	// Maintains a display image consisting of a video frame with a list of overlay
+	// elements drawn over it. When elements change, only the regions of the image
+	// that they cover (before and after the change) are restored from a clean copy
+	// of the frame and redrawn, rather than copying and redrawing the whole image.
+	//
+	// Elements are identified by their position in the drawing order and may be of
+	// any type T for which the following are defined (see annotationOverlays.h):
+	//   void drawOverlay(cv::Mat& img, const T& overlay, const cv::Point& offset)
+	//   cv::Rect overlayBounds(const T& overlay)
+	//   bool operator==(const T& a, const T& b)
+	class OverlayRenderer
+	{
+		public:
+			OverlayRenderer();
+
+			// Use a new frame as the background, everything will be redrawn
+			void setBase(const cv::Mat& frame);
+
+			// Set the element at a given position in the drawing order. Nothing needs
+			// to be redrawn if the element is unchanged
+			template<typename T>
+			void setElement(const size_t id, const T& overlay);
+
+			// Remove the element at a given position in the drawing order
+			void clearElement(const size_t id);
+
+			// Bring the display image up to date and return it
+			const cv::Mat& render();
+
+		private:
+			struct element_t
+			{
+				cv::Rect bounds;
+				const std::type_info* type;
+				std::shared_ptr<const void> overlay;
+				std::function<void(cv::Mat&,const cv::Point&)> draw;
+				element_t() : type(nullptr) {}
+			};
+
+			void markDirty(const cv::Rect& region);
+
+			cv::Mat base, canvas;
+			std::vector<element_t> elements;
+			std::vector<cv::Rect> dirty;
+			bool full_repaint;
+	};
+
+
+	template<typename T>
+	void OverlayRenderer::setElement(const size_t id, const T& overlay)
+	{
+		if(id >= elements.size())
+			elements.resize(id+1);
+		element_t& element = elements[id];
+
+		// Nothing to do if the element has not changed
+		if( (element.type != nullptr) && (*element.type == typeid(T)) && (*static_cast<const T*>(element.overlay.get()) == overlay) )
+			return;
+
+		markDirty(element.bounds);
+
+		std::shared_ptr<const T> stored = std::make_shared<const T>(overlay);
+		element.bounds = overlayBounds(overlay);
+		element.type = &typeid(T);
+		element.overlay = stored;
+		element.draw = [stored](cv::Mat& img, const cv::Point& offset) {drawOverlay(img,*stored,offset);};
+
+		markDirty(element.bounds);
+	}
+
+}
+
+// inclusion guard
+#endif
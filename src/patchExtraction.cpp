@@ -0,0 +1,100 @@
+#include "patchExtraction.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <cmath>
+#include <thread>
+#include "boundedQueue.h"
+
+// Number of decoded frames that may wait to be cropped
+#define PATCH_QUEUE_FRAMES 8
+
+using namespace std;
+using namespace cv;
+
+namespace thesisUtilities
+{
+
+Mat patchTransform(const int centrex, const int centrey, const int ori, const int radius, const bool headup, const patchOptions_t& options)
+{
+	const double theta = ori*M_PI/180.0;
+	const double half = 0.5*(options.patch_size - 1);
+	const double k = options.scale*max(radius,1)/(0.5*options.patch_size);
+
+	// Image directions of the patch's up and right (the image y axis points down)
+	const double upx = std::cos(theta), upy = -std::sin(theta);
+	const double rightx = headup ? -std::sin(theta) : std::sin(theta);
+	const double righty = headup ? -std::cos(theta) : std::cos(theta);
+
+	// Patch pixel (u,v) maps to centre + k*(u-half)*right - k*(v-half)*up
+	Mat transform = (Mat_<double>(2,3) <<
+		k*rightx, -k*upx, centrex - k*half*(rightx - upx),
+		k*righty, -k*upy, centrey - k*half*(righty - upy));
+	return transform;
+}
+
+
+void extractPatch(const Mat& gray, const int centrex, const int centrey, const int ori, const int radius, const bool headup,
+                  const patchOptions_t& options, Mat& patch)
+{
+	warpAffine(gray,patch,patchTransform(centrex,centrey,ori,radius,headup,options),Size(options.patch_size,options.patch_size),
+	           INTER_LINEAR|WARP_INVERSE_MAP,BORDER_CONSTANT,Scalar(0));
+}
+
+
+int extractVideoPatches(const string& video_filename, const HeartTrack& track, const bool headup, const int radius,
+                        const patchOptions_t& options, const patchSink_t& sink)
+{
+	VideoCapture cap(video_filename);
+	if(!cap.isOpened())
+		return -1;
+
+	const auto selected = [&](const int f) {return track.labelled()[f] && (!options.present_only || (track.present()[f] != hpNone));};
+
+	// The last frame that is needed, so decoding can stop there
+	int last_frame = -1;
+	for(int f = 0; f < track.frameCount(); ++f)
+		if(selected(f))
+			last_frame = f;
+
+	BoundedQueue<Mat> decoded(PATCH_QUEUE_FRAMES);
+
+	// Frames that are not needed are grabbed without being decoded into an image
+	thread decoder([&]
+	{
+		for(int f = 0; f <= last_frame; ++f)
+		{
+			Mat frame;
+			const bool needed = selected(f);
+			if(needed ? !cap.read(frame) : !cap.grab())
+				break;
+			if(needed && !decoded.push(frame))
+				break;
+		}
+		decoded.close();
+	});
+
+	int n_extracted = 0;
+	Mat frame, gray, patch;
+	for(int f = 0; f <= last_frame; ++f)
+	{
+		if(!selected(f))
+			continue;
+		if(!decoded.pop(frame))
+			break;
+
+		if(frame.channels() == 1)
+			gray = frame;
+		else
+			cvtColor(frame,gray,COLOR_BGR2GRAY);
+		extractPatch(gray,track.centrex()[f],track.centrey()[f],track.orientation()[f],radius,headup,options,patch);
+		if(!sink(f,patch))
+			break;
+		++n_extracted;
+	}
+	decoded.close();
+	decoder.join();
+
+	return n_extracted;
+}
+
+} // end of namespace
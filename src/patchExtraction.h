@@ -0,0 +1,46 @@
+#ifndef PATCHEXTRACTION_H
+#define PATCHEXTRACTION_H
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+#include <functional>
+#include "trackContainers.h"
+
+namespace thesisUtilities
+{
+	// Settings for cropping heart-aligned patches from the frames of a video
+	struct patchOptions_t
+	{
+		int patch_size; // width and height of the (square) patches in pixels
+		float scale; // half the width of a patch, as a multiple of the heart radius
+		bool present_only; // skip labelled frames in which the heart is not present
+		patchOptions_t() : patch_size(64), scale(1.2), present_only(false) {}
+	};
+
+	// Transform from the pixels of a patch to the pixels of a frame (for use with
+	// cv::warpAffine and WARP_INVERSE_MAP). The heart centre is at the centre of the
+	// patch, the heart's orientation points up, and the radius is patch_size/(2*scale)
+	// pixels. Frames viewed from the other direction (headup false) are mirrored, so
+	// that the fetus' left (marked 'L' by the annotation overlay) is always on the right
+	cv::Mat patchTransform(const int centrex, const int centrey, const int ori, const int radius, const bool headup, const patchOptions_t& options);
+
+	// Crop the patch for a frame with a given heart label from a grayscale frame.
+	// Parts of the patch outside the frame are black
+	void extractPatch(const cv::Mat& gray, const int centrex, const int centrey, const int ori, const int radius, const bool headup,
+	                  const patchOptions_t& options, cv::Mat& patch);
+
+	// Patches are passed to this as they are extracted, in order of frame, with the
+	// frame number. Returning false stops the extraction
+	typedef std::function<bool(const int f, const cv::Mat& patch)> patchSink_t;
+
+	// Extract the patches of all the labelled frames of a video (all those in which the
+	// heart is present, if options.present_only is set), decoding the video once. The
+	// video is decoded on a separate thread while the patches are cropped on the calling
+	// thread. Returns the number of patches extracted, or -1 if the video cannot be read
+	int extractVideoPatches(const std::string& video_filename, const HeartTrack& track, const bool headup, const int radius,
+	                        const patchOptions_t& options, const patchSink_t& sink);
+}
+
+// inclusion guard
+#endif
@@ -0,0 +1,284 @@
+#include "phaseSuggestion.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "thesisUtilities.h"
+#include "cardiacPhase.h"
+#include "frameStore.h"
+
+using namespace std;
+using namespace cv;
+
+namespace thesisUtilities
+{
+
+// Smallest autocorrelation (relative to the signal's variance) accepted as a heart beat
+const float C_MIN_CORRELATION = 0.1;
+
+// Window around one period after the previous end-diastole frame in which the next is looked for
+const float C_SEARCH_WINDOW_START = 0.7;
+const float C_SEARCH_WINDOW_END = 1.3;
+
+// Average of the signal over a centred window of 2*half_width+1 frames, or fewer at the ends
+static void movingAverage(const vector<float>& signal, const int half_width, vector<float>& average)
+{
+	const int n = signal.size();
+	vector<double> cumulative(n+1,0.0);
+	for(int i = 0; i < n; ++i)
+		cumulative[i+1] = cumulative[i] + signal[i];
+
+	average.resize(n);
+	for(int i = 0; i < n; ++i)
+	{
+		const int first = max(i-half_width,0), last = min(i+half_width+1,n);
+		average[i] = (cumulative[last] - cumulative[first])/(last - first);
+	}
+}
+
+
+// The centre of the heart circle used for each frame, or (-1,-1) for the centre of the image
+static void circleCentres(const HeartTrack& track, vector<Point>& centres)
+{
+	const int n_frames = track.frameCount();
+
+	// The labelled frame whose circle is used for each frame
+	vector<int> source(n_frames,-1);
+	for(int f = 0, last = -1; f < n_frames; ++f)
+	{
+		if(track.labelled()[f])
+			last = f;
+		source[f] = last;
+	}
+	for(int f = n_frames-1, next = -1; f >= 0; --f)
+	{
+		if(track.labelled()[f])
+			next = f;
+		if(source[f] < 0)
+			source[f] = next;
+	}
+
+	centres.resize(n_frames);
+	for(int f = 0; f < n_frames; ++f)
+		centres[f] = (source[f] < 0) ? Point(-1,-1) : Point(track.centrex()[source[f]],track.centrey()[source[f]]);
+}
+
+
+// Mean intensity inside circles with the given centres, read with a sequential pass over the video
+static bool readIntensitySignal(const string& video_filename, const vector<Point>& centres, const int radius, vector<float>& signal)
+{
+	signal.clear();
+	VideoCapture cap(video_filename);
+	if(!cap.isOpened())
+		return false;
+
+	const int r = max(radius,1);
+	Mat mask = Mat::zeros(2*r+1,2*r+1,CV_8UC1);
+	circle(mask,Point(r,r),r,Scalar(255),-1);
+
+	signal.reserve(centres.size());
+	Mat frame, gray;
+	for(const Point& centre : centres)
+	{
+		if(!cap.read(frame) || frame.empty())
+			break;
+		frameToGrayscale(frame,gray);
+
+		const Point corner = (centre.x < 0) ? Point(gray.cols/2-r,gray.rows/2-r) : Point(centre.x-r,centre.y-r);
+		const Rect roi = Rect(corner,mask.size()) & Rect(0,0,gray.cols,gray.rows);
+		if(roi.area() == 0)
+			signal.emplace_back(signal.empty() ? 0.0 : signal.back());
+		else
+			signal.emplace_back(mean(gray(roi),mask(roi - corner))[0]);
+	}
+
+	return !signal.empty();
+}
+
+
+bool heartIntensitySignal(const string& video_filename, const HeartTrack& track, const int radius, vector<float>& signal)
+{
+	vector<Point> centres;
+	circleCentres(track,centres);
+	return readIntensitySignal(video_filename,centres,radius,signal);
+}
+
+
+HeartSignalCache::HeartSignalCache()
+: cached_radius(0)
+{
+}
+
+
+bool HeartSignalCache::signal(const string& video_filename, const HeartTrack& track, const int radius, vector<float>& signal)
+{
+	vector<Point> centres;
+	circleCentres(track,centres);
+	if( cached_signal.empty() || (video_filename != cached_filename) || (radius != cached_radius) || (centres != cached_centres) )
+	{
+		if(!readIntensitySignal(video_filename,centres,radius,cached_signal))
+			return false;
+		cached_filename = video_filename;
+		cached_centres.swap(centres);
+		cached_radius = radius;
+	}
+	signal = cached_signal;
+	return true;
+}
+
+
+float dominantPeriod(const vector<float>& signal, const float frame_rate)
+{
+	const float min_frames_per_beat = 60.0*frame_rate/MAX_HEART_RATE;
+	const float max_frames_per_beat = 60.0*frame_rate/MIN_HEART_RATE;
+	const int first_lag = max(int(std::floor(min_frames_per_beat)),1);
+	const int last_lag = int(std::ceil(max_frames_per_beat));
+	const int n = signal.size();
+	if(n < 2*(last_lag+1))
+		return numeric_limits<float>::quiet_NaN();
+
+	// Remove changes that are slower than a heart beat, e.g. from gain or probe movement
+	vector<float> trend;
+	movingAverage(signal,last_lag/2,trend);
+	vector<float> x(n);
+	double variance = 0.0;
+	for(int i = 0; i < n; ++i)
+	{
+		x[i] = signal[i] - trend[i];
+		variance += x[i]*x[i];
+	}
+	variance /= n;
+	if(variance <= 0.0)
+		return numeric_limits<float>::quiet_NaN();
+
+	// Normalised autocorrelation at each plausible lag, and one either side
+	vector<float> correlation(last_lag+2,0.0);
+	for(int lag = first_lag-1; lag <= last_lag+1; ++lag)
+	{
+		double sum = 0.0;
+		for(int i = 0; i + lag < n; ++i)
+			sum += x[i]*x[i+lag];
+		correlation[lag] = sum/(n-lag)/variance;
+	}
+
+	// The strongest peak, refined to a fraction of a frame by fitting a parabola
+	int best_lag = -1;
+	for(int lag = first_lag; lag <= last_lag; ++lag)
+	{
+		if( (correlation[lag] >= correlation[lag-1]) && (correlation[lag] >= correlation[lag+1]) && (correlation[lag] > C_MIN_CORRELATION) &&
+		    ( (best_lag < 0) || (correlation[lag] > correlation[best_lag]) ) )
+			best_lag = lag;
+	}
+	if(best_lag < 0)
+		return numeric_limits<float>::quiet_NaN();
+
+	const float curvature = correlation[best_lag-1] - 2.0*correlation[best_lag] + correlation[best_lag+1];
+	const float offset = (curvature < 0.0) ? 0.5*(correlation[best_lag-1] - correlation[best_lag+1])/curvature : 0.0;
+	return best_lag + offset;
+}
+
+
+void suggestPhasePoints(const vector<float>& signal, const float period, vector<int>& systole, vector<int>& diastole)
+{
+	systole.clear();
+	diastole.clear();
+	const int n = signal.size();
+	if( (n < 3) || !(period > 1.0) )
+		return;
+
+	vector<float> smoothed;
+	movingAverage(signal,int(period/8.0),smoothed);
+	const auto is_minimum = [&](const int i) {return (i > 0) && (i < n-1) && (smoothed[i] <= smoothed[i-1]) && (smoothed[i] <= smoothed[i+1]);};
+	const auto is_maximum = [&](const int i) {return (i > 0) && (i < n-1) && (smoothed[i] >= smoothed[i-1]) && (smoothed[i] >= smoothed[i+1]);};
+
+	// End-diastole is the darkest frame of each beat, looked for around one period
+	// after the last one found
+	int first = 0, last = min(int(std::round(period)),n);
+	while(first < last)
+	{
+		const int ed = min_element(smoothed.cbegin()+first,smoothed.cbegin()+last) - smoothed.cbegin();
+		if(is_minimum(ed))
+			diastole.emplace_back(ed);
+		first = max(ed + int(std::round(C_SEARCH_WINDOW_START*period)),ed+1);
+		last = min(ed + int(std::round(C_SEARCH_WINDOW_END*period)) + 1,n);
+	}
+	if(diastole.empty())
+		return;
+
+	// End-systole is the brightest frame between each pair of end-diastole frames,
+	// and within a period before the first and after the last
+	const auto add_systole = [&](const int first, const int last)
+	{
+		if(first >= last)
+			return;
+		const int es = max_element(smoothed.cbegin()+first,smoothed.cbegin()+last) - smoothed.cbegin();
+		if(is_maximum(es))
+			systole.emplace_back(es);
+	};
+	add_systole(max(diastole.front()-int(std::round(period))+1,0),diastole.front());
+	for(size_t i = 1; i < diastole.size(); ++i)
+		add_systole(diastole[i-1]+1,diastole[i]);
+	add_systole(diastole.back()+1,min(diastole.back()+int(std::round(period)),n));
+}
+
+
+int addSuggestedPhasePoints(const vector<int>& systole, const vector<int>& diastole, const float period,
+                            const int n_frames, uint8_t* phase_point_track, int& n_removed)
+{
+	// The existing manual marks, index 0 for end-systole, 1 for end-diastole, and
+	// the earlier suggestions are removed
+	vector<int> manual[2];
+	n_removed = 0;
+	for(int f = 0; f < n_frames; ++f)
+	{
+		if( (phase_point_track[f] == SUGGESTED_SYSTOLE) || (phase_point_track[f] == SUGGESTED_DIASTOLE) )
+		{
+			phase_point_track[f] = NOT_LABELLED;
+			++n_removed;
+		}
+		else if(phase_point_track[f] == MANUALLY_LABELLED_SYSTOLE)
+			manual[0].emplace_back(f);
+		else if(phase_point_track[f] == MANUALLY_LABELLED_DIASTOLE)
+			manual[1].emplace_back(f);
+	}
+
+	const auto near_mark = [](const vector<int>& marks, const int f, const float distance)
+	{
+		const auto it = lower_bound(marks.cbegin(),marks.cend(),f);
+		return ( (it != marks.cend()) && (*it - f < distance) ) || ( (it != marks.cbegin()) && (f - *prev(it) < distance) );
+	};
+
+	int n_added = 0;
+	for(int c = 0; c < 2; ++c)
+	{
+		for(const int f : (c == 0) ? systole : diastole)
+		{
+			if( (f < 0) || (f >= n_frames) || (phase_point_track[f] == MANUALLY_LABELLED_SYSTOLE) || (phase_point_track[f] == MANUALLY_LABELLED_DIASTOLE) ||
+			    near_mark(manual[c],f,0.5*period) || near_mark(manual[1-c],f,0.25*period) )
+				continue;
+			phase_point_track[f] = (c == 0) ? SUGGESTED_SYSTOLE : SUGGESTED_DIASTOLE;
+			++n_added;
+		}
+	}
+	return n_added;
+}
+
+
+vector<int> acceptSuggestedPhasePoints(const int n_frames, uint8_t* phase_point_track)
+{
+	vector<int> accepted;
+	for(int f = 0; f < n_frames; ++f)
+	{
+		if(phase_point_track[f] == SUGGESTED_SYSTOLE)
+			phase_point_track[f] = MANUALLY_LABELLED_SYSTOLE;
+		else if(phase_point_track[f] == SUGGESTED_DIASTOLE)
+			phase_point_track[f] = MANUALLY_LABELLED_DIASTOLE;
+		else
+			continue;
+		accepted.emplace_back(f);
+	}
+	return accepted;
+}
+
+} // end of namespace
@@ -0,0 +1,70 @@
+#ifndef PHASESUGGESTION_H
+#define PHASESUGGESTION_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <opencv2/core/core.hpp>
+#include "trackContainers.h"
+
+namespace thesisUtilities
+{
+	// Suggestions for the end-systole and end-diastole frames, found from the video.
+	//
+	// The mean intensity inside the heart circle rises and falls with each beat, as
+	// the (dark) blood is pushed out of the ventricles towards end-systole and fills
+	// them again towards end-diastole. The dominant period of this signal within the
+	// range of plausible heart rates is found by autocorrelation, and then one minimum
+	// (end-diastole) and one maximum (end-systole) are picked per beat.
+
+	// Mean intensity inside the heart circle in every frame. Frames that have not been
+	// labelled use the circle of the nearest labelled frame before them (or after, or
+	// the centre of the image if there are none). The video is read from start to end
+	// with its own decoder, so the frames kept around the annotator are not disturbed.
+	// Returns false if no frame could be read
+	bool heartIntensitySignal(const std::string& video_filename, const HeartTrack& track, const int radius, std::vector<float>& signal);
+
+	// Keeps the intensity signal of a video for the rest of the session, so that the
+	// video is only read again once a heart circle has moved
+	class HeartSignalCache
+	{
+		public:
+			HeartSignalCache();
+
+			// The signal for the current heart circles, as heartIntensitySignal()
+			bool signal(const std::string& video_filename, const HeartTrack& track, const int radius, std::vector<float>& signal);
+
+		private:
+			std::string cached_filename;
+			std::vector<cv::Point> cached_centres;
+			int cached_radius;
+			std::vector<float> cached_signal;
+	};
+
+	// The period of the heart beat in the signal (in frames), or NaN if the signal
+	// is too short or does not repeat at a plausible heart rate
+	float dominantPeriod(const std::vector<float>& signal, const float frame_rate);
+
+	// Pick the end-systole and end-diastole frames, which alternate, from a signal with
+	// the given period
+	void suggestPhasePoints(const std::vector<float>& signal, const float period, std::vector<int>& systole, std::vector<int>& diastole);
+
+	// Add suggested frames to a phase point track as SUGGESTED_SYSTOLE and
+	// SUGGESTED_DIASTOLE marks, replacing any earlier suggestions. The cardiac phase
+	// is calculated from them like manual marks until they are accepted (becoming
+	// manual marks) or removed. Frames close to an existing manual mark (within half
+	// a period of a mark of the same kind or a quarter period of the other kind) are
+	// left alone, so marks made by the annotator always take precedence. n_frames
+	// should cover the whole track, so that no earlier suggestion is left behind.
+	// Returns the number of marks added, and the number of earlier suggestions
+	// removed in n_removed
+	int addSuggestedPhasePoints(const std::vector<int>& systole, const std::vector<int>& diastole, const float period,
+	                            const int n_frames, uint8_t* phase_point_track, int& n_removed);
+
+	// Turn the suggested marks of a phase point track into manual marks, which does
+	// not change the cardiac phase. Returns the frames that were accepted
+	std::vector<int> acceptSuggestedPhasePoints(const int n_frames, uint8_t* phase_point_track);
+}
+
+// inclusion guard
+#endif
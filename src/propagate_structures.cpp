@@ -0,0 +1,347 @@
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include "thesisUtilities.h"
+#include "motionPrediction.h"
+#include "boundedQueue.h"
+
+using namespace cv;
+using namespace std;
+namespace ut = thesisUtilities;
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+// Maximum number of frames that motion may be prepared ahead of the propagation
+#define C_LOOKAHEAD_PER_THREAD 4
+
+// A pair of consecutive frames whose motion needs to be prepared
+struct pairJob_t
+{
+	int f; // the later frame of the pair
+	Mat oldim, newim;
+};
+
+// Shared state between the threads working on one video
+struct propagationState_t
+{
+	mutex mtx;
+	condition_variable results_cv, window_cv;
+	map<int,ut::framePairMotion_t> results;
+	int next_f = 1; // the next frame the propagation needs
+	bool loader_done = false;
+	int n_decoded = 0;
+};
+
+// Find which frames structure labels will be propagated into by motion prediction,
+// following the same rules as interactive propagation: a label is carried into the
+// next frame if that frame is not already labelled and has the same view label.
+// Labels whose location lies outside the image are copied without prediction
+static vector<bool> findPredictedFrames(const ut::StructureTrack& track, const ut::HeartTrack& heart_track, const int xsize, const int ysize)
+{
+	const int n_frames = track.frameCount();
+	const int n_structures = track.structureCount();
+	const uint8_t* const view_label = heart_track.viewLabel();
+	vector<bool> needed(n_frames,false);
+
+	for(int s = 0; s < n_structures; ++s)
+	{
+		const uint8_t* const labelled = track.labelled(s);
+		const int16_t* const x = track.x(s);
+		const int16_t* const y = track.y(s);
+		bool reached = false, in_image = false;
+		for(int f = 0; f < n_frames; ++f)
+		{
+			if(labelled[f])
+			{
+				reached = true;
+				in_image = (x[f] >= 0) && (y[f] >= 0) && (x[f] < xsize) && (y[f] < ysize);
+			}
+			else if(reached && (f > 0) && (view_label[f] == view_label[f-1]))
+			{
+				if(in_image)
+					needed[f] = true;
+			}
+			else
+				reached = false;
+		}
+	}
+	return needed;
+}
+
+
+// Decode the video in order and queue up the frame pairs that need motion preparing,
+// staying within a window of frames ahead of the propagation
+static void loadFrames(VideoCapture& cap, const vector<bool>& needed, const int window, ut::BoundedQueue<pairJob_t>& queue, propagationState_t& state)
+{
+	const int n_frames = needed.size();
+	Mat previous_gray;
+	int f = 0;
+	for( ; f < n_frames; ++f)
+	{
+		Mat frame, gray;
+		cap >> frame;
+		if(frame.rows <= 0)
+			break;
+		if(frame.channels() == 1)
+			gray = frame.clone();
+		else
+			cvtColor(frame,gray,cv::COLOR_BGR2GRAY);
+
+		if(needed[f])
+		{
+			{
+				unique_lock<mutex> lk(state.mtx);
+				state.window_cv.wait(lk,[&]{return f - state.next_f <= window;});
+			}
+			queue.push(pairJob_t{f,previous_gray,gray});
+		}
+		previous_gray = gray;
+	}
+
+	queue.close();
+	lock_guard<mutex> lk(state.mtx);
+	state.loader_done = true;
+	state.n_decoded = f;
+	state.results_cv.notify_all();
+}
+
+
+// Propagate the labels through one video and write the result to the output directory
+static bool propagateVideo(const fs::path& vidname, const fs::path& trackdir, const fs::path& hearttrackdir, const fs::path& outdir,
+                           const vector<string>& structure_names, const vector<vector<int>>& views_per_structure,
+                           const ut::motionPrediction_t mode, const int n_threads)
+{
+	const auto start_time = chrono::steady_clock::now();
+
+	VideoCapture cap(vidname.string());
+	if(!cap.isOpened())
+	{
+		cerr << "ERROR: Could not open video " << vidname << endl;
+		return false;
+	}
+	const int xsize = cap.get(cv::CAP_PROP_FRAME_WIDTH);
+	const int ysize = cap.get(cv::CAP_PROP_FRAME_HEIGHT);
+	int n_frames = cap.get(cv::CAP_PROP_FRAME_COUNT);
+	const int n_structures = structure_names.size();
+
+	const fs::path trackfilename = trackdir / vidname.stem().replace_extension(".stk");
+	const fs::path hearttrackfilename = hearttrackdir / vidname.stem().replace_extension(".tk");
+	const fs::path outfilename = outdir / vidname.stem().replace_extension(".stk");
+
+	vector<string> file_structure_names;
+	ut::StructureTrack track;
+	if(!ut::readSubstructuresTrackFile(trackfilename.string(),n_frames,file_structure_names,track))
+	{
+		cerr << "ERROR: Could not read keyframes from " << trackfilename << endl;
+		return false;
+	}
+	if(file_structure_names != structure_names)
+	{
+		cerr << "ERROR: The structures in " << trackfilename << " do not match the structure list" << endl;
+		return false;
+	}
+
+	ut::HeartTrack heart_track;
+	if(!ut::readViewLabels(hearttrackfilename.string(),n_frames,heart_track))
+	{
+		cerr << "ERROR: Could not read heart track information from " << hearttrackfilename << endl;
+		return false;
+	}
+
+	// Start decoding frames and preparing the motion between them
+	const vector<bool> needed = findPredictedFrames(track,heart_track,xsize,ysize);
+	const int n_workers = max(n_threads-1,1);
+	propagationState_t state;
+	ut::BoundedQueue<pairJob_t> queue(n_workers);
+	thread loader(loadFrames,std::ref(cap),std::cref(needed),C_LOOKAHEAD_PER_THREAD*n_workers,std::ref(queue),std::ref(state));
+	vector<thread> workers;
+	for(int w = 0; w < n_workers; ++w)
+	{
+		workers.emplace_back([&queue,&state,mode]
+		{
+			pairJob_t job;
+			while(queue.pop(job))
+			{
+				ut::framePairMotion_t motion;
+				ut::prepareMotion(job.oldim,job.newim,mode,motion);
+				lock_guard<mutex> lk(state.mtx);
+				state.results[job.f] = std::move(motion);
+				state.results_cv.notify_all();
+			}
+		});
+	}
+
+	// Propagate the labels forward through the video, one frame at a time
+	int n_propagated = 0;
+	int f = 1;
+	for( ; f < n_frames; ++f)
+	{
+		vector<Point2f> old_points, predicted_points;
+		vector<int> predicted_index(n_structures,-1);
+		vector<int> propagate;
+		for(int s = 0; s < n_structures; ++s)
+		{
+			if(!track.labelled(s)[f] && track.labelled(s)[f-1] && (heart_track.viewLabel()[f] == heart_track.viewLabel()[f-1]) )
+			{
+				propagate.emplace_back(s);
+				const int16_t x = track.x(s)[f-1], y = track.y(s)[f-1];
+				if( (x >= 0) && (y >= 0) && (x < xsize) && (y < ysize) )
+				{
+					predicted_index[s] = old_points.size();
+					old_points.emplace_back(x,y);
+				}
+			}
+		}
+
+		// Wait for the motion between this frame and the last
+		ut::framePairMotion_t motion;
+		bool end_of_video = false;
+		{
+			unique_lock<mutex> lk(state.mtx);
+			if(needed[f])
+			{
+				state.results_cv.wait(lk,[&]{return (state.results.count(f) > 0) || (state.loader_done && f >= state.n_decoded);});
+				const auto it = state.results.find(f);
+				if(it != state.results.end())
+				{
+					motion = std::move(it->second);
+					state.results.erase(it);
+				}
+				else
+					end_of_video = true;
+			}
+			else if(state.loader_done && f >= state.n_decoded)
+				end_of_video = true;
+		}
+		if(end_of_video)
+			break;
+		ut::predictMotion(motion,old_points,predicted_points);
+
+		for(const int s : propagate)
+		{
+			ut::subStructLabel_t label = track.label(f-1,s);
+			if(predicted_index[s] >= 0)
+			{
+				label.x = std::round(predicted_points[predicted_index[s]].x);
+				label.y = std::round(predicted_points[predicted_index[s]].y);
+			}
+			track.setLabel(f,s,label);
+			++n_propagated;
+		}
+
+		lock_guard<mutex> lk(state.mtx);
+		state.next_f = f+1;
+		state.window_cv.notify_all();
+	}
+
+	{
+		lock_guard<mutex> lk(state.mtx);
+		state.next_f = n_frames;
+		state.window_cv.notify_all();
+	}
+	loader.join();
+	for(thread& t : workers)
+		t.join();
+
+	// The frame count reported by opencv is sometimes wrong
+	n_frames = min(n_frames,state.n_decoded);
+	track.resize(n_frames);
+
+	if(!ut::writeSubstructuresTrackFile(outfilename.string(),xsize,ysize,structure_names,views_per_structure,heart_track,track,true))
+	{
+		cerr << "ERROR: Could not write track file " << outfilename << endl;
+		return false;
+	}
+
+	const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+	cout << vidname.filename().string() << ": propagated " << n_propagated << " labels over " << n_frames << " frames in " << seconds << " s" << endl;
+	return true;
+}
+
+
+int main(int argc, char** argv)
+{
+	vector<fs::path> vidnames;
+	fs::path trackdir, hearttrackdir, outdir, structfilename;
+	string motion_prediction_str;
+	ut::motionPrediction_t motion_prediction;
+	int n_threads;
+
+	// Declare the supported options.
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help,h", "produce help message")
+		("video,v", po::value<vector<fs::path>>(&vidnames)->multitoken(), "input video file(s)")
+		("structure_file,s", po::value<fs::path>(&structfilename)->default_value("structures"), "file containing list of structures to annotate")
+		("trackdirectory,t", po::value<fs::path>(&trackdir)->default_value("."), "directory containing the input track files with labelled keyframes")
+		("hearttrackdirectory,d", po::value<fs::path>(&hearttrackdir)->default_value("."), "directory containing the relevant heart track files")
+		("outputdirectory,o", po::value<fs::path>(&outdir), "directory in which to write the propagated track files")
+		("motion-prediction,m", po::value<string>(&motion_prediction_str)->default_value("dense"), "method for predicting structure motion between frames: 'sparse', 'dense' or 'off'")
+		("threads,j", po::value<int>(&n_threads)->default_value(thread::hardware_concurrency()), "number of threads to use");
+
+	po::positional_options_description pos;
+	pos.add("video",-1);
+
+	po::variables_map vm;
+	po::store(po::command_line_parser(argc, argv).options(desc).positional(pos).run(), vm);
+	po::notify(vm);
+
+	if (vm.count("help"))
+	{
+		cout << "Propagates substructure labels from manually labelled keyframes through the rest of each video" << endl;
+		cout << desc << endl;
+		return 1;
+	}
+
+	if(vidnames.empty() || !vm.count("outputdirectory"))
+	{
+		cerr << "ERROR: At least one video and an output directory must be specified" << endl;
+		return EXIT_FAILURE;
+	}
+
+	// Do not overwrite the manually labelled keyframes
+	boost::system::error_code ec;
+	if(fs::exists(outdir) && fs::equivalent(outdir,trackdir,ec))
+	{
+		cerr << "ERROR: The output directory must be different from the track directory" << endl;
+		return EXIT_FAILURE;
+	}
+	fs::create_directories(outdir,ec);
+
+	if(!ut::parseMotionPrediction(motion_prediction_str,motion_prediction))
+	{
+		cerr << "ERROR: Unrecognised motion prediction option " << motion_prediction_str << endl;
+		return EXIT_FAILURE;
+	}
+
+	vector<string> structure_names;
+	vector<vector<int>> views_per_structure;
+	if(!ut::readStructureList(structfilename.string(),structure_names,views_per_structure))
+	{
+		cerr << "ERROR: Could not open structure file " << structfilename << endl;
+		return EXIT_FAILURE;
+	}
+
+	int n_failed = 0;
+	for(const fs::path& vidname : vidnames)
+		if(!propagateVideo(vidname,trackdir,hearttrackdir,outdir,structure_names,views_per_structure,motion_prediction,max(n_threads,1)))
+			++n_failed;
+
+	if(n_failed > 0)
+	{
+		cerr << n_failed << " of " << vidnames.size() << " videos could not be processed" << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include <boost/program_options.hpp>
+#include "thesisUtilities.h"
+#include "trackIndex.h"
+
+using namespace std;
+namespace ut = thesisUtilities;
+namespace po = boost::program_options;
+
+// Upper case copy of a string, leaving out dashes so that e.g. "4-cham" matches "4CHAM"
+static string normalisedName(const string& name)
+{
+	string normalised;
+	for(const char c : name)
+		if(c != '-')
+			normalised += toupper(static_cast<unsigned char>(c));
+	return normalised;
+}
+
+// The view number for a view name or number, or -1 if it is not recognised
+static int parseView(const string& view)
+{
+	const string name = normalisedName(view);
+	if(name == "BACKGROUND" || name == "0")
+		return 0;
+	else if(name == "4CHAM" || name == "1")
+		return VIEW_4CHAM;
+	else if(name == "LVOT" || name == "2")
+		return VIEW_LVOT;
+	else if(name == "3V" || name == "RVOT" || name == "3")
+		return VIEW_RVOT;
+	else if(name == "VSIGN" || name == "4")
+		return VIEW_VSIGN;
+	return -1;
+}
+
+int main(int argc, char** argv)
+{
+	string index_file, view_name, structure_name;
+	int min_frames;
+
+	// Declare the supported options.
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help,h", "produce help message")
+		("index,x", po::value<string>(&index_file), "index file created by index_tracks")
+		("view,w", po::value<string>(&view_name), "only count frames of this view (4CHAM, LVOT, 3V, VSIGN, or background)")
+		("structure,s", po::value<string>(&structure_name), "only count frames in which this structure is visible")
+		("minframes,n", po::value<int>(&min_frames)->default_value(1), "only list videos with at least this many matching frames")
+		("ranges,r", "list the matching frame ranges of each video");
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help") || index_file.empty())
+	{
+		cout << "Lists the videos in a track index with labelled frames matching a view and/or a visible structure" << endl;
+		cout << desc << endl;
+		return 1;
+	}
+
+	const int view = view_name.empty() ? -1 : parseView(view_name);
+	if(!view_name.empty() && (view < 0))
+	{
+		cerr << "ERROR: Unrecognised view " << view_name << endl;
+		return EXIT_FAILURE;
+	}
+	const bool show_ranges = vm.count("ranges") > 0;
+
+	ut::TrackIndex index;
+	if(!index.read(index_file))
+	{
+		cerr << "ERROR: Could not read the index file " << index_file << endl;
+		return EXIT_FAILURE;
+	}
+
+	int n_matched = 0;
+	long long n_matched_frames = 0;
+	for(const ut::indexedVideo_t& video : index.videos())
+	{
+		int count = 0;
+		vector<ut::frameRange_t> ranges;
+		if(structure_name.empty())
+		{
+			if(view < 0)
+			{
+				count = video.n_labelled;
+				for(int v = 0; v < INDEX_N_VIEWS; ++v)
+					ut::mergeFrameRanges(ranges,video.view_ranges[v],ranges);
+			}
+			else
+			{
+				count = video.n_view[view];
+				ranges = video.view_ranges[view];
+			}
+		}
+		else
+		{
+			const auto structure = find_if(video.structures.cbegin(),video.structures.cend(),
+			                               [&](const ut::indexedStructure_t& s) {return normalisedName(s.name) == normalisedName(structure_name);});
+			if(structure == video.structures.cend())
+				continue;
+			for(int v = 0; v < INDEX_N_VIEWS; ++v)
+			{
+				if( (view >= 0) && (v != view) )
+					continue;
+				count += structure->n_visible[v];
+				ut::mergeFrameRanges(ranges,structure->visible_ranges[v],ranges);
+			}
+		}
+
+		if( (count < min_frames) || (count == 0) )
+			continue;
+
+		++n_matched;
+		n_matched_frames += count;
+		cout << video.name << " " << count;
+		if(show_ranges)
+			for(const ut::frameRange_t& range : ranges)
+				cout << " " << range.first << "-" << range.second-1;
+		cout << endl;
+	}
+
+	cout << n_matched << " of " << index.videos().size() << " videos match (" << n_matched_frames << " frames)" << endl;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,95 @@
+#include "recordPipeline.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <cmath>
+#include <thread>
+#include "boundedQueue.h"
+
+// Number of frames that may wait between each pair of stages
+#define RECORD_QUEUE_FRAMES 4
+
+using namespace std;
+using namespace cv;
+
+namespace thesisUtilities
+{
+
+bool readVideoProperties(const string& filename, videoProperties_t& properties)
+{
+	VideoCapture cap(filename);
+	if(!cap.isOpened())
+		return false;
+
+	properties.xsize = cap.get(CAP_PROP_FRAME_WIDTH);
+	properties.ysize = cap.get(CAP_PROP_FRAME_HEIGHT);
+	properties.n_frames = cap.get(CAP_PROP_FRAME_COUNT);
+	properties.fourcc = static_cast<int>(cap.get(CAP_PROP_FOURCC));
+	properties.frame_rate = cap.get(CAP_PROP_FPS);
+	if(properties.frame_rate <= 0.0)
+		properties.frame_rate = nan("");
+	return true;
+}
+
+
+int recordLabelVideo(const string& video_filename, const videoLabels_t& labels, const string& output_filename, const int fourcc, const double frame_rate)
+{
+	VideoCapture cap(video_filename);
+	if(!cap.isOpened())
+		return -1;
+	const int xsize = cap.get(CAP_PROP_FRAME_WIDTH);
+	const int ysize = cap.get(CAP_PROP_FRAME_HEIGHT);
+	const int n_frames = cap.get(CAP_PROP_FRAME_COUNT);
+
+	VideoWriter output_video(output_filename,fourcc,frame_rate,Size(xsize,ysize),true);
+	if(!output_video.isOpened())
+		return -1;
+
+	BoundedQueue<Mat> decoded(RECORD_QUEUE_FRAMES), rendered(RECORD_QUEUE_FRAMES);
+
+	// Each frame is decoded into a new image, which is then drawn on in place
+	thread decoder([&]
+	{
+		while(true)
+		{
+			Mat frame;
+			if(!cap.read(frame) || !decoded.push(frame))
+				break;
+		}
+		decoded.close();
+	});
+
+	thread renderer([&]
+	{
+		Mat frame;
+		for(int f = 0; decoded.pop(frame); ++f)
+		{
+			if(frame.channels() == 1)
+			{
+				Mat colour;
+				cvtColor(frame,colour,COLOR_GRAY2BGR);
+				frame = colour;
+			}
+			drawLabels(frame,labels,f,n_frames);
+			if(!rendered.push(frame))
+				break;
+			frame = Mat();
+		}
+		rendered.close();
+		decoded.close();
+	});
+
+	int n_written = 0;
+	Mat frame;
+	while(rendered.pop(frame))
+	{
+		output_video << frame;
+		++n_written;
+	}
+	output_video.release();
+
+	decoder.join();
+	renderer.join();
+	return n_written;
+}
+
+} // end of namespace
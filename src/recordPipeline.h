@@ -0,0 +1,33 @@
+#ifndef RECORDPIPELINE_H
+#define RECORDPIPELINE_H
+
+#include <string>
+#include "labelRendering.h"
+
+namespace thesisUtilities
+{
+	// The properties of a video needed to record a visualisation of it
+	struct videoProperties_t
+	{
+		int xsize;
+		int ysize;
+		int n_frames; // as reported by the container, may be wrong
+		int fourcc;
+		double frame_rate; // NaN if unknown
+	};
+
+	bool readVideoProperties(const std::string& filename, videoProperties_t& properties);
+
+	// Record a visualisation video of the labels of a video, without a display.
+	//
+	// Decoding, drawing the labels and encoding run concurrently (on two extra
+	// threads and the calling thread), connected by short queues, so that only a
+	// few frames are held in memory at once and recording runs at the speed of the
+	// slowest stage. Returns the number of frames written, or -1 if the video
+	// cannot be read or the output cannot be opened
+	int recordLabelVideo(const std::string& video_filename, const videoLabels_t& labels, const std::string& output_filename,
+	                     const int fourcc, const double frame_rate);
+}
+
+// inclusion guard
+#endif
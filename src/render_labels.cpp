@@ -0,0 +1,166 @@
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include "thesisUtilities.h"
+#include "labelRendering.h"
+#include "recordPipeline.h"
+#include "batchJobs.h"
+
+using namespace std;
+namespace ut = thesisUtilities;
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+// Suffix of the visualisation videos, as produced by the record mode of the annotation tools
+#define LABELS_SUFFIX "_labels"
+
+// A video to be rendered, with its track files (empty if absent)
+struct renderJob_t
+{
+	fs::path vidname, heart_filename, structure_filename, outfilename;
+};
+
+
+static bool endsWith(const string& str, const string& suffix)
+{
+	return (str.size() >= suffix.size()) && (str.compare(str.size()-suffix.size(),string::npos,suffix) == 0);
+}
+
+
+// Render the visualisation video for one clip, with INCOMPLETE_SUFFIX inserted
+// before the extension until it is complete
+static bool renderVideo(const renderJob_t& job)
+{
+	const auto start_time = chrono::steady_clock::now();
+
+	ut::videoProperties_t properties;
+	if(!ut::readVideoProperties(job.vidname.string(),properties))
+	{
+		ut::LockedOutput(cerr) << "ERROR: Could not open video " << job.vidname << endl;
+		return false;
+	}
+	if(std::isnan(properties.frame_rate))
+		properties.frame_rate = ut::getFrameRate(job.vidname.string(),job.vidname.parent_path().string());
+	if(std::isnan(properties.frame_rate))
+	{
+		ut::LockedOutput(cerr) << "ERROR: Could not determine the frame rate of " << job.vidname << endl;
+		return false;
+	}
+
+	ut::videoLabels_t labels;
+	if(!ut::readVideoLabels(job.heart_filename.string(),job.structure_filename.string(),properties.n_frames,labels))
+	{
+		ut::LockedOutput(cerr) << "ERROR: Could not read the track files for " << job.vidname << endl;
+		return false;
+	}
+
+	const fs::path tempname = fs::path(job.outfilename).replace_extension(string(INCOMPLETE_SUFFIX) + job.outfilename.extension().string());
+	const int n_written = ut::recordLabelVideo(job.vidname.string(),labels,tempname.string(),properties.fourcc,properties.frame_rate);
+	if(n_written < 0)
+	{
+		ut::LockedOutput(cerr) << "ERROR: Could not open the output video for write: " << tempname << endl;
+		return false;
+	}
+
+	boost::system::error_code ec;
+	fs::rename(tempname,job.outfilename,ec);
+	if(ec)
+	{
+		ut::LockedOutput(cerr) << "ERROR: Could not rename " << tempname << " to " << job.outfilename << endl;
+		return false;
+	}
+
+	const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+	ut::LockedOutput(cout) << job.vidname.filename().string() << ": rendered " << n_written << " frames in " << seconds << " s" << endl;
+	return true;
+}
+
+
+int main(int argc, char** argv)
+{
+	fs::path viddir, hearttrackdir, trackdir, outdir;
+	string extension;
+	int n_threads;
+
+	// Declare the supported options.
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help,h", "produce help message")
+		("videodirectory,v", po::value<fs::path>(&viddir), "directory containing the videos")
+		("hearttrackdirectory,d", po::value<fs::path>(&hearttrackdir), "directory containing the heart track files (.tk)")
+		("trackdirectory,t", po::value<fs::path>(&trackdir), "directory containing the structure track files (.stk)")
+		("outputdirectory,o", po::value<fs::path>(&outdir), "directory in which to write the visualisation videos")
+		("extension,e", po::value<string>(&extension)->default_value(".avi"), "file extension of the videos")
+		("threads,j", po::value<int>(&n_threads)->default_value(thread::hardware_concurrency()), "number of videos to render at once");
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help"))
+	{
+		cout << "Renders the labels of every video in a directory that has track files into visualisation videos" << endl;
+		cout << desc << endl;
+		return 1;
+	}
+
+	if(!vm.count("videodirectory") || !vm.count("outputdirectory") || (!vm.count("hearttrackdirectory") && !vm.count("trackdirectory")) )
+	{
+		cerr << "ERROR: A video directory, an output directory and at least one track directory must be specified" << endl;
+		return EXIT_FAILURE;
+	}
+
+	boost::system::error_code ec;
+	fs::create_directories(outdir,ec);
+
+	// Find the videos with tracks, skipping those that have already been rendered
+	vector<renderJob_t> jobs;
+	int n_done = 0;
+	for(fs::directory_iterator it(viddir,ec), end; !ec && (it != end); it.increment(ec))
+	{
+		const fs::path& vidname = it->path();
+		const string stem = vidname.stem().string();
+		// Skip any visualisation videos, in case the output directory is the video directory
+		if(!fs::is_regular_file(vidname) || (vidname.extension() != extension) ||
+		   endsWith(stem,LABELS_SUFFIX) || endsWith(stem,LABELS_SUFFIX INCOMPLETE_SUFFIX) )
+			continue;
+
+		renderJob_t job;
+		job.vidname = vidname;
+		if(vm.count("hearttrackdirectory") && fs::exists(hearttrackdir / (stem + ".tk")))
+			job.heart_filename = hearttrackdir / (stem + ".tk");
+		if(vm.count("trackdirectory") && fs::exists(trackdir / (stem + ".stk")))
+			job.structure_filename = trackdir / (stem + ".stk");
+		if(job.heart_filename.empty() && job.structure_filename.empty())
+			continue;
+
+		job.outfilename = outdir / (stem + LABELS_SUFFIX + extension);
+		if(fs::exists(job.outfilename))
+			++n_done;
+		else
+			jobs.emplace_back(job);
+	}
+	if(ec)
+	{
+		cerr << "ERROR: Could not read the video directory " << viddir << endl;
+		return EXIT_FAILURE;
+	}
+	sort(jobs.begin(),jobs.end(),[](const renderJob_t& a, const renderJob_t& b){return a.vidname < b.vidname;});
+	cout << jobs.size() << " videos to render (" << n_done << " already rendered)" << endl;
+
+	// Each thread renders whole videos
+	const int n_failed = ut::runJobs(n_threads,jobs.size(),[&](const size_t j) {return renderVideo(jobs[j]);});
+
+	if(n_failed > 0)
+	{
+		cerr << n_failed << " of " << jobs.size() << " videos could not be rendered" << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
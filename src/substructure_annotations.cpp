@@ -1,7 +1,6 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
-#include <opencv2/video/video.hpp>
 #include <cmath>
 #include <iostream>
 #include <fstream>
@@ -10,6 +9,17 @@
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 #include "thesisUtilities.h"
+#include "frameStore.h"
+#include "annotationOverlays.h"
+#include "overlayRenderer.h"
+#include "motionPrediction.h"
+#include "motionPrefetcher.h"
+#include "flowCache.h"
+#include "editJournal.h"
+#include "recordPipeline.h"
+#include "tracing.h"
+#include "userInput.h"
+#include "trackComparison.h"
 #include "opencvkeys.h"
 
 using namespace cv;
@@ -20,60 +30,53 @@ namespace fs = boost::filesystem;
 
 #define C_SELECT_CLICK_DISTANCE 10.0
 
+// Number of stored labels after which the track file is rewritten in the background
+#define JOURNAL_COMPACTION_LABELS 2000
+
 // Global variables (need to be accessible by callbacks)
 int f, xsize, ysize, n_frames;
-vector<int> view_label_track;
-vector<ut::heartPresent_t> heart_present_track;
+ut::HeartTrack heart_track;
 int active_s, n_structures;
 bool overwrite_mode;
-vector<Mat> I;
-Mat disp;
+Mat frame, disp;
+ut::OverlayRenderer renderer;
+ut::UserInput user_input;
 vector<string> structure_names;
 vector<bool> touched;
 vector<ut::subStructLabel_t> current_sl;
-const std::string view_strings[4] = {std::string("BACKGROUND"),std::string("4-CHAM"),std::string("LVOT"),std::string("3V")};
-const cv::Scalar view_colours[4] = {Scalar(255,255,255),Scalar(255,255,0), Scalar(0,255,0), Scalar(0,255,255)};
-const cv::Scalar view_highlight_colours[4] = {Scalar(0,0,255),Scalar(0,127,255), Scalar(255,0,255), Scalar(255,0,0)};
-const int n_views = 4;
+ut::TraceSpan key_to_display("key_to_display",false); // from a key press until its result is displayed
 
 // Function to display the current frame with the current annotations
 void render()
 {
-	// Display the image
-	disp = I[f].clone();
-
+	// Display the image, only redrawing the parts that have changed
 	for (int s = 0; s < n_structures; ++s)
 	{
-		Scalar colour = (s == active_s) ? view_highlight_colours[view_label_track[f]] : view_colours[view_label_track[f]];
-
-		if(current_sl[s].present == ut::hpObscured)
-			colour *= 0.5;
-
-		if(current_sl[s].present != ut::hpNone)
-		{
-			const int lineThickness = 2;
-			const int lineLength = 15;
-			arrowedLine(disp,Point(current_sl[s].x,current_sl[s].y), Point(std::round(current_sl[s].x+lineLength*std::cos(float(current_sl[s].ori)*M_PI/180.0)),std::round(current_sl[s].y-lineLength*std::sin(float(current_sl[s].ori)*M_PI/180.0))),colour,lineThickness,8,0,0.2);
-		}
+		const Scalar colour = (s == active_s) ? ut::view_highlight_colours[heart_track.viewLabel()[f]] : ut::view_colours[heart_track.viewLabel()[f]];
+		renderer.setElement(s,ut::structureOverlay_t{current_sl[s].x,current_sl[s].y,current_sl[s].ori,current_sl[s].present,colour});
 	}
 	string name_display_str = to_string(active_s) + string(": ") + structure_names[active_s];
 	if(current_sl[active_s].present == ut::hpNone)
 		name_display_str = string("(") + name_display_str + string(")");
-	putText(disp,name_display_str,Point(5,15),FONT_HERSHEY_PLAIN,1.0,Scalar(0,255,255));
+	renderer.setElement(n_structures,ut::textOverlay_t{name_display_str,Point(5,15),Scalar(0,255,255)});
 
-	if(heart_present_track[f] == ut::hpPresent || heart_present_track[f] == ut::hpObscured)
-		putText(disp,view_strings[view_label_track[f]],Point(5,30),FONT_HERSHEY_PLAIN,1.0,view_colours[view_label_track[f]]);
+	if(heart_track.present()[f] == ut::hpPresent || heart_track.present()[f] == ut::hpObscured)
+		renderer.setElement(n_structures+1,ut::textOverlay_t{ut::view_strings[heart_track.viewLabel()[f]],Point(5,30),ut::view_colours[heart_track.viewLabel()[f]]});
 	else
-		putText(disp,string("-"),Point(5,30),FONT_HERSHEY_PLAIN,1.0,view_colours[0]);
+		renderer.setElement(n_structures+1,ut::textOverlay_t{string("-"),Point(5,30),ut::view_colours[0]});
 
 	// Frame number display
-	putText(disp,string("Frame ") + to_string(f) + string("/") + to_string(n_frames-1),Point(5,ysize-10),FONT_HERSHEY_PLAIN,1.0,Scalar(0,255,255));
+	renderer.setElement(n_structures+2,ut::textOverlay_t{string("Frame ") + to_string(f) + string("/") + to_string(n_frames-1),Point(5,ysize-10),Scalar(0,255,255)});
 
 	// Overwrite mode display
 	if(overwrite_mode)
-		putText(disp,"OVERWRITE",Point(xsize-100,ysize-10),FONT_HERSHEY_PLAIN,1.0,Scalar(0,255,255));
+		renderer.setElement(n_structures+3,ut::textOverlay_t{"OVERWRITE",Point(xsize-100,ysize-10),Scalar(0,255,255)});
+	else
+		renderer.clearElement(n_structures+3);
 
-	imshow("Substructure Annotation",disp);
+	disp = renderer.render();
+	user_input.show(disp);
+	key_to_display.end();
 }
 
 
@@ -130,10 +133,16 @@ int main(int argc, char** argv)
 	int nextf, previousf = -1;
 	float frame_rate;
 	int keyPress = 0;
-	VideoCapture vid_obj;
-	bool irrelevant_key, exit_flag, read_error = false, read_success = false, record_mode = false, motion_prediction = true;
-	VideoWriter output_video;
-	fs::path trackdir, hearttrackdir, vidname, structfilename;
+	ut::FrameStore frame_store;
+	ut::FlowCache flow_cache;
+	ut::MotionPrefetcher motion_prefetcher(frame_store);
+	unsigned frame_cache_mb;
+	int jpeg_quality;
+	string frame_storage, grayscale, motion_prediction_str;
+	bool irrelevant_key, exit_flag, read_error = false, read_success = false, record_mode = false;
+	ut::motionPrediction_t motion_prediction;
+	ut::videoProperties_t video;
+	fs::path trackdir, hearttrackdir, vidname, structfilename, frame_cache_dir, flow_cache_dir, trace_file, replay_script, record_script, replay_times, golden_file;
 
 	// Declare the supported options.
 	po::options_description desc("Allowed options");
@@ -143,6 +152,18 @@ int main(int argc, char** argv)
 		("structure_file,s", po::value<fs::path>(&structfilename)->default_value("structures"), "file containing list of structures to annotate")
 		("trackdirectory,t", po::value<fs::path>(&trackdir)->default_value("."), "directory containing the input/output track file")
 		("hearttrackdirectory,d", po::value<fs::path>(&hearttrackdir)->default_value("."), "directory containing the relevant track file")
+		("frame-cache-mb", po::value<unsigned>(&frame_cache_mb)->default_value(512), "memory budget for caching decoded video frames (MB)")
+		("frame-cache-dir", po::value<fs::path>(&frame_cache_dir)->default_value(""), "directory in which to keep decoded frames between sessions (disabled if empty)")
+		("frame-storage", po::value<string>(&frame_storage)->default_value("raw"), "how to hold frames in memory: 'raw' (decode on demand) or compressed as 'png' or 'jpeg'")
+		("jpeg-quality", po::value<int>(&jpeg_quality)->default_value(95), "quality (0-100) of frames held as 'jpeg'")
+		("grayscale", po::value<string>(&grayscale)->default_value("auto"), "store frames with a single channel: 'yes', 'no' or 'auto' (if the video is grayscale)")
+		("flow-cache-dir", po::value<fs::path>(&flow_cache_dir)->default_value(""), "directory in which to keep dense optical flow fields between sessions (disabled if empty)")
+		("motion-prediction,m", po::value<string>(&motion_prediction_str)->default_value("dense"), "initial method for predicting structure motion between frames: 'sparse', 'dense' or 'off'")
+		("trace", po::value<fs::path>(&trace_file)->default_value(""), "write a Chrome trace of decoding, display, optical flow and saving to this file and print latency percentiles on exit")
+		("replay", po::value<fs::path>(&replay_script)->default_value(""), "take key presses and mouse clicks from this input script instead of the window, without opening it")
+		("replay-times", po::value<fs::path>(&replay_times)->default_value(""), "write the time taken by each replayed key press and mouse click to this file")
+		("record-input", po::value<fs::path>(&record_script)->default_value(""), "record the key presses and mouse clicks of this session as an input script")
+		("golden", po::value<fs::path>(&golden_file)->default_value(""), "on exit, check that the track file matches this one (fails if not)")
 		("record,r" , "record the visualisation in a video file");
 
 	po::variables_map vm;
@@ -156,36 +177,81 @@ int main(int argc, char** argv)
 		return 1;
 	}
 
+	// Time the work done from here on if requested
+	const ut::TraceSession trace_session(trace_file.string());
+
 	if (vm.count("record"))
 		record_mode = true;
 
-	// Open
-	vid_obj.open(vidname.string());
-	if ( !vid_obj.isOpened())
+	if( (frame_storage == "png") || (frame_storage == "jpeg") )
+		frame_store.useCompression(frame_storage,jpeg_quality);
+	else if(frame_storage != "raw")
+	{
+		cerr << "ERROR: Unrecognised frame storage option " << frame_storage << endl;
+		return -1;
+	}
+
+	if(!ut::parseMotionPrediction(motion_prediction_str,motion_prediction))
 	{
-		cout  << "Could not open reference " << vidname << endl;
+		cerr << "ERROR: Unrecognised motion prediction option " << motion_prediction_str << endl;
 		return -1;
 	}
 
-	xsize = vid_obj.get(cv::CAP_PROP_FRAME_WIDTH);
-	ysize = vid_obj.get(cv::CAP_PROP_FRAME_HEIGHT);
-	n_frames = vid_obj.get(cv::CAP_PROP_FRAME_COUNT);
-	frame_rate = vid_obj.get(cv::CAP_PROP_FPS);
+	if(grayscale == "yes")
+		frame_store.setGrayscaleMode(ut::gsAlways);
+	else if(grayscale == "no")
+		frame_store.setGrayscaleMode(ut::gsNever);
+	else if(grayscale != "auto")
+	{
+		cerr << "ERROR: Unrecognised grayscale option " << grayscale << endl;
+		return -1;
+	}
 
-	// Read in all frames into a buffer (this gets around decoding issues)
-	I.resize(n_frames);
-	for(f = 0; f < n_frames; f++)
+	// Take key presses and mouse clicks from a script instead of the window, or record them
+	if(!replay_script.empty())
 	{
-		vid_obj >> I[f];
+		if(!user_input.replay(replay_script.string()))
+			return -1;
+	}
+	else if(!record_script.empty() && !user_input.record(record_script.string()))
+		return -1;
 
-		// Occasionally the number of frames detected by opencv is wrong
-		// Therefore check for empty frames
-		if( I[f].rows <= 0)
+	// Open (frames are decoded on demand by the frame store, or by the record pipeline in record mode)
+	if(record_mode)
+	{
+		if(!ut::readVideoProperties(vidname.string(),video))
 		{
-			n_frames = f;
-			break;
+			cout  << "Could not open reference " << vidname << endl;
+			return -1;
 		}
 	}
+	else
+	{
+		if ( !frame_store.open(vidname.string(),size_t(frame_cache_mb)*1024*1024,frame_cache_dir.string()) || !frame_store.getFrame(0,frame) )
+		{
+			cout  << "Could not open reference " << vidname << endl;
+			return -1;
+		}
+		video.xsize = frame_store.width();
+		video.ysize = frame_store.height();
+		video.n_frames = frame_store.frameCount();
+		video.fourcc = frame_store.fourcc();
+		video.frame_rate = frame_store.frameRate();
+	}
+
+	xsize = video.xsize;
+	ysize = video.ysize;
+	n_frames = video.n_frames;
+	frame_rate = video.frame_rate;
+
+	// Reuse dense optical flow fields calculated in previous sessions
+	if(!flow_cache_dir.empty() && !record_mode)
+	{
+		if(flow_cache.open(vidname.string(),flow_cache_dir.string(),xsize,ysize,ut::denseFlowParameters()))
+			motion_prefetcher.setFlowCache(&flow_cache);
+		else
+			cerr << "WARNING: Could not open a flow cache in " << flow_cache_dir << endl;
+	}
 
 	cout << "Heart Substructures Annotation Tool \n"
 			"Control List: \n"
@@ -201,7 +267,7 @@ int main(int argc, char** argv)
 			"  O             : Toggle overwrite mode (changes are propagated even to frames with existing labels) \n"
 			"  P             : Move to the next frame without saving label \n"
 			"  R             : Move to the previous frame without saving label \n"
-			"  M             : Toggle motion prediction \n"
+			"  M             : Cycle motion prediction (sparse point tracking/dense flow/off) \n"
 			"  Esc           : Exit (and save annotations) \n"
 			"  Q             : Quit (discarding annotations) \n";
 	cout << endl;
@@ -219,28 +285,8 @@ int main(int argc, char** argv)
 	cout << "Using frame rate: " << frame_rate << endl;
 
 	// Read in structures to label
-	ifstream structfile(structfilename.string().c_str());
 	vector<vector<int>> views_per_structure;
-	if(structfile.is_open())
-	{
-		for(string linestring; !getline(structfile,linestring).eof() && !linestring.empty(); )
-		{
-			stringstream ss(linestring);
-			string namestring;
-			ss >> namestring;
-			structure_names.emplace_back(namestring);
-			views_per_structure.emplace_back(vector<int>());
-
-			int fourier_order;
-			ss >> fourier_order;
-			bool systole_only;
-			ss >> systole_only; // FIXME currently not doing anything with this
-
-			for(int v; ss >> v; )
-				views_per_structure[structure_names.size()-1].emplace_back(v);
-		}
-	}
-	else
+	if(!ut::readStructureList(structfilename.string(),structure_names,views_per_structure))
 	{
 		cerr << "ERROR: Could not open structure file " << structfilename << endl;
 		return EXIT_FAILURE;
@@ -248,12 +294,12 @@ int main(int argc, char** argv)
 	n_structures = structure_names.size();
 
 	// Vector listing the structures that are present in each view
-	vector<vector<int>> structuresPerView(n_views);
+	vector<vector<int>> structuresPerView(ut::n_views);
 	for(int s = 0; s < n_structures; ++s)
 		for(int v : views_per_structure[s])
 			structuresPerView[v].emplace_back(s);
 
-	vector<vector<ut::subStructLabel_t>> track(n_frames, vector<ut::subStructLabel_t>(n_structures)) ;
+	ut::StructureTrack track(n_frames,n_structures);
 
 	// Look for an existing track file
 	const fs::path outvidname = trackdir / vidname.stem().concat("_labels").replace_extension(".avi");
@@ -278,55 +324,63 @@ int main(int argc, char** argv)
 
 	// Also get the view label information from the heart track file
 
-	ifstream htfile(hearttrackfilename.string().c_str());
-	if (htfile.is_open())
-	{
-		htfile.close(); // close it to let the dedicated function read it
-
-		view_label_track.resize(n_frames); heart_present_track.resize(n_frames);
-		int radius; bool headup;
-		vector<bool> labelled_track(n_frames); vector<int> centrey_track(n_frames); vector<int> centrex_track(n_frames);
-		vector<int> ori_track(n_frames); vector<int> phase_point_track(n_frames); vector<float> cardiac_phase_track(n_frames);
-
-		if(!ut::readTrackFile(hearttrackfilename.string(), n_frames, headup, radius, labelled_track, heart_present_track, centrey_track,
-			                       centrex_track, ori_track, view_label_track, phase_point_track, cardiac_phase_track) )
-		{
-			cerr << "Could not read heart track information from " << hearttrackfilename << endl;
-			return EXIT_FAILURE;
-		}
-	}
-	else
+	// (frames where the heart is not present are given the background class)
+	if(!ut::readViewLabels(hearttrackfilename.string(), n_frames, heart_track))
 	{
 		cerr << "Could not read heart track information from " << hearttrackfilename << endl;
 		return EXIT_FAILURE;
 	}
 
-	// Set frames where the heart is not present to the background class
-	for(int g = 0; g < n_frames; ++g)
-		if(heart_present_track[g] == ut::hpNone)
-			view_label_track[g] = 0;
-
 	if(read_error)
 	{
 		cerr << "Error reading existing trackfile " << outfilename << ", file will be ignored and overwritten (quit to retain this file)" << endl;
 	}
 
-	// Create a window and bind the mouse callback to it
-	namedWindow( "Substructure Annotation", WINDOW_AUTOSIZE );// Create a window for display.
-	setMouseCallback( "Substructure Annotation", onMouse, 0 );
+	// Writes the track file from a snapshot of the current labels
+	const auto track_writer = [&]() -> ut::EditJournal::trackWriter_t
+	{
+		ut::StructureTrack snapshot = track;
+		return [=](const string& filename) mutable {return ut::writeSubstructuresTrackFile(filename,xsize,ysize,structure_names,views_per_structure,heart_track,snapshot);};
+	};
 
-	// Create an output video
+	// Record mode draws the stored labels into the output video without a window
+	// and without changing any labels. The heart track is only used to colour the
+	// structures by view
 	if(record_mode)
 	{
-		int ex = static_cast<int>(vid_obj.get(cv::CAP_PROP_FOURCC));
-		output_video.open(outvidname.string(), ex, frame_rate, Size(xsize,ysize), true);
-
-		if (!output_video.isOpened())
+		ut::videoLabels_t labels;
+		labels.has_heart = true;
+		labels.draw_heart = false;
+		labels.heart = heart_track;
+		labels.has_structures = true;
+		labels.structures = track;
+		labels.structure_names = structure_names;
+
+		const int n_written = ut::recordLabelVideo(vidname.string(),labels,outvidname.string(),video.fourcc,frame_rate);
+		if(n_written < 0)
 		{
 			cerr  << "Could not open the output video for write: " << outvidname << endl;
 			return -1;
 		}
+		cout << "Recorded " << n_written << " frames to " << outvidname << endl;
+		return EXIT_SUCCESS;
+	}
+
+	// Every stored label is recorded in a journal. Recover any labels stored in a
+	// session that did not finish. They stay in the journal, so they are only written
+	// to the track file with the rest of this session (and quitting leaves it unchanged)
+	ut::EditJournal journal;
+	if(!journal.open(outfilename.string(),ut::EditJournal::jkStructures))
+	{
+		cerr << "Could not open the edit journal for " << outfilename << endl;
+		return EXIT_FAILURE;
 	}
+	const int n_recovered = journal.replay(track);
+	if(n_recovered > 0)
+		cout << "Recovered " << n_recovered << " stored labels from an unfinished session (exit with Esc to keep them, or quit to return the track file to how it was before that session)" << endl;
+
+	// Create a window and bind the mouse callback to it
+	user_input.openWindow("Substructure Annotation",onMouse);
 
 	// This will hold the current annotations
 	vector<bool> just_stored_label(n_structures,false);
@@ -334,39 +388,67 @@ int main(int argc, char** argv)
 	current_sl.resize(n_structures);
 
 	// Loop through frames
-	active_s = structuresPerView[view_label_track[0]][0];
+	active_s = structuresPerView[heart_track.viewLabel()[0]][0];
 	int active_s_view_specific_index = 0;
 	exit_flag = false;
 	f = 0;
 	overwrite_mode = false;
 	while(!exit_flag)
 	{
+		// Fetch the frame. The frame count reported by opencv is sometimes wrong, so we may
+		// only find out here that we have moved past the end of the video
+		n_frames = frame_store.frameCount();
+		if(!frame_store.getFrame(f,frame))
+		{
+			n_frames = frame_store.frameCount();
+			if( (keyPress == RETURN_KEY) || (keyPress == VAR_RETURN_KEY) )
+				break;
+			f = previousf; // stall on the final frame
+			continue;
+		}
+
+		renderer.setBase(frame);
+
 		// Initialise the labels to this frame to either their previously labelled values
 		// Or, if the frame has not been labelled yet, to the values from the previous frame
 		// Start in the middle for the first frame
 		fill(touched.begin(),touched.end(),false);
 
 		// Select a new structure if the view has changed
-		if(view_label_track[f] != view_label_track[previousf])
+		if(heart_track.viewLabel()[f] != heart_track.viewLabel()[previousf])
 		{
 			active_s_view_specific_index = 0;
-			active_s = structuresPerView[view_label_track[f]][active_s_view_specific_index];
+			active_s = structuresPerView[heart_track.viewLabel()[f]][active_s_view_specific_index];
 		}
 
-		// Calculate a motion offset to use to estimate new positions
-		Mat_<Vec2f> flow;
-		if(motion_prediction && previousf >= 0 && any_of(just_stored_label.cbegin(),just_stored_label.cend(), [](bool b){return b;}) )
+		// Estimate the new positions of the structures that are about to be propagated
+		// from the previous frame
+		vector<Point2f> old_points, predicted_points;
+		vector<int> predicted_index(n_structures,-1);
+		if( (motion_prediction != ut::mpOff) && (previousf >= 0) && (heart_track.viewLabel()[f] == heart_track.viewLabel()[previousf]) )
+		{
+			for (int s = 0; s < n_structures; ++s)
+			{
+				if(just_stored_label[s] && (track.x(s)[previousf] >= 0) && (track.y(s)[previousf] >= 0) && (track.x(s)[previousf] < xsize) && (track.y(s)[previousf] < ysize) )
+				{
+					predicted_index[s] = old_points.size();
+					old_points.emplace_back(track.x(s)[previousf],track.y(s)[previousf]);
+				}
+			}
+		}
+		if(!old_points.empty())
 		{
-			Mat oldim, newim;
-			cvtColor(I[previousf],oldim,cv::COLOR_BGR2GRAY);
-			cvtColor(I[f],newim,cv::COLOR_BGR2GRAY);
-			calcOpticalFlowFarneback(oldim,newim,flow,0.5/*PYR_SCALE*/,3/*LEVELS*/,30/*WINSIZE*/,3/*ITERATIONS*/,7/*POLY_N*/,1.5/*POLY_SIGMA*/,OPTFLOW_FARNEBACK_GAUSSIAN/*FLAGS*/);
+			// Use the motion prepared in the background while the user was working
+			// on the previous frame if possible
+			ut::framePairMotion_t pair_motion;
+			motion_prefetcher.obtain(previousf,f,motion_prediction,pair_motion);
+			ut::predictMotion(pair_motion,old_points,predicted_points);
 		}
 		for (int s = 0; s < n_structures; ++s)
 		{
-			if((f == 0) && !track[0][s].labelled)
+			if((f == 0) && !track.labelled(s)[0])
 			{
-				if(any_of(views_per_structure[s].cbegin(),views_per_structure[s].cend(),[](int v){return v == view_label_track[f];}))
+				if(any_of(views_per_structure[s].cbegin(),views_per_structure[s].cend(),[](int v){return v == heart_track.viewLabel()[f];}))
 				{
 					current_sl[s].x = xsize-20;
 					current_sl[s].y = 5+5*s;
@@ -385,35 +467,29 @@ int main(int argc, char** argv)
 			else
 			{
 				// Retrieve a previous labelling if one exists
-				if( track[f][s].labelled && (!overwrite_mode || (overwrite_mode && !just_stored_label[s]) ) )
-				{
-					current_sl[s].x = track[f][s].x;
-					current_sl[s].y = track[f][s].y;
-					current_sl[s].ori = track[f][s].ori;
-					current_sl[s].present = track[f][s].present;
-				}
+				if( track.labelled(s)[f] && (!overwrite_mode || (overwrite_mode && !just_stored_label[s]) ) )
+					current_sl[s] = track.label(f,s);
 				// Propagate the label in the previously labelled frame
-				else if(just_stored_label[s] && (view_label_track[f] == view_label_track[previousf]) )
+				else if(just_stored_label[s] && (heart_track.viewLabel()[f] == heart_track.viewLabel()[previousf]) )
 				{
-					if(motion_prediction && (previousf >= 0) && (track[previousf][s].x >= 0) && (track[previousf][s].y >= 0) && (track[previousf][s].x < xsize) && (track[previousf][s].y < ysize) )
+					if(predicted_index[s] >= 0)
 					{
-						Vec2f flow_offset = flow(track[previousf][s].y,track[previousf][s].x);
-						current_sl[s].x = track[previousf][s].x + std::round(flow_offset[0]);
-						current_sl[s].y = track[previousf][s].y + std::round(flow_offset[1]);
+						current_sl[s].x = std::round(predicted_points[predicted_index[s]].x);
+						current_sl[s].y = std::round(predicted_points[predicted_index[s]].y);
 					}
 					else
 					{
-						current_sl[s].x = track[previousf][s].x;
-						current_sl[s].y = track[previousf][s].y;
+						current_sl[s].x = track.x(s)[previousf];
+						current_sl[s].y = track.y(s)[previousf];
 					}
-					current_sl[s].ori = track[previousf][s].ori;
-					current_sl[s].present = track[previousf][s].present;
+					current_sl[s].ori = track.orientation(s)[previousf];
+					current_sl[s].present = track.present(s)[previousf];
 					touched[s] = true;
 				}
 				// Apply a default labelling
 				else
 				{
-					if(any_of(views_per_structure[s].cbegin(),views_per_structure[s].cend(),[](int v){return v == view_label_track[f];}))
+					if(any_of(views_per_structure[s].cbegin(),views_per_structure[s].cend(),[](int v){return v == heart_track.viewLabel()[f];}))
 					{
 						current_sl[s].x = xsize-4*s;
 						current_sl[s].y = 20;
@@ -432,26 +508,23 @@ int main(int argc, char** argv)
 		}
 
 		fill(just_stored_label.begin(),just_stored_label.end(), false);
+
+		// Moving on to the next frame is the most likely next step, so start preparing
+		// the motion prediction for it while the user works on this one
+		if( (motion_prediction != ut::mpOff) && (f+1 < n_frames) )
+			motion_prefetcher.request(f,f+1,motion_prediction);
 		nextf = f;
 		while((nextf == f) && (!exit_flag))
 		{
 			// Display the current frame
 			render();
 
-			// Add this frame to the output video and continue to the next frame
-			if(record_mode)
-			{
-				output_video << disp;
-				nextf = f + 1;
-				waitKey(10);
-				break;
-			}
-
 			// Wait for a (relevant) key press
 			do
 			{
 				irrelevant_key = false;
-				keyPress = waitKey(0);
+				keyPress = user_input.waitKey();
+				key_to_display.begin();
 				switch(keyPress)
 				{
 					case LEFT_ARROW:
@@ -552,16 +625,16 @@ int main(int argc, char** argv)
 
 					case LESSTHAN_KEY:
 						if(active_s_view_specific_index == 0)
-							active_s_view_specific_index = structuresPerView[view_label_track[f]].size()-1;
+							active_s_view_specific_index = structuresPerView[heart_track.viewLabel()[f]].size()-1;
 						else
 							active_s_view_specific_index--;
-						active_s = structuresPerView[view_label_track[f]][active_s_view_specific_index];
+						active_s = structuresPerView[heart_track.viewLabel()[f]][active_s_view_specific_index];
 						break;
 
 					case MORETHAN_KEY:
 						active_s_view_specific_index++;
-						active_s_view_specific_index %= structuresPerView[view_label_track[f]].size();
-						active_s = structuresPerView[view_label_track[f]][active_s_view_specific_index];
+						active_s_view_specific_index %= structuresPerView[heart_track.viewLabel()[f]].size();
+						active_s = structuresPerView[heart_track.viewLabel()[f]][active_s_view_specific_index];
 						break;
 
 					case ZERO_KEY:
@@ -574,10 +647,10 @@ int main(int argc, char** argv)
 					case SEVEN_KEY:
 					case EIGHT_KEY:
 					case NINE_KEY:
-						if(keyPress - ZERO_KEY < int(structuresPerView[view_label_track[f]].size()))
+						if(keyPress - ZERO_KEY < int(structuresPerView[heart_track.viewLabel()[f]].size()))
 						{
 							active_s_view_specific_index = keyPress - ZERO_KEY ;
-							active_s = structuresPerView[view_label_track[f]][active_s_view_specific_index];
+							active_s = structuresPerView[heart_track.viewLabel()[f]][active_s_view_specific_index];
 						}
 						else
 							irrelevant_key = true;
@@ -588,7 +661,10 @@ int main(int argc, char** argv)
 						break;
 
 					case M_KEY:
-						motion_prediction = !motion_prediction;
+						motion_prediction = ut::motionPrediction_t((motion_prediction+1) % 3);
+						cout << "Motion prediction: " << ut::motionPredictionName(motion_prediction) << endl;
+						if( (motion_prediction != ut::mpOff) && (f+1 < n_frames) )
+							motion_prefetcher.request(f,f+1,motion_prediction);
 						break;
 
 					case P_KEY:
@@ -636,21 +712,24 @@ int main(int argc, char** argv)
 				// Check to see whether the annotations for this substructure have actually changed
 				if(touched[s])
 				{
-					track[f][s].x = current_sl[s].x;
-					track[f][s].y = current_sl[s].y;
-					track[f][s].ori = current_sl[s].ori;
-					track[f][s].present = current_sl[s].present;
-					track[f][s].labelled = true;
+					ut::subStructLabel_t label = current_sl[s];
+					label.labelled = true;
+					track.setLabel(f,s,label);
+					journal.append(f,s,label);
 					just_stored_label[s] = true;
 				}
-				else if(track[f][s].labelled == true)
+				else if(track.labelled(s)[f])
 					just_stored_label[s] = true;
 			}
 		}
 
+		// Bring the track file up to date in the background every so often
+		if( (journal.pendingCount() >= JOURNAL_COMPACTION_LABELS) && !journal.compacting() )
+			journal.compactInBackground(track_writer());
+
 		if(f == n_frames - 1 )
 		{
-			if( (keyPress == RETURN_KEY) || (keyPress == VAR_RETURN_KEY) || record_mode )
+			if( (keyPress == RETURN_KEY) || (keyPress == VAR_RETURN_KEY) )
 				exit_flag = true;
 			else if (keyPress == P_KEY)
 				nextf = f; // stall on the final frame
@@ -663,44 +742,49 @@ int main(int argc, char** argv)
 
 	} // frame loop
 
-	// Write to file
-	if( (keyPress != Q_KEY) && (!record_mode) )
-	{
-		ofstream outfile(outfilename.c_str());
-		if (!outfile.is_open())
-			return false;
+	// Report how often the prefetcher failed to keep up, and any compression statistics
+	frame_store.reportStatistics(cout);
+	if(motion_prefetcher.hitCount() + motion_prefetcher.missCount() > 0)
+		cout << "Motion predictions prepared in advance: " << motion_prefetcher.hitCount() << "/" << motion_prefetcher.hitCount() + motion_prefetcher.missCount() << endl;
 
-		outfile << "# frame_no labelled present y x orientation" << endl;
-		outfile << " " << n_structures << " " << xsize << " " << ysize << endl << endl;
+	// Write to file, which is only needed if there are labels that have not
+	// already been written in the background
+	if(keyPress != Q_KEY)
+	{
+		// Make sure the file has exactly one line per frame
+		n_frames = frame_store.verifiedFrameCount();
 
-		for (int s = 0; s < n_structures; ++s)
+		track.resize(n_frames);
+		if(!journal.commit(track_writer(),read_error))
 		{
-			outfile << s << " " << structure_names[s] << endl;
-			for(f = 0; f < n_frames; f++)
-			{
-				// Stipulate that substructures must be obscured if the whole heart is obscured
-				if(heart_present_track[f] == ut::hpObscured && track[f][s].present == ut::hpPresent && std::none_of(views_per_structure[s].cbegin(),views_per_structure[s].cend(),[](int v){return v == 0;}) )
-					track[f][s].present = ut::hpObscured;
-
-				// Also ensure that any lablled locations that are off the edge of the image are
-				// marked as not present
-				if( (track[f][s].y >= ysize) || (track[f][s].y < 0) || (track[f][s].x >= xsize) || (track[f][s].x < 0) )
-					track[f][s].present = ut::hpNone;
-
-				outfile << f << " "
-						<< track[f][s].labelled << " "
-						<< track[f][s].present << " "
-						<< track[f][s].y << " "
-						<< track[f][s].x << " "
-						<< track[f][s].ori <<
-						endl;
-			}
-			outfile << endl;
+			cerr << "ERROR: Could not write track file " << outfilename << " (the labels are kept in its journal)" << endl;
+			return EXIT_FAILURE;
 		}
-		outfile.close();
 	}
+	else
+		journal.discard();
 
-	if(record_mode)
-		output_video.release();
+	// Report on a replayed session, then check the labels it produced
+	if(user_input.replaying())
+	{
+		user_input.endSession();
+		user_input.reportStepTimes(cout);
+		if(!replay_times.empty() && !user_input.writeStepTimes(replay_times.string()))
+		{
+			cerr << "ERROR: Could not write the replay times to " << replay_times << endl;
+			return EXIT_FAILURE;
+		}
+		if(!user_input.scriptComplete())
+			return EXIT_FAILURE;
+	}
+	if(!golden_file.empty())
+	{
+		if(!ut::compareSubstructuresTrackFiles(outfilename.string(),golden_file.string(),cerr))
+		{
+			cerr << "ERROR: The labels in " << outfilename << " do not match " << golden_file << endl;
+			return EXIT_FAILURE;
+		}
+		cout << "The labels match " << golden_file << endl;
+	}
 
 }
@@ -0,0 +1,209 @@
+#include "textParser.h"
+#include <fstream>
+#include <limits>
+#include <cmath>
+
+using namespace std;
+
+namespace thesisUtilities
+{
+
+bool readWholeFile(const string& filename, vector<char>& buffer)
+{
+	ifstream infile(filename.c_str(),ios::binary|ios::ate);
+	if(!infile.is_open())
+		return false;
+	const streamoff size = infile.tellg();
+	if(size < 0)
+		return false;
+	buffer.resize(size);
+	infile.seekg(0);
+	return (size == 0) || infile.read(buffer.data(),size);
+}
+
+
+static inline bool isSpace(const char c)
+{
+	return (c == ' ') || (c == '\n') || (c == '\t') || (c == '\r') || (c == '\v') || (c == '\f');
+}
+
+static inline bool isDigit(const char c)
+{
+	return (c >= '0') && (c <= '9');
+}
+
+
+TextParser::TextParser(const char* begin, const char* end)
+: pos(begin), end(end), eof_flag(false)
+{
+}
+
+
+// Skip whitespace before a value, returns false if the end of the text is reached
+bool TextParser::skipSpace()
+{
+	while( (pos != end) && isSpace(*pos) )
+		++pos;
+	if(pos == end)
+	{
+		eof_flag = true;
+		return false;
+	}
+	return true;
+}
+
+
+bool TextParser::readInt(int& value)
+{
+	if(!skipSpace())
+		return false;
+
+	bool negative = false;
+	if( (*pos == '-') || (*pos == '+') )
+	{
+		negative = (*pos == '-');
+		++pos;
+	}
+
+	long long magnitude = 0;
+	const char* digits_start = pos;
+	for( ; (pos != end) && isDigit(*pos); ++pos)
+	{
+		magnitude = 10*magnitude + (*pos - '0');
+		if(magnitude > static_cast<long long>(numeric_limits<int>::max()) + 1)
+			return false;
+	}
+	if(pos == end)
+		eof_flag = true;
+	if(pos == digits_start)
+		return false;
+
+	const long long signed_value = negative ? -magnitude : magnitude;
+	if(signed_value > numeric_limits<int>::max())
+		return false;
+	value = static_cast<int>(signed_value);
+	return true;
+}
+
+
+bool TextParser::readBool(bool& value)
+{
+	int int_value;
+	if(!readInt(int_value) || (int_value < 0) || (int_value > 1))
+		return false;
+	value = (int_value == 1);
+	return true;
+}
+
+
+bool TextParser::readFloat(float& value)
+{
+	static const double powers_of_ten[] = {1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+
+	if(!skipSpace())
+		return false;
+
+	bool negative = false;
+	if( (*pos == '-') || (*pos == '+') )
+	{
+		negative = (*pos == '-');
+		++pos;
+	}
+
+	// Accumulate up to 19 significant digits, keeping track of the decimal exponent
+	unsigned long long mantissa = 0;
+	int exponent = 0, n_digits = 0, n_significant = 0;
+	for( ; (pos != end) && isDigit(*pos); ++pos, ++n_digits)
+	{
+		if(n_significant < 19)
+		{
+			mantissa = 10*mantissa + (*pos - '0');
+			if(mantissa > 0)
+				++n_significant;
+		}
+		else
+			++exponent;
+	}
+	if( (pos != end) && (*pos == '.') )
+	{
+		for(++pos; (pos != end) && isDigit(*pos); ++pos, ++n_digits)
+		{
+			if(n_significant < 19)
+			{
+				mantissa = 10*mantissa + (*pos - '0');
+				if(mantissa > 0)
+					++n_significant;
+				--exponent;
+			}
+		}
+	}
+	if(n_digits == 0)
+	{
+		if(pos == end)
+			eof_flag = true;
+		return false;
+	}
+
+	if( (pos != end) && ((*pos == 'e') || (*pos == 'E')) )
+	{
+		++pos;
+		int exponent_value;
+		if(!readInt(exponent_value))
+			return false;
+		exponent += exponent_value;
+	}
+	if(pos == end)
+		eof_flag = true;
+
+	double result = static_cast<double>(mantissa);
+	if( (exponent >= 0) && (exponent <= 22) )
+		result *= powers_of_ten[exponent];
+	else if( (exponent < 0) && (exponent >= -22) )
+		result /= powers_of_ten[-exponent];
+	else
+		result *= std::pow(10.0,exponent);
+
+	if(std::abs(result) > numeric_limits<float>::max())
+		return false;
+	value = static_cast<float>(negative ? -result : result);
+	return true;
+}
+
+
+bool TextParser::readWord(string& value)
+{
+	if(!skipSpace())
+		return false;
+	const char* word_start = pos;
+	while( (pos != end) && !isSpace(*pos) )
+		++pos;
+	if(pos == end)
+		eof_flag = true;
+	value.assign(word_start,pos);
+	return true;
+}
+
+
+bool TextParser::skipLine()
+{
+	TextParser line(pos,pos);
+	return nextLine(line);
+}
+
+
+bool TextParser::nextLine(TextParser& line)
+{
+	const char* line_start = pos;
+	while( (pos != end) && (*pos != '\n') )
+		++pos;
+	line = TextParser(line_start,pos);
+	if(pos == end)
+	{
+		eof_flag = true;
+		return false;
+	}
+	++pos;
+	return true;
+}
+
+} // end of namespace
@@ -0,0 +1,52 @@
+#ifndef TEXTPARSER_H
+#define TEXTPARSER_H
+
+#include <string>
+#include <vector>
+
+namespace thesisUtilities
+{
+	// Reads the contents of a whole file into a buffer, returns false if this fails
+	bool readWholeFile(const std::string& filename, std::vector<char>& buffer);
+
+	// A fast replacement for reading whitespace-separated values from a text file
+	// with the >> operators of an input stream. It works directly on a buffer
+	// holding the text and is not affected by the locale.
+	//
+	// The values accepted, and the way failures are reported, match the stream
+	// operators: whitespace (including newlines) before a value is skipped, bool
+	// values must be 0 or 1, and eof() becomes true when the end of the text is
+	// reached while looking for a value
+	class TextParser
+	{
+		public:
+			TextParser(const char* begin, const char* end);
+
+			bool readInt(int& value);
+			bool readBool(bool& value);
+			bool readFloat(float& value);
+			bool readWord(std::string& value);
+
+			// Skip to the start of the next line, like std::getline. Returns false if
+			// the end of the text was reached without finding a newline
+			bool skipLine();
+
+			// Get a parser for the rest of the current line and move on to the next,
+			// like std::getline. Returns false (like getline setting eof) if the end
+			// of the text was reached without finding a newline
+			bool nextLine(TextParser& line);
+
+			bool eof() const {return eof_flag;}
+			bool empty() const {return pos == end;}
+
+		private:
+			bool skipSpace();
+
+			const char* pos;
+			const char* end;
+			bool eof_flag;
+	};
+}
+
+// inclusion guard
+#endif
@@ -1,11 +1,17 @@
 #include "thesisUtilities.h"
+#include "binaryTracks.h"
+#include "textParser.h"
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <cmath>
+#include <algorithm>
 
 #define FRAME_RATE_DATABASE "frameratedatabase"
 
+// Ends the header line of structure track files written by propagate_structures
+#define AUTO_PROPAGATED_MARKER "(auto-propagated)"
+
 using namespace std;
 
 namespace thesisUtilities
@@ -50,196 +56,394 @@ float getFrameRate(string filename, string viddir)
 }
 
 
-bool readTrackFile(const string& filename, const int n_frames, bool& headup, int& radius, vector<bool>& labelled_track, vector<heartPresent_t>& heart_present_track,
-	               vector<int>&  centrey_track, vector<int>&  centrex_track, vector<int>&  ori_track, vector<int>&  view_label_track, vector<int>&  phase_point_track, vector<float>& cardiac_phase_track)
+// Read a binary heart track file into the same container as the text version
+static bool readBinaryTrackFile(const string& filename, const int n_frames, bool& headup, int& radius, HeartTrack& track)
 {
-	// Resize the arrays
-	labelled_track.resize(n_frames);
-	heart_present_track.resize(n_frames);
-	centrex_track.resize(n_frames);
-	centrey_track.resize(n_frames);
-	ori_track.resize(n_frames);
-	view_label_track.resize(n_frames);
-	phase_point_track.resize(n_frames);
-	cardiac_phase_track.resize(n_frames);
+	MappedHeartTrack mapped;
+	if(!mapped.open(filename))
+		return false;
 
-	ifstream infile(filename.c_str());
-	if (infile.is_open())
+	headup = mapped.headup();
+	radius = mapped.radius();
+
+	// Frames beyond the end of the file are marked as unlabelled
+	track = HeartTrack(n_frames);
+	const int n_stored = min(n_frames,mapped.frameCount());
+	copy_n(mapped.labelled(),n_stored,track.labelled());
+	for(int f = 0; f < n_stored; ++f)
+		track.present()[f] = heartPresent_t(mapped.present()[f]);
+	copy_n(mapped.centrey(),n_stored,track.centrey());
+	copy_n(mapped.centrex(),n_stored,track.centrex());
+	copy_n(mapped.orientation(),n_stored,track.orientation());
+	copy_n(mapped.viewLabel(),n_stored,track.viewLabel());
+	copy_n(mapped.phasePoint(),n_stored,track.phasePoint());
+	copy_n(mapped.cardiacPhase(),n_stored,track.cardiacPhase());
+	return true;
+}
+
+
+// Read a binary substructures track file into the same container as the text version
+static bool readBinarySubstructuresTrackFile(const string& filename, const int n_frames, vector<string>& structure_names, StructureTrack& track,
+                                             bool& auto_propagated)
+{
+	MappedStructureTrack mapped;
+	if(!mapped.open(filename))
+		return false;
+
+	auto_propagated = mapped.autoPropagated();
+
+	const int n_structures = mapped.structureCount();
+	structure_names.resize(n_structures);
+	for(int s = 0; s < n_structures; ++s)
+		structure_names[s] = mapped.structureName(s);
+
+	// Frames beyond the end of the file are marked as unlabelled
+	track.reset(n_frames,n_structures);
+	const int n_stored = min(n_frames,mapped.frameCount());
+	for(int s = 0; s < n_structures; ++s)
 	{
-		string dummy_string;
+		copy_n(mapped.labelled(s),n_stored,track.labelled(s));
+		copy_n(mapped.present(s),n_stored,track.present(s));
+		copy_n(mapped.y(s),n_stored,track.y(s));
+		copy_n(mapped.x(s),n_stored,track.x(s));
+		copy_n(mapped.orientation(s),n_stored,track.orientation(s));
+	}
+	return true;
+}
 
-		// Skip the first and second lines - a header line
-		// and video dimensions respectively
-		getline(infile,dummy_string);
-		getline(infile,dummy_string);
 
-		infile >> headup;
-		if(infile.fail())
-			return false;
+bool readTrackFile(const string& filename, const int n_frames, bool& headup, int& radius, HeartTrack& track)
+{
+	if(isBinaryTrackFile(filename))
+		return readBinaryTrackFile(filename,n_frames,headup,radius,track);
 
-		infile >> radius;
-		if(infile.fail())
-			return false;
+	track = HeartTrack(n_frames);
 
-		for(int f = 0; f < n_frames; f++)
+	// The whole file is read into memory and parsed in place, which is much
+	// faster than extracting each value from a stream
+	vector<char> buffer;
+	if(!readWholeFile(filename,buffer))
+		return false;
+	TextParser parser(buffer.data(),buffer.data()+buffer.size());
+
+	// Skip the first and second lines - a header line
+	// and video dimensions respectively
+	parser.skipLine();
+	parser.skipLine();
+
+	if(!parser.readBool(headup))
+		return false;
+
+	if(!parser.readInt(radius))
+		return false;
+
+	for(int f = 0; f < n_frames; f++)
+	{
+		int dummy_int;
+		if(!parser.readInt(dummy_int) || dummy_int != f)
 		{
-			int dummy_int;
-			infile >> dummy_int;
-			if(infile.fail() || dummy_int != f)
-			{
-				if(infile.eof()) // we've reached the end of the file before we expected to, mark the other frames as unlabelled
-				{
-					for(int l = f; l < n_frames; ++l)
-					{
-						labelled_track[l] = false;
-						heart_present_track[f] = hpNone;
-						centrey_track[l] = 0;
-						centrex_track[l] = 0;
-						ori_track[l] = 0;
-						view_label_track[l] = 0;
-						phase_point_track[l] = 0;
-						cardiac_phase_track[l] = 0;
-					}
-					break;
-				}
-				else
-					return false;
-			}
-
-			bool tempbool;
-			infile >> tempbool;
-			if(infile.fail())
+			// If we've reached the end of the file before we expected to, the
+			// other frames remain unlabelled
+			if(parser.eof())
+				break;
+			else
 				return false;
-			labelled_track[f] = tempbool;
+		}
 
-			infile >> dummy_int;
-			if(infile.fail())
-				return false;
-			heart_present_track[f] = heartPresent_t(dummy_int);
+		heartLabel_t label;
+		if(!parser.readBool(label.labelled))
+			return false;
 
-			infile >> centrey_track[f];
-			if(infile.fail())
-				return false;
+		if(!parser.readInt(dummy_int))
+			return false;
+		label.present = heartPresent_t(dummy_int);
 
-			infile >> centrex_track[f];
-			if(infile.fail())
-				return false;
+		if(!parser.readInt(label.centrey) || !parser.readInt(label.centrex) || !parser.readInt(label.ori) ||
+		   !parser.readInt(label.view_label) || !parser.readInt(label.phase_point) || !parser.readFloat(label.cardiac_phase))
+			return false;
 
-			infile >> ori_track[f];
-			if(infile.fail())
-				return false;
+		track.setFrame(f,label);
+	}
 
-			infile >> view_label_track[f];
-			if(infile.fail())
-				return false;
+	return true;
+}
+
+
+bool readSubstructuresTrackFile(const std::string& filename, const int n_frames, std::vector<std::string>& structure_names, StructureTrack& track)
+{
+	bool auto_propagated;
+	return readSubstructuresTrackFile(filename,n_frames,structure_names,track,auto_propagated);
+}
+
+
+bool readSubstructuresTrackFile(const std::string& filename, const int n_frames, std::vector<std::string>& structure_names, StructureTrack& track,
+                                bool& auto_propagated)
+{
+	if(isBinaryTrackFile(filename))
+		return readBinarySubstructuresTrackFile(filename,n_frames,structure_names,track,auto_propagated);
 
-			infile >> phase_point_track[f];
-			if(infile.fail())
+	vector<char> buffer;
+	if(!readWholeFile(filename,buffer))
+		return false;
+	TextParser parser(buffer.data(),buffer.data()+buffer.size());
+
+	// The first line is a header line, which may end with the auto-propagated marker
+	auto_propagated = false;
+	TextParser header_line(nullptr,nullptr);
+	parser.nextLine(header_line);
+	for(string word; header_line.readWord(word); )
+		auto_propagated = (word == AUTO_PROPAGATED_MARKER);
+
+	int n_structures;
+	if(!parser.readInt(n_structures) || n_structures < 0)
+		return false;
+
+	// Skip the rest of this line
+	parser.skipLine();
+
+	structure_names.resize(n_structures);
+
+	// Frames not in the file remain unlabelled
+	track.reset(n_frames,n_structures);
+
+	// Loop through the substructures
+	for(int s = 0; s < n_structures; ++s)
+	{
+		// Read in the first line with name and number
+		int dummy_int;
+		if(!parser.readInt(dummy_int))
+			return false;
+
+		// Check the structure number matches what we expected
+		if(dummy_int != s)
+			return false;
+
+		// Read in the name
+		if(!parser.readWord(structure_names[s]))
+			return false;
+
+		// Loop through frames
+		parser.skipLine();
+		int f = -1;
+		for(TextParser line(nullptr,nullptr); parser.nextLine(line) && !line.empty(); )
+		{
+			f++;
+			if(!line.readInt(dummy_int))
 				return false;
 
-			infile >> cardiac_phase_track[f];
-			if(infile.fail())
+			if(dummy_int != f)
 				return false;
 
+			// Lines beyond the expected number of frames are ignored
+			if(f >= n_frames)
+				continue;
+
+			subStructLabel_t label;
+			if(!line.readBool(label.labelled) || !line.readInt(label.present) || !line.readInt(label.y) ||
+			   !line.readInt(label.x) || !line.readInt(label.ori))
+				return false;
+			track.setLabel(f,s,label);
 		}
+	}
+	return true;
+}
 
-		infile.close();
 
-		return true;
-	}
-	else
+bool writeTrackFile(const string& filename, const int xsize, const int ysize, const bool headup, const int radius, HeartTrack& track)
+{
+	ofstream outfile(filename.c_str());
+	if (!outfile.is_open())
 		return false;
+
+	outfile << "# frame_no labelled present centrey centrex orientation view_label phasepoints cardiac_phase" << '\n';
+	outfile << xsize << " " << ysize << '\n';
+	outfile << headup << " " << radius << '\n';
+
+	for(int f = 0; f < track.frameCount(); f++)
+	{
+		heartLabel_t label = track.frame(f);
+		if(!label.labelled)
+		{
+			label.present = hpNone;
+			label.centrey = 0;
+			label.centrex = 0;
+			label.ori = 0;
+			label.view_label = 0;
+			track.setFrame(f,label);
+		}
+
+		outfile << f << " "
+				<< label.labelled << " "
+				<< int(label.present) << " "
+				<< label.centrey << " "
+				<< label.centrex << " "
+				<< label.ori << " "
+				<< label.view_label << " "
+				<< label.phase_point << " "
+				<< label.cardiac_phase <<
+				'\n';
+	}
+
+	outfile.close();
+	return !outfile.fail();
 }
 
 
-bool readSubstructuresTrackFile(const std::string& filename, const int n_frames, std::vector<std::string>& structure_names, std::vector<std::vector<subStructLabel_t>>& track)
+bool writeSubstructuresTrackFile(const string& filename, const int xsize, const int ysize, const vector<string>& structure_names,
+                                 const vector<vector<int>>& views_per_structure, const HeartTrack& heart_track,
+                                 StructureTrack& track, const bool auto_propagated)
 {
-	ifstream infile(filename.c_str());
-	if (infile.is_open())
+	ofstream outfile(filename.c_str());
+	if (!outfile.is_open())
+		return false;
+
+	const int n_structures = structure_names.size();
+	const int n_frames = track.frameCount();
+
+	outfile << "# frame_no labelled present y x orientation";
+	if(auto_propagated)
+		outfile << " " AUTO_PROPAGATED_MARKER;
+	outfile << '\n';
+	outfile << " " << n_structures << " " << xsize << " " << ysize << '\n' << '\n';
+
+	for (int s = 0; s < n_structures; ++s)
 	{
-		string dummy_string;
-		// Skip the first, header line
-		getline(infile,dummy_string);
+		const bool background = std::any_of(views_per_structure[s].cbegin(),views_per_structure[s].cend(),[](int v){return v == 0;});
+		uint8_t* const present = track.present(s);
+		const uint8_t* const labelled = track.labelled(s);
+		const int16_t* const y = track.y(s);
+		const int16_t* const x = track.x(s);
+		const int16_t* const ori = track.orientation(s);
+
+		outfile << s << " " << structure_names[s] << '\n';
+		for(int f = 0; f < n_frames; f++)
+		{
+			// Stipulate that substructures must be obscured if the whole heart is obscured
+			if(heart_track.present()[f] == hpObscured && present[f] == hpPresent && !background)
+				present[f] = hpObscured;
+
+			// Also ensure that any lablled locations that are off the edge of the image are
+			// marked as not present
+			if( (y[f] >= ysize) || (y[f] < 0) || (x[f] >= xsize) || (x[f] < 0) )
+				present[f] = hpNone;
+
+			outfile << f << " "
+					<< int(labelled[f]) << " "
+					<< int(present[f]) << " "
+					<< y[f] << " "
+					<< x[f] << " "
+					<< ori[f] <<
+					'\n';
+		}
+		outfile << '\n';
+	}
+	outfile.close();
+	return !outfile.fail();
+}
 
-		int n_structures;
-		infile >> n_structures;
-		if(infile.fail())
-			return false;
 
-		// Skip the rest of this line
-		getline(infile,dummy_string);
+bool readStructureList(const string& filename, vector<string>& structure_names, vector<vector<int>>& views_per_structure)
+{
+	ifstream structfile(filename.c_str());
+	if(!structfile.is_open())
+		return false;
 
-		structure_names.resize(n_structures);
+	structure_names.clear();
+	views_per_structure.clear();
+	for(string linestring; !getline(structfile,linestring).eof() && !linestring.empty(); )
+	{
+		stringstream ss(linestring);
+		string namestring;
+		ss >> namestring;
+		structure_names.emplace_back(namestring);
+		views_per_structure.emplace_back(vector<int>());
+
+		int fourier_order;
+		ss >> fourier_order;
+		bool systole_only;
+		ss >> systole_only; // FIXME currently not doing anything with this
+
+		for(int v; ss >> v; )
+			views_per_structure[structure_names.size()-1].emplace_back(v);
+	}
+	return true;
+}
 
-		track.resize(n_frames);
-		for(vector<subStructLabel_t>& v : track)
-			v.resize(n_structures);
 
-		// Loop through the substructures
-		for(int s = 0; s < n_structures; ++s)
-		{
-			// Read in the first line with name and number
-			int dummy_int;
-			infile >> dummy_int;
-			if(infile.fail())
-				return false;
+bool readViewLabels(const string& filename, const int n_frames, HeartTrack& track)
+{
+	int radius; bool headup;
+	if(!readTrackFile(filename, n_frames, headup, radius, track))
+		return false;
 
-			// Check the structure number matches what we expectedSize
-			if(dummy_int != s)
-				return false;
+	// Set frames where the heart is not present to the background class
+	for(int f = 0; f < n_frames; ++f)
+		if(track.present()[f] == hpNone)
+			track.viewLabel()[f] = 0;
 
-			// Read in the name
-			infile >> structure_names[s];
-			if(infile.fail())
-				return false;
+	return true;
+}
 
-			// Loop through frames
-			getline(infile,dummy_string);
-			int f = -1;
-			for(string linestring; !getline(infile,linestring).eof() && !linestring.empty(); )
-			{
-				f++;
-				stringstream ss(linestring);
-				ss >> dummy_int;
-				if(ss.fail())
-					return false;
-
-				if(dummy_int != f)
-					return false;
-
-				ss >> track[f][s].labelled;
-				if(ss.fail())
-					return false;
-				ss >> track[f][s].present;
-				if(ss.fail())
-					return false;
-				ss >> track[f][s].y;
-				if(ss.fail())
-					return false;
-				ss >> track[f][s].x;
-				if(ss.fail())
-					return false;
-				ss >> track[f][s].ori;
-				if(ss.fail())
-					return false;
-			}
-			// We do not have information on some of the frames at the end
-			// Mark them as unlabelled
-			while(f < n_frames - 1)
-			{
-				track[f][s].labelled = false;
-				track[f][s].present = 0;
-				track[f][s].y = -1;
-				track[f][s].x = -1;
-				track[f][s].ori = 0;
-				f++;
-			}
-		}
-		infile.close();
+
+bool scanTrackFile(const string& filename, int& xsize, int& ysize, int& n_frames)
+{
+	const string extension = filename.substr(min(filename.find_last_of('.'),filename.size()));
+	if(extension == BINARY_TRACK_EXTENSION)
+	{
+		MappedHeartTrack mapped;
+		if(!mapped.open(filename))
+			return false;
+		xsize = mapped.width();
+		ysize = mapped.height();
+		n_frames = mapped.frameCount();
 		return true;
 	}
-	else
+	if(extension == BINARY_STRUCTURE_TRACK_EXTENSION)
+	{
+		MappedStructureTrack mapped;
+		if(!mapped.open(filename))
+			return false;
+		xsize = mapped.width();
+		ysize = mapped.height();
+		n_frames = mapped.frameCount();
+		return true;
+	}
+
+	const bool structures = (extension == ".stk");
+	ifstream infile(filename.c_str());
+	if(!infile.is_open())
 		return false;
+
+	string linestring;
+	getline(infile,linestring); // header line
+	getline(infile,linestring);
+	stringstream ss(linestring);
+	if(structures)
+	{
+		int n_structures;
+		ss >> n_structures;
+	}
+	ss >> xsize >> ysize;
+	if(ss.fail())
+		return false;
+
+	n_frames = 0;
+	if(structures)
+	{
+		// Skip the blank line and the first structure's name
+		getline(infile,linestring);
+		getline(infile,linestring);
+		while(getline(infile,linestring) && !linestring.empty())
+			++n_frames;
+	}
+	else
+	{
+		getline(infile,linestring); // flip and radius
+		while(getline(infile,linestring))
+			if(!linestring.empty())
+				++n_frames;
+	}
+	return true;
 }
 
 } // end of namespace
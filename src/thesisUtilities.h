@@ -4,34 +4,59 @@
 #include <fstream>
 #include <vector>
 #include <string>
+#include "trackContainers.h"
+
+// View Codes
+#define VIEW_4CHAM 1
+#define VIEW_LVOT 2
+#define VIEW_RVOT 3
+#define VIEW_VSIGN 4
+
+// Labellings for cardiac phase points
+#define NOT_LABELLED 0
+#define AUTO_LABELLED_SYSTOLE 1
+#define MANUALLY_LABELLED_SYSTOLE 2
+#define AUTO_LABELLED_DIASTOLE 3
+#define MANUALLY_LABELLED_DIASTOLE 4
+#define SUGGESTED_SYSTOLE 5
+#define SUGGESTED_DIASTOLE 6
 
 namespace thesisUtilities
 {
-	enum heartPresent_t : unsigned char
-	{
-		hpNone = 0,
-		hpPresent,
-		hpObscured
-	};
-
-	// Struct representing all the annotation information for one substructure
-	struct subStructLabel_t
-	{
-		int x;
-		int y;
-		int ori;
-		int present;
-		bool labelled;
-		subStructLabel_t() : x(-1), y(-1), ori(0), present(0), labelled(false) {}
-	};
-
 	float getFrameRate(std::string filename,std::string viddir);
 
 
-	bool readTrackFile(const std::string& filename, const int n_frames, bool& headup, int& radius, std::vector<bool>& labelled_track, std::vector<heartPresent_t>& heart_present_track,
-		               std::vector<int>& centrey_track, std::vector<int>& centrex_track, std::vector<int>& ori_track, std::vector<int>& view_label_track, std::vector<int>& phase_point_track, std::vector<float>& cardiac_phase_track);
+	// The track file readers also accept the binary formats (see binaryTracks.h), chosen by the file extension.
+	// Frames missing from the end of a file are left unlabelled
+	bool readTrackFile(const std::string& filename, const int n_frames, bool& headup, int& radius, HeartTrack& track);
+
+	// Write a heart track file. Frames that are not labelled have their other values reset
+	bool writeTrackFile(const std::string& filename, const int xsize, const int ysize, const bool headup, const int radius, HeartTrack& track);
+
+	bool readSubstructuresTrackFile(const std::string& filename, const int n_frames, std::vector<std::string>& structure_names, StructureTrack& track);
+
+	// As above, also returning whether the file is marked as auto-propagated
+	bool readSubstructuresTrackFile(const std::string& filename, const int n_frames, std::vector<std::string>& structure_names, StructureTrack& track,
+	                                bool& auto_propagated);
+
+	// Write a substructures track file. Structures are marked obscured where the whole heart is obscured
+	// (unless they are background structures) and not present where they lie outside the image.
+	// If auto_propagated is set, the header line records that the labels were propagated automatically
+	bool writeSubstructuresTrackFile(const std::string& filename, const int xsize, const int ysize, const std::vector<std::string>& structure_names,
+	                                 const std::vector<std::vector<int>>& views_per_structure, const HeartTrack& heart_track,
+	                                 StructureTrack& track, const bool auto_propagated = false);
+
+	// Read a list of structures, with the views in which each appears
+	bool readStructureList(const std::string& filename, std::vector<std::string>& structure_names, std::vector<std::vector<int>>& views_per_structure);
+
+	// Read the view labels and heart presence from a heart track file, with the view
+	// label set to background (0) in frames where the heart is not present
+	bool readViewLabels(const std::string& filename, const int n_frames, HeartTrack& track);
 
-	bool readSubstructuresTrackFile(const std::string& filename, const int n_frames, std::vector<std::string>& structure_names, std::vector<std::vector<subStructLabel_t>>& track);
+	// Read the image dimensions and number of frames of a heart or structure track file
+	// in any of the formats (chosen by the file extension) without reading the labels.
+	// For a text structure track file, the frames of the first structure are counted
+	bool scanTrackFile(const std::string& filename, int& xsize, int& ysize, int& n_frames);
 
 }
 
@@ -0,0 +1,220 @@
+#include "tracing.h"
+#include <atomic>
+#include <mutex>
+#include <list>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <cstdio>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace thesisUtilities
+{
+
+// A completed span, with times in microseconds since tracing was enabled
+struct traceEvent_t
+{
+	const char* name;
+	int64_t start_us;
+	int64_t dur_us;
+};
+
+// The spans recorded by one thread. The lock is only contended while the trace is
+// being written out
+struct traceBuffer_t
+{
+	int tid;
+	mutex mtx;
+	vector<traceEvent_t> events;
+};
+
+static atomic<bool> tracing_enabled(false);
+static steady_clock::time_point trace_origin;
+static mutex buffers_mtx;
+static list<traceBuffer_t> buffers; // list so that buffers never move
+static thread_local traceBuffer_t* thread_buffer = nullptr;
+
+
+void enableTracing()
+{
+	lock_guard<mutex> lk(buffers_mtx);
+	if(!tracing_enabled)
+	{
+		trace_origin = steady_clock::now();
+		tracing_enabled = true;
+	}
+}
+
+
+bool tracingEnabled()
+{
+	return tracing_enabled.load(memory_order_acquire);
+}
+
+
+// Find (or create) the buffer of the calling thread
+static traceBuffer_t& threadBuffer()
+{
+	if(thread_buffer == nullptr)
+	{
+		lock_guard<mutex> lk(buffers_mtx);
+		buffers.emplace_back();
+		buffers.back().tid = buffers.size();
+		thread_buffer = &buffers.back();
+	}
+	return *thread_buffer;
+}
+
+
+TraceSpan::TraceSpan(const char* name, const bool start)
+: name(name), running(false)
+{
+	if(start)
+		begin();
+}
+
+
+void TraceSpan::begin()
+{
+	running = tracingEnabled();
+	if(running)
+		start_time = steady_clock::now();
+}
+
+
+void TraceSpan::end()
+{
+	// Spans that finish after the trace has been written are dropped
+	if(!running || !tracingEnabled())
+		return;
+	running = false;
+	const steady_clock::time_point end_time = steady_clock::now();
+	traceEvent_t event;
+	event.name = name;
+	event.start_us = duration_cast<microseconds>(start_time - trace_origin).count();
+	event.dur_us = duration_cast<microseconds>(end_time - start_time).count();
+	traceBuffer_t& buffer = threadBuffer();
+	lock_guard<mutex> lk(buffer.mtx);
+	buffer.events.push_back(event);
+}
+
+
+// Write a string as a JSON string literal
+static void writeJsonString(ostream& out, const char* s)
+{
+	out << '"';
+	for( ; *s != '\0'; ++s)
+	{
+		if( (*s == '"') || (*s == '\\') )
+			out << '\\';
+		out << *s;
+	}
+	out << '"';
+}
+
+
+bool writeChromeTrace(const string& filename)
+{
+	const string partial_name = filename + ".partial";
+	ofstream outfile(partial_name.c_str());
+	if(!outfile.is_open())
+		return false;
+
+	outfile << "{\"traceEvents\":[";
+	bool first = true;
+	lock_guard<mutex> lk(buffers_mtx);
+	for(traceBuffer_t& buffer : buffers)
+	{
+		lock_guard<mutex> buffer_lk(buffer.mtx);
+		for(const traceEvent_t& event : buffer.events)
+		{
+			outfile << (first ? "\n" : ",\n") << "{\"name\":";
+			writeJsonString(outfile,event.name);
+			outfile << ",\"ph\":\"X\",\"ts\":" << event.start_us << ",\"dur\":" << event.dur_us << ",\"pid\":1,\"tid\":" << buffer.tid << "}";
+			first = false;
+		}
+	}
+	outfile << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	outfile.close();
+	if(!outfile)
+	{
+		remove(partial_name.c_str());
+		return false;
+	}
+	return rename(partial_name.c_str(),filename.c_str()) == 0;
+}
+
+
+// Nearest-rank percentile of a sorted list
+static int64_t percentile(const vector<int64_t>& sorted, const double p)
+{
+	size_t rank = size_t(p*sorted.size() + 0.999999);
+	rank = min(max(rank,size_t(1)),sorted.size());
+	return sorted[rank-1];
+}
+
+
+void printTraceSummary(ostream& out)
+{
+	// Group durations by name (names are compared by content since the same
+	// literal may have different addresses in different translation units)
+	map<string,vector<int64_t>> durations;
+	{
+		lock_guard<mutex> lk(buffers_mtx);
+		for(traceBuffer_t& buffer : buffers)
+		{
+			lock_guard<mutex> buffer_lk(buffer.mtx);
+			for(const traceEvent_t& event : buffer.events)
+				durations[event.name].push_back(event.dur_us);
+		}
+	}
+
+	out << "Trace summary (milliseconds):" << endl;
+	out << left << setw(24) << "span" << right << setw(8) << "count" << setw(10) << "mean" << setw(10) << "p50"
+	    << setw(10) << "p95" << setw(10) << "p99" << setw(10) << "max" << endl;
+	out << fixed << setprecision(2);
+	for(auto& d : durations)
+	{
+		vector<int64_t>& times = d.second;
+		sort(times.begin(),times.end());
+		double total = 0.0;
+		for(const int64_t t : times)
+			total += t;
+		out << left << setw(24) << d.first << right << setw(8) << times.size()
+		    << setw(10) << total/times.size()/1000.0
+		    << setw(10) << percentile(times,0.50)/1000.0
+		    << setw(10) << percentile(times,0.95)/1000.0
+		    << setw(10) << percentile(times,0.99)/1000.0
+		    << setw(10) << times.back()/1000.0 << endl;
+	}
+	out.unsetf(ios::floatfield);
+}
+
+
+TraceSession::TraceSession(const string& filename)
+: filename(filename)
+{
+	if(!filename.empty())
+		enableTracing();
+}
+
+
+TraceSession::~TraceSession()
+{
+	if(filename.empty())
+		return;
+	tracing_enabled = false;
+	if(writeChromeTrace(filename))
+		cout << "Trace written to " << filename << endl;
+	else
+		cerr << "ERROR: Could not write trace file " << filename << endl;
+	printTraceSummary(cout);
+}
+
+} // end of namespace
@@ -0,0 +1,62 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <string>
+#include <ostream>
+#include <chrono>
+
+namespace thesisUtilities
+{
+	// Start recording spans. Until this is called, spans cost a single check of a flag
+	void enableTracing();
+	bool tracingEnabled();
+
+	// Times a named span of work on the current thread, from construction (or begin())
+	// until destruction (or end()). Each thread records into its own buffer so the
+	// threads do not contend with each other. The name must be a string literal (or
+	// otherwise outlive the trace) as only the pointer is kept
+	class TraceSpan
+	{
+		public:
+			explicit TraceSpan(const char* name, const bool start = true);
+			~TraceSpan() {end();}
+			TraceSpan(const TraceSpan&) = delete;
+			TraceSpan& operator=(const TraceSpan&) = delete;
+
+			// Start the span (again), discarding any unfinished run
+			void begin();
+
+			// Record the span if it has been started
+			void end();
+
+		private:
+			const char* name;
+			bool running;
+			std::chrono::steady_clock::time_point start_time;
+	};
+
+	// Write all recorded spans as a Chrome trace-event file (viewable in
+	// chrome://tracing or Perfetto), returns false if the file cannot be written
+	bool writeChromeTrace(const std::string& filename);
+
+	// Print the count, mean and p50/p95/p99/max durations of each span name
+	void printTraceSummary(std::ostream& out);
+
+	// Enables tracing for the lifetime of a program if given a file name, then
+	// writes the trace and prints the summary to stdout on destruction. An empty
+	// file name leaves tracing disabled
+	class TraceSession
+	{
+		public:
+			explicit TraceSession(const std::string& filename);
+
+			// Stops tracing before writing, so any spans still open are dropped
+			~TraceSession();
+
+		private:
+			std::string filename;
+	};
+}
+
+// inclusion guard
+#endif
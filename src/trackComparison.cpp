@@ -0,0 +1,122 @@
+#include "trackComparison.h"
+#include <vector>
+#include <cmath>
+#include "thesisUtilities.h"
+
+using namespace std;
+
+// Largest acceptable difference between cardiac phases
+const float C_PHASE_TOLERANCE = 1e-4;
+
+namespace thesisUtilities
+{
+
+// Check that two files are the same size and have the same number of frames
+static bool compareDimensions(const string& filename, const string& golden_filename, ostream& report, int& n_frames)
+{
+	int xsize, ysize, golden_xsize, golden_ysize, golden_n_frames;
+	if(!scanTrackFile(filename,xsize,ysize,n_frames))
+	{
+		report << "Could not read " << filename << endl;
+		return false;
+	}
+	if(!scanTrackFile(golden_filename,golden_xsize,golden_ysize,golden_n_frames))
+	{
+		report << "Could not read " << golden_filename << endl;
+		return false;
+	}
+	if( (xsize != golden_xsize) || (ysize != golden_ysize) || (n_frames != golden_n_frames) )
+	{
+		report << "Dimensions differ: " << xsize << "x" << ysize << " with " << n_frames << " frames, expected "
+		       << golden_xsize << "x" << golden_ysize << " with " << golden_n_frames << " frames" << endl;
+		return false;
+	}
+	return true;
+}
+
+
+bool compareTrackFiles(const string& filename, const string& golden_filename, ostream& report, const int max_reported)
+{
+	int n_frames;
+	if(!compareDimensions(filename,golden_filename,report,n_frames))
+		return false;
+
+	bool headup, golden_headup;
+	int radius, golden_radius;
+	HeartTrack track, golden_track;
+	if(!readTrackFile(filename,n_frames,headup,radius,track) || !readTrackFile(golden_filename,n_frames,golden_headup,golden_radius,golden_track))
+	{
+		report << "Could not read " << filename << " or " << golden_filename << endl;
+		return false;
+	}
+
+	bool match = true;
+	if( (headup != golden_headup) || (radius != golden_radius) )
+	{
+		report << "Header differs: headup " << headup << " radius " << radius << ", expected headup " << golden_headup << " radius " << golden_radius << endl;
+		match = false;
+	}
+
+	int n_differing = 0;
+	for(int f = 0; f < n_frames; ++f)
+	{
+		const heartLabel_t a = track.frame(f), b = golden_track.frame(f);
+		if( (a.labelled == b.labelled) && (a.present == b.present) && (a.centrey == b.centrey) && (a.centrex == b.centrex) && (a.ori == b.ori)
+		    && (a.view_label == b.view_label) && (a.phase_point == b.phase_point) && (std::fabs(a.cardiac_phase - b.cardiac_phase) <= C_PHASE_TOLERANCE) )
+			continue;
+		if(n_differing++ < max_reported)
+			report << "Frame " << f << ": labelled " << a.labelled << " present " << int(a.present) << " centre (" << a.centrex << "," << a.centrey << ") ori " << a.ori
+			       << " view " << a.view_label << " phase point " << a.phase_point << " phase " << a.cardiac_phase << ", expected labelled " << b.labelled
+			       << " present " << int(b.present) << " centre (" << b.centrex << "," << b.centrey << ") ori " << b.ori << " view " << b.view_label
+			       << " phase point " << b.phase_point << " phase " << b.cardiac_phase << endl;
+	}
+	if(n_differing > 0)
+	{
+		report << n_differing << " of " << n_frames << " frames differ" << endl;
+		match = false;
+	}
+	return match;
+}
+
+
+bool compareSubstructuresTrackFiles(const string& filename, const string& golden_filename, ostream& report, const int max_reported)
+{
+	int n_frames;
+	if(!compareDimensions(filename,golden_filename,report,n_frames))
+		return false;
+
+	vector<string> names, golden_names;
+	StructureTrack track, golden_track;
+	if(!readSubstructuresTrackFile(filename,n_frames,names,track) || !readSubstructuresTrackFile(golden_filename,n_frames,golden_names,golden_track))
+	{
+		report << "Could not read " << filename << " or " << golden_filename << endl;
+		return false;
+	}
+	if(names != golden_names)
+	{
+		report << "The structures differ from those of " << golden_filename << endl;
+		return false;
+	}
+
+	int n_differing = 0;
+	for(int s = 0; s < track.structureCount(); ++s)
+	{
+		for(int f = 0; f < n_frames; ++f)
+		{
+			const subStructLabel_t a = track.label(f,s), b = golden_track.label(f,s);
+			if( (a.labelled == b.labelled) && (a.present == b.present) && (a.x == b.x) && (a.y == b.y) && (a.ori == b.ori) )
+				continue;
+			if(n_differing++ < max_reported)
+				report << names[s] << " frame " << f << ": labelled " << a.labelled << " present " << a.present << " position (" << a.x << "," << a.y << ") ori " << a.ori
+				       << ", expected labelled " << b.labelled << " present " << b.present << " position (" << b.x << "," << b.y << ") ori " << b.ori << endl;
+		}
+	}
+	if(n_differing > 0)
+	{
+		report << n_differing << " of " << n_frames*track.structureCount() << " structure labels differ" << endl;
+		return false;
+	}
+	return true;
+}
+
+} // end of namespace
@@ -0,0 +1,22 @@
+#ifndef TRACKCOMPARISON_H
+#define TRACKCOMPARISON_H
+
+#include <string>
+#include <ostream>
+
+namespace thesisUtilities
+{
+	// Check that a heart track file (text or binary) holds the same labels as a
+	// golden track file, e.g. one produced by an earlier run of the same scripted
+	// session. The image size, headup flag, radius and every frame's labels must
+	// match (cardiac phases to within a small tolerance, to allow for the precision
+	// of text files). Up to max_reported differing frames are described in report
+	bool compareTrackFiles(const std::string& filename, const std::string& golden_filename, std::ostream& report, const int max_reported = 10);
+
+	// The same for structure track files (.stk/.stkb), where the structure names
+	// and every label of every structure must match
+	bool compareSubstructuresTrackFiles(const std::string& filename, const std::string& golden_filename, std::ostream& report, const int max_reported = 10);
+}
+
+// inclusion guard
+#endif
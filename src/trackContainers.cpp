@@ -0,0 +1,139 @@
+#include "trackContainers.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace thesisUtilities
+{
+
+HeartTrack::HeartTrack()
+: n_frames(0)
+{
+}
+
+
+HeartTrack::HeartTrack(const int n_frames)
+: n_frames(0)
+{
+	resize(n_frames);
+}
+
+
+void HeartTrack::resize(const int n_frames)
+{
+	const heartLabel_t unlabelled;
+	this->n_frames = n_frames;
+	labelled_col.resize(n_frames,unlabelled.labelled);
+	present_col.resize(n_frames,unlabelled.present);
+	centrey_col.resize(n_frames,unlabelled.centrey);
+	centrex_col.resize(n_frames,unlabelled.centrex);
+	ori_col.resize(n_frames,unlabelled.ori);
+	view_label_col.resize(n_frames,unlabelled.view_label);
+	phase_point_col.resize(n_frames,unlabelled.phase_point);
+	cardiac_phase_col.resize(n_frames,unlabelled.cardiac_phase);
+}
+
+
+heartLabel_t HeartTrack::frame(const int f) const
+{
+	heartLabel_t label;
+	label.labelled = labelled_col[f];
+	label.present = present_col[f];
+	label.centrey = centrey_col[f];
+	label.centrex = centrex_col[f];
+	label.ori = ori_col[f];
+	label.view_label = view_label_col[f];
+	label.phase_point = phase_point_col[f];
+	label.cardiac_phase = cardiac_phase_col[f];
+	return label;
+}
+
+
+void HeartTrack::setFrame(const int f, const heartLabel_t& label)
+{
+	labelled_col[f] = label.labelled;
+	present_col[f] = label.present;
+	centrey_col[f] = label.centrey;
+	centrex_col[f] = label.centrex;
+	ori_col[f] = label.ori;
+	view_label_col[f] = label.view_label;
+	phase_point_col[f] = label.phase_point;
+	cardiac_phase_col[f] = label.cardiac_phase;
+}
+
+
+StructureTrack::StructureTrack()
+: n_frames(0), n_structures(0)
+{
+}
+
+
+StructureTrack::StructureTrack(const int n_frames, const int n_structures)
+: n_frames(0), n_structures(0)
+{
+	reset(n_frames,n_structures);
+}
+
+
+void StructureTrack::reset(const int n_frames, const int n_structures)
+{
+	const subStructLabel_t unlabelled;
+	const size_t n = size_t(n_frames)*n_structures;
+	this->n_frames = n_frames;
+	this->n_structures = n_structures;
+	labelled_col.assign(n,unlabelled.labelled);
+	present_col.assign(n,unlabelled.present);
+	y_col.assign(n,unlabelled.y);
+	x_col.assign(n,unlabelled.x);
+	ori_col.assign(n,unlabelled.ori);
+}
+
+
+// Move each structure's values to their position for the new number of frames
+template<typename T>
+static void resizeColumns(vector<T>& column, const int old_frames, const int new_frames, const int n_structures, const T fill_value)
+{
+	vector<T> resized(size_t(new_frames)*n_structures,fill_value);
+	const int n_kept = min(old_frames,new_frames);
+	for(int s = 0; s < n_structures; ++s)
+		copy_n(column.cbegin() + size_t(s)*old_frames,n_kept,resized.begin() + size_t(s)*new_frames);
+	column.swap(resized);
+}
+
+
+void StructureTrack::resize(const int n_frames)
+{
+	const subStructLabel_t unlabelled;
+	resizeColumns<uint8_t>(labelled_col,this->n_frames,n_frames,n_structures,unlabelled.labelled);
+	resizeColumns<uint8_t>(present_col,this->n_frames,n_frames,n_structures,unlabelled.present);
+	resizeColumns<int16_t>(y_col,this->n_frames,n_frames,n_structures,unlabelled.y);
+	resizeColumns<int16_t>(x_col,this->n_frames,n_frames,n_structures,unlabelled.x);
+	resizeColumns<int16_t>(ori_col,this->n_frames,n_frames,n_structures,unlabelled.ori);
+	this->n_frames = n_frames;
+}
+
+
+subStructLabel_t StructureTrack::label(const int f, const int s) const
+{
+	const size_t i = offset(s) + f;
+	subStructLabel_t label;
+	label.labelled = labelled_col[i];
+	label.present = present_col[i];
+	label.y = y_col[i];
+	label.x = x_col[i];
+	label.ori = ori_col[i];
+	return label;
+}
+
+
+void StructureTrack::setLabel(const int f, const int s, const subStructLabel_t& label)
+{
+	const size_t i = offset(s) + f;
+	labelled_col[i] = label.labelled;
+	present_col[i] = label.present;
+	y_col[i] = label.y;
+	x_col[i] = label.x;
+	ori_col[i] = label.ori;
+}
+
+} // end of namespace
@@ -0,0 +1,133 @@
+#ifndef TRACKCONTAINERS_H
+#define TRACKCONTAINERS_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace thesisUtilities
+{
+	enum heartPresent_t : unsigned char
+	{
+		hpNone = 0,
+		hpPresent,
+		hpObscured
+	};
+
+	// Struct representing all the annotation information for one substructure
+	struct subStructLabel_t
+	{
+		int x;
+		int y;
+		int ori;
+		int present;
+		bool labelled;
+		subStructLabel_t() : x(-1), y(-1), ori(0), present(0), labelled(false) {}
+	};
+
+	// Struct representing all the annotation information for the heart in one frame
+	struct heartLabel_t
+	{
+		int centrey;
+		int centrex;
+		int ori;
+		int view_label;
+		int phase_point;
+		float cardiac_phase;
+		heartPresent_t present;
+		bool labelled;
+		heartLabel_t() : centrey(0), centrex(0), ori(0), view_label(0), phase_point(0), cardiac_phase(0.0), present(hpNone), labelled(false) {}
+	};
+
+	// The heart annotations of every frame of a video.
+	//
+	// Each variable is stored as a single contiguous column holding its value in every
+	// frame, using the smallest type that holds the range of values it takes (positions
+	// and orientations must fit in 16 bits). The columns may be used directly for scans
+	// over the video, or a whole frame may be read or written with frame()/setFrame()
+	class HeartTrack
+	{
+		public:
+			HeartTrack();
+			explicit HeartTrack(const int n_frames);
+
+			// Change the number of frames, any new frames are unlabelled
+			void resize(const int n_frames);
+			int frameCount() const {return n_frames;}
+
+			heartLabel_t frame(const int f) const;
+			void setFrame(const int f, const heartLabel_t& label);
+			void clearFrame(const int f) {setFrame(f,heartLabel_t());}
+
+			uint8_t* labelled() {return labelled_col.data();}
+			heartPresent_t* present() {return present_col.data();}
+			int16_t* centrey() {return centrey_col.data();}
+			int16_t* centrex() {return centrex_col.data();}
+			int16_t* orientation() {return ori_col.data();}
+			uint8_t* viewLabel() {return view_label_col.data();}
+			uint8_t* phasePoint() {return phase_point_col.data();}
+			float* cardiacPhase() {return cardiac_phase_col.data();}
+
+			const uint8_t* labelled() const {return labelled_col.data();}
+			const heartPresent_t* present() const {return present_col.data();}
+			const int16_t* centrey() const {return centrey_col.data();}
+			const int16_t* centrex() const {return centrex_col.data();}
+			const int16_t* orientation() const {return ori_col.data();}
+			const uint8_t* viewLabel() const {return view_label_col.data();}
+			const uint8_t* phasePoint() const {return phase_point_col.data();}
+			const float* cardiacPhase() const {return cardiac_phase_col.data();}
+
+		private:
+			int n_frames;
+			std::vector<uint8_t> labelled_col, view_label_col, phase_point_col;
+			std::vector<heartPresent_t> present_col;
+			std::vector<int16_t> centrey_col, centrex_col, ori_col;
+			std::vector<float> cardiac_phase_col;
+	};
+
+	// The substructure annotations of every frame of a video.
+	//
+	// Each variable is stored as a single contiguous array, within which all the frames
+	// of one structure are adjacent. The column accessors return the start of a given
+	// structure's values, which may be indexed by frame. A single label may be read or
+	// written with label()/setLabel()
+	class StructureTrack
+	{
+		public:
+			StructureTrack();
+			StructureTrack(const int n_frames, const int n_structures);
+
+			// Change the dimensions, all labels are reset to unlabelled
+			void reset(const int n_frames, const int n_structures);
+			// Change the number of frames, keeping the existing labels. Any new frames are unlabelled
+			void resize(const int n_frames);
+			int frameCount() const {return n_frames;}
+			int structureCount() const {return n_structures;}
+
+			subStructLabel_t label(const int f, const int s) const;
+			void setLabel(const int f, const int s, const subStructLabel_t& label);
+			void clearLabel(const int f, const int s) {setLabel(f,s,subStructLabel_t());}
+
+			uint8_t* labelled(const int s) {return labelled_col.data() + offset(s);}
+			uint8_t* present(const int s) {return present_col.data() + offset(s);}
+			int16_t* y(const int s) {return y_col.data() + offset(s);}
+			int16_t* x(const int s) {return x_col.data() + offset(s);}
+			int16_t* orientation(const int s) {return ori_col.data() + offset(s);}
+
+			const uint8_t* labelled(const int s) const {return labelled_col.data() + offset(s);}
+			const uint8_t* present(const int s) const {return present_col.data() + offset(s);}
+			const int16_t* y(const int s) const {return y_col.data() + offset(s);}
+			const int16_t* x(const int s) const {return x_col.data() + offset(s);}
+			const int16_t* orientation(const int s) const {return ori_col.data() + offset(s);}
+
+		private:
+			size_t offset(const int s) const {return size_t(s)*n_frames;}
+
+			int n_frames, n_structures;
+			std::vector<uint8_t> labelled_col, present_col;
+			std::vector<int16_t> y_col, x_col, ori_col;
+	};
+}
+
+// inclusion guard
+#endif
@@ -0,0 +1,415 @@
+#include "trackIndex.h"
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <boost/filesystem.hpp>
+#include "thesisUtilities.h"
+#include "binaryTracks.h"
+#include "textParser.h"
+#include "cacheFiles.h"
+#include "batchJobs.h"
+
+// Index file format
+#define TRACK_INDEX_MAGIC "HAINDEX\0"
+#define TRACK_INDEX_VERSION 1
+#define TRACK_INDEX_TEMP_EXTENSION ".tmp"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace thesisUtilities
+{
+
+template<typename T>
+static void writeValue(ofstream& outfile, const T value)
+{
+	outfile.write(reinterpret_cast<const char*>(&value),sizeof(value));
+}
+
+static void writeString(ofstream& outfile, const string& str)
+{
+	writeValue<uint32_t>(outfile,str.size());
+	outfile.write(str.data(),str.size());
+}
+
+static void writeRanges(ofstream& outfile, const vector<frameRange_t>& ranges)
+{
+	writeValue<uint32_t>(outfile,ranges.size());
+	for(const frameRange_t& range : ranges)
+	{
+		writeValue<int32_t>(outfile,range.first);
+		writeValue<int32_t>(outfile,range.second);
+	}
+}
+
+static void writeFile(ofstream& outfile, const indexedFile_t& file)
+{
+	writeString(outfile,file.path);
+	writeValue<int64_t>(outfile,file.size);
+	writeValue<int64_t>(outfile,file.mtime);
+}
+
+
+// Reads values from the buffer holding an index file, failing (and staying failed)
+// if the end of the buffer is reached
+class IndexReader
+{
+	public:
+		IndexReader(const char* begin, const char* end) : pos(begin), end(end), ok(true) {}
+
+		template<typename T>
+		T value()
+		{
+			T v = T();
+			if(ok && (size_t(end - pos) >= sizeof(T)))
+			{
+				memcpy(&v,pos,sizeof(T));
+				pos += sizeof(T);
+			}
+			else
+				ok = false;
+			return v;
+		}
+
+		string str()
+		{
+			const uint32_t length = value<uint32_t>();
+			if(!ok || (size_t(end - pos) < length))
+			{
+				ok = false;
+				return string();
+			}
+			pos += length;
+			return string(pos-length,length);
+		}
+
+		void ranges(vector<frameRange_t>& ranges)
+		{
+			const uint32_t n_ranges = value<uint32_t>();
+			if(!ok || (size_t(end - pos)/(2*sizeof(int32_t)) < n_ranges))
+			{
+				ok = false;
+				return;
+			}
+			ranges.resize(n_ranges);
+			for(frameRange_t& range : ranges)
+			{
+				range.first = value<int32_t>();
+				range.second = value<int32_t>();
+			}
+		}
+
+		void file(indexedFile_t& file)
+		{
+			file.path = str();
+			file.size = value<int64_t>();
+			file.mtime = value<int64_t>();
+		}
+
+		bool good() const {return ok;}
+		bool atEnd() const {return pos == end;}
+
+	private:
+		const char* pos;
+		const char* end;
+		bool ok;
+};
+
+
+bool TrackIndex::read(const string& filename)
+{
+	video_list.clear();
+	vector<char> buffer;
+	if(!readWholeFile(filename,buffer) || (buffer.size() < 8) || (memcmp(buffer.data(),TRACK_INDEX_MAGIC,8) != 0))
+		return false;
+
+	IndexReader reader(buffer.data()+8,buffer.data()+buffer.size());
+	if(reader.value<uint32_t>() != TRACK_INDEX_VERSION)
+		return false;
+
+	const uint32_t n_videos = reader.value<uint32_t>();
+	for(uint32_t i = 0; (i < n_videos) && reader.good(); ++i)
+	{
+		indexedVideo_t video;
+		video.name = reader.str();
+		reader.file(video.heart_file);
+		reader.file(video.structure_file);
+		video.n_frames = reader.value<int32_t>();
+		video.n_labelled = reader.value<int32_t>();
+		for(int v = 0; v < INDEX_N_VIEWS; ++v)
+		{
+			video.n_view[v] = reader.value<int32_t>();
+			reader.ranges(video.view_ranges[v]);
+		}
+		const uint32_t n_structures = reader.value<uint32_t>();
+		for(uint32_t s = 0; (s < n_structures) && reader.good(); ++s)
+		{
+			video.structures.emplace_back();
+			indexedStructure_t& structure = video.structures.back();
+			structure.name = reader.str();
+			structure.n_labelled = reader.value<int32_t>();
+			for(int v = 0; v < INDEX_N_VIEWS; ++v)
+			{
+				structure.n_visible[v] = reader.value<int32_t>();
+				reader.ranges(structure.visible_ranges[v]);
+			}
+		}
+		video_list.emplace_back(move(video));
+	}
+
+	if(!reader.good() || !reader.atEnd())
+	{
+		video_list.clear();
+		return false;
+	}
+	return true;
+}
+
+
+bool TrackIndex::write(const string& filename) const
+{
+	const string temp_filename = filename + TRACK_INDEX_TEMP_EXTENSION;
+	{
+		ofstream outfile(temp_filename.c_str(),ios::binary|ios::trunc);
+		if(!outfile.is_open())
+			return false;
+
+		outfile.write(TRACK_INDEX_MAGIC,8);
+		writeValue<uint32_t>(outfile,TRACK_INDEX_VERSION);
+		writeValue<uint32_t>(outfile,video_list.size());
+		for(const indexedVideo_t& video : video_list)
+		{
+			writeString(outfile,video.name);
+			writeFile(outfile,video.heart_file);
+			writeFile(outfile,video.structure_file);
+			writeValue<int32_t>(outfile,video.n_frames);
+			writeValue<int32_t>(outfile,video.n_labelled);
+			for(int v = 0; v < INDEX_N_VIEWS; ++v)
+			{
+				writeValue<int32_t>(outfile,video.n_view[v]);
+				writeRanges(outfile,video.view_ranges[v]);
+			}
+			writeValue<uint32_t>(outfile,video.structures.size());
+			for(const indexedStructure_t& structure : video.structures)
+			{
+				writeString(outfile,structure.name);
+				writeValue<int32_t>(outfile,structure.n_labelled);
+				for(int v = 0; v < INDEX_N_VIEWS; ++v)
+				{
+					writeValue<int32_t>(outfile,structure.n_visible[v]);
+					writeRanges(outfile,structure.visible_ranges[v]);
+				}
+			}
+		}
+		if(!outfile.good())
+			return false;
+	}
+
+	boost::system::error_code ec;
+	fs::rename(temp_filename,filename,ec);
+	return !ec;
+}
+
+
+static bool sameFile(const indexedFile_t& a, const indexedFile_t& b)
+{
+	return (a.path == b.path) && (a.size == b.size) && (a.mtime == b.mtime);
+}
+
+
+void findVideoTrackFiles(const string& heart_dir, const string& structure_dir, vector<videoTrackFiles_t>& videos, vector<string>& failed)
+{
+	map<string,videoTrackFiles_t> found;
+	const auto scan = [&](const string& dir, const string& text_extension, const string& binary_extension, const bool heart)
+	{
+		if(dir.empty())
+			return;
+		boost::system::error_code ec;
+		for(fs::directory_iterator it(dir,ec), end; !ec && (it != end); it.increment(ec))
+		{
+			const fs::path& path = it->path();
+			const string extension = path.extension().string();
+			if( !fs::is_regular_file(path) || ( (extension != text_extension) && (extension != binary_extension) ) )
+				continue;
+
+			const videoIdentity_t identity = videoIdentity(path.string());
+			videoTrackFiles_t& video = found[path.stem().string()];
+			indexedFile_t& file = heart ? video.heart_file : video.structure_file;
+			if(file.path.empty() || (identity.mtime > file.mtime))
+			{
+				file.path = identity.path;
+				file.size = identity.size;
+				file.mtime = identity.mtime;
+			}
+		}
+		if(ec)
+			failed.emplace_back(dir);
+	};
+	scan(heart_dir,".tk",BINARY_TRACK_EXTENSION,true);
+	scan(structure_dir,".stk",BINARY_STRUCTURE_TRACK_EXTENSION,false);
+
+	videos.clear();
+	videos.reserve(found.size());
+	for(auto& entry : found)
+	{
+		entry.second.name = entry.first;
+		videos.emplace_back(move(entry.second));
+	}
+}
+
+
+int TrackIndex::update(const string& heart_dir, const string& structure_dir, const int n_threads, vector<string>& failed)
+{
+	vector<videoTrackFiles_t> found;
+	findVideoTrackFiles(heart_dir,structure_dir,found,failed);
+
+	// Keep the entries of videos whose files have not changed, and index the rest again
+	vector<indexedVideo_t> new_list;
+	new_list.reserve(found.size());
+	vector<size_t> jobs;
+	for(const videoTrackFiles_t& files : found)
+	{
+		const auto old = lower_bound(video_list.cbegin(),video_list.cend(),files.name,
+		                             [](const indexedVideo_t& video, const string& name) {return video.name < name;});
+		if( (old != video_list.cend()) && (old->name == files.name) &&
+		    sameFile(old->heart_file,files.heart_file) && sameFile(old->structure_file,files.structure_file) )
+			new_list.emplace_back(*old);
+		else
+		{
+			jobs.emplace_back(new_list.size());
+			new_list.emplace_back();
+			new_list.back().name = files.name;
+			new_list.back().heart_file = files.heart_file;
+			new_list.back().structure_file = files.structure_file;
+		}
+	}
+
+	// Each thread indexes whole videos. The results are kept one byte per job, so
+	// that threads never write to the same element
+	vector<char> succeeded(jobs.size(),false);
+	runJobs(n_threads,jobs.size(),[&](const size_t j) -> bool
+	{
+		indexedVideo_t& video = new_list[jobs[j]];
+		succeeded[j] = indexVideo(video.name,video.heart_file,video.structure_file,video);
+		return bool(succeeded[j]);
+	});
+
+	// Leave out any videos that could not be indexed
+	int n_indexed = 0;
+	vector<bool> keep(new_list.size(),true);
+	for(size_t j = 0; j < jobs.size(); ++j)
+	{
+		if(succeeded[j])
+			++n_indexed;
+		else
+		{
+			keep[jobs[j]] = false;
+			const indexedVideo_t& video = new_list[jobs[j]];
+			failed.emplace_back(video.heart_file.path.empty() ? video.structure_file.path : video.heart_file.path);
+		}
+	}
+	video_list.clear();
+	for(size_t i = 0; i < new_list.size(); ++i)
+		if(keep[i])
+			video_list.emplace_back(move(new_list[i]));
+
+	return n_indexed;
+}
+
+
+// Add a frame to the end of a list of ranges, extending the last range if possible
+static void addFrame(vector<frameRange_t>& ranges, const int f)
+{
+	if(!ranges.empty() && (ranges.back().second == f))
+		++ranges.back().second;
+	else
+		ranges.emplace_back(f,f+1);
+}
+
+
+bool indexVideo(const string& name, const indexedFile_t& heart_file, const indexedFile_t& structure_file, indexedVideo_t& video)
+{
+	int xsize, ysize, n_heart_frames = 0, n_structure_frames = 0;
+	HeartTrack heart_track;
+	if(!heart_file.path.empty())
+	{
+		bool headup;
+		int radius;
+		if(!scanTrackFile(heart_file.path,xsize,ysize,n_heart_frames) || !readTrackFile(heart_file.path,n_heart_frames,headup,radius,heart_track))
+			return false;
+	}
+	vector<string> structure_names;
+	StructureTrack structure_track;
+	if(!structure_file.path.empty())
+	{
+		if(!scanTrackFile(structure_file.path,xsize,ysize,n_structure_frames) ||
+		   !readSubstructuresTrackFile(structure_file.path,n_structure_frames,structure_names,structure_track))
+			return false;
+	}
+
+	// Filled in separately, as the arguments may be fields of the video being replaced
+	indexedVideo_t result;
+	result.name = name;
+	result.heart_file = heart_file;
+	result.structure_file = structure_file;
+	result.n_frames = max(n_heart_frames,n_structure_frames);
+	result.n_labelled = 0;
+	fill_n(result.n_view,INDEX_N_VIEWS,0);
+
+	// The view of each frame, background where the heart is not present or not labelled
+	vector<uint8_t> views(result.n_frames,0);
+	for(int f = 0; f < n_heart_frames; ++f)
+	{
+		if(!heart_track.labelled()[f])
+			continue;
+		const int view_label = heart_track.viewLabel()[f];
+		const int view = ( (heart_track.present()[f] != hpNone) && (view_label > 0) && (view_label < INDEX_N_VIEWS) ) ? view_label : 0;
+		views[f] = view;
+		++result.n_labelled;
+		++result.n_view[view];
+		addFrame(result.view_ranges[view],f);
+	}
+
+	result.structures.resize(structure_track.structureCount());
+	for(int s = 0; s < structure_track.structureCount(); ++s)
+	{
+		indexedStructure_t& structure = result.structures[s];
+		structure.name = structure_names[s];
+		structure.n_labelled = 0;
+		fill_n(structure.n_visible,INDEX_N_VIEWS,0);
+		for(int f = 0; f < n_structure_frames; ++f)
+		{
+			if(!structure_track.labelled(s)[f])
+				continue;
+			++structure.n_labelled;
+			if(structure_track.present(s)[f] == hpPresent)
+			{
+				++structure.n_visible[views[f]];
+				addFrame(structure.visible_ranges[views[f]],f);
+			}
+		}
+	}
+
+	video = move(result);
+	return true;
+}
+
+
+void mergeFrameRanges(const vector<frameRange_t>& a, const vector<frameRange_t>& b, vector<frameRange_t>& merged)
+{
+	vector<frameRange_t> all;
+	all.reserve(a.size() + b.size());
+	merge(a.cbegin(),a.cend(),b.cbegin(),b.cend(),back_inserter(all));
+
+	merged.clear();
+	for(const frameRange_t& range : all)
+	{
+		if(!merged.empty() && (range.first <= merged.back().second))
+			merged.back().second = max(merged.back().second,range.second);
+		else
+			merged.emplace_back(range);
+	}
+}
+
+} // end of namespace
@@ -0,0 +1,107 @@
+#ifndef TRACKINDEX_H
+#define TRACKINDEX_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+// Views recorded in the index, from background (0) to VIEW_VSIGN
+#define INDEX_N_VIEWS 5
+
+namespace thesisUtilities
+{
+	// A run of consecutive frames [first,last)
+	typedef std::pair<int32_t,int32_t> frameRange_t;
+
+	// A track file as it was when it was indexed (path empty if there is none)
+	struct indexedFile_t
+	{
+		std::string path;
+		int64_t size;
+		int64_t mtime;
+		indexedFile_t() : size(0), mtime(0) {}
+	};
+
+	// The track files of one video, identified by their stem
+	struct videoTrackFiles_t
+	{
+		std::string name;
+		indexedFile_t heart_file, structure_file;
+	};
+
+	// The frames in which one structure is labelled as visible. These are divided by
+	// the view label of the heart track in the same frame, which is background (0) if
+	// the heart is not present or not labelled
+	struct indexedStructure_t
+	{
+		std::string name;
+		int32_t n_labelled;
+		int32_t n_visible[INDEX_N_VIEWS];
+		std::vector<frameRange_t> visible_ranges[INDEX_N_VIEWS];
+	};
+
+	// Summary of the labels of one video: the labelled frames of the heart track by
+	// view (frames in which the heart is not present count as background), and the
+	// visible frames of each structure
+	struct indexedVideo_t
+	{
+		std::string name;
+		indexedFile_t heart_file, structure_file;
+		int32_t n_frames, n_labelled;
+		int32_t n_view[INDEX_N_VIEWS];
+		std::vector<frameRange_t> view_ranges[INDEX_N_VIEWS];
+		std::vector<indexedStructure_t> structures;
+	};
+
+	// An index of the labels in a collection of track files, so that questions about
+	// the whole dataset can be answered without parsing every track file.
+	//
+	// The index is kept in a single binary file: an 8-byte magic string and a uint32
+	// version, followed by the number of videos (uint32) and each video in turn. Strings
+	// are stored as a uint32 length followed by the characters, and lists of ranges as
+	// a uint32 count followed by the (int32 first, int32 last) pairs. The field order is
+	// that of indexedVideo_t, with each structure's fields in the order of
+	// indexedStructure_t.
+	//
+	// Videos are identified by the stem of their track files. An update only parses
+	// the track files whose size or modification time has changed since they were
+	// indexed, spreading them over several threads.
+	class TrackIndex
+	{
+		public:
+			// Read an index file, returns false if it does not exist or is not valid
+			// (leaving the index empty)
+			bool read(const std::string& filename);
+
+			// Write the index file, replacing it once the new one is complete
+			bool write(const std::string& filename) const;
+
+			// Bring the index up to date with the heart (.tk/.tkb) and structure
+			// (.stk/.stkb) track files in two directories (either may be empty).
+			// Videos whose track files no longer exist are removed. Returns the number
+			// of videos that were indexed again, and lists the files that could not be read
+			int update(const std::string& heart_dir, const std::string& structure_dir, const int n_threads, std::vector<std::string>& failed);
+
+			// The indexed videos, in order of name
+			const std::vector<indexedVideo_t>& videos() const {return video_list;}
+
+		private:
+			std::vector<indexedVideo_t> video_list;
+	};
+
+	// Find the heart (.tk/.tkb) and structure (.stk/.stkb) track files in two directories
+	// (either may be empty), in order of name. If a video has both a text and a binary
+	// track file of the same kind, the more recently modified one is used. Directories
+	// that cannot be read are added to failed
+	void findVideoTrackFiles(const std::string& heart_dir, const std::string& structure_dir, std::vector<videoTrackFiles_t>& videos, std::vector<std::string>& failed);
+
+	// Index the track files of one video (either file name may be empty)
+	bool indexVideo(const std::string& name, const indexedFile_t& heart_file, const indexedFile_t& structure_file, indexedVideo_t& video);
+
+	// Merge two sorted lists of frame ranges
+	void mergeFrameRanges(const std::vector<frameRange_t>& a, const std::vector<frameRange_t>& b, std::vector<frameRange_t>& merged);
+}
+
+// inclusion guard
+#endif
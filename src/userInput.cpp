@@ -0,0 +1,201 @@
+#include "userInput.h"
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include "opencvkeys.h"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace thesisUtilities
+{
+
+UserInput::UserInput()
+: on_mouse(nullptr), replay_mode(false), script_exhausted(false), step_running(false), next_event(0)
+{
+}
+
+
+bool UserInput::replay(const string& script_filename)
+{
+	ifstream infile(script_filename.c_str());
+	if(!infile.is_open())
+	{
+		cerr << "ERROR: Could not open input script " << script_filename << endl;
+		return false;
+	}
+
+	events.clear();
+	string line;
+	for(int line_number = 1; getline(infile,line); ++line_number)
+	{
+		stringstream ss(line);
+		string type;
+		if(!(ss >> type) || (type[0] == '#'))
+			continue;
+
+		inputEvent_t event;
+		event.line = line_number;
+		event.key = -1;
+		event.mouse_event = event.x = event.y = event.flags = 0;
+		bool valid;
+		if(type == "key")
+		{
+			event.is_mouse = false;
+			valid = bool(ss >> event.key);
+		}
+		else if(type == "mouse")
+		{
+			event.is_mouse = true;
+			valid = bool(ss >> event.mouse_event >> event.x >> event.y >> event.flags);
+		}
+		else
+			valid = false;
+
+		string extra;
+		if(!valid || (ss >> extra))
+		{
+			cerr << "ERROR: Could not parse line " << line_number << " of input script " << script_filename << ": " << line << endl;
+			return false;
+		}
+		events.emplace_back(event);
+	}
+
+	replay_mode = true;
+	next_event = 0;
+	step_ms.clear();
+	step_ms.reserve(events.size());
+	return true;
+}
+
+
+bool UserInput::record(const string& script_filename)
+{
+	record_file.open(script_filename.c_str());
+	if(!record_file.is_open())
+	{
+		cerr << "ERROR: Could not open input script " << script_filename << " for writing" << endl;
+		return false;
+	}
+	record_file << "# key <code> | mouse <event> <x> <y> <flags>" << endl;
+	return true;
+}
+
+
+void UserInput::openWindow(const string& name, cv::MouseCallback on_mouse)
+{
+	window_name = name;
+	this->on_mouse = on_mouse;
+	if(replay_mode)
+		return;
+	cv::namedWindow(window_name,cv::WINDOW_AUTOSIZE);
+	if(on_mouse != nullptr)
+		cv::setMouseCallback(window_name,&UserInput::mouseCallback,this);
+}
+
+
+void UserInput::show(const cv::Mat& image)
+{
+	if(!replay_mode)
+		cv::imshow(window_name,image);
+}
+
+
+// Pass live mouse events on to the tool, recording them if needed
+void UserInput::mouseCallback(int event, int x, int y, int flags, void* userdata)
+{
+	UserInput* input = static_cast<UserInput*>(userdata);
+	if(input->record_file.is_open() && (event != cv::EVENT_MOUSEMOVE))
+		input->record_file << "mouse " << event << " " << x << " " << y << " " << flags << endl;
+	input->on_mouse(event,x,y,flags,nullptr);
+}
+
+
+// Record the duration of the current replayed event
+void UserInput::finishStep()
+{
+	if(!step_running)
+		return;
+	step_ms.push_back(duration<double,milli>(steady_clock::now() - step_start).count());
+	step_running = false;
+}
+
+
+int UserInput::waitKey()
+{
+	if(!replay_mode)
+	{
+		const int key = cv::waitKey(0);
+		if(record_file.is_open())
+			record_file << "key " << key << endl;
+		return key;
+	}
+
+	finishStep();
+	for( ; next_event < events.size(); ++next_event)
+	{
+		const inputEvent_t& event = events[next_event];
+		step_start = steady_clock::now();
+		step_running = true;
+		if(!event.is_mouse)
+		{
+			++next_event;
+			return event.key;
+		}
+		if(on_mouse != nullptr)
+			on_mouse(event.mouse_event,event.x,event.y,event.flags,nullptr);
+		finishStep();
+	}
+
+	if(!script_exhausted)
+		cerr << "ERROR: The input script ended before the session did, quitting without saving" << endl;
+	script_exhausted = true;
+	return Q_KEY;
+}
+
+
+void UserInput::endSession()
+{
+	finishStep();
+	if(replay_mode && (next_event < events.size()))
+		cerr << "WARNING: The session ended before the input script did, " << events.size() - next_event << " events were not used" << endl;
+}
+
+
+void UserInput::reportStepTimes(ostream& out) const
+{
+	if(step_ms.empty())
+		return;
+	vector<double> sorted = step_ms;
+	sort(sorted.begin(),sorted.end());
+	double total = 0.0;
+	for(const double t : sorted)
+		total += t;
+	const size_t p95_rank = min(size_t(0.95*sorted.size() + 0.999999),sorted.size());
+	out << fixed << setprecision(2) << "Replayed " << sorted.size() << " input events in " << total << " ms (median "
+	    << sorted[(sorted.size()-1)/2] << " ms, p95 " << sorted[max(p95_rank,size_t(1))-1] << " ms, max " << sorted.back() << " ms)" << endl;
+	out.unsetf(ios::floatfield);
+}
+
+
+bool UserInput::writeStepTimes(const string& filename) const
+{
+	ofstream outfile(filename.c_str());
+	if(!outfile.is_open())
+		return false;
+	outfile << setprecision(6);
+	for(size_t e = 0; e < step_ms.size(); ++e)
+	{
+		const inputEvent_t& event = events[e];
+		outfile << "{\"step\":" << e << ",\"line\":" << event.line;
+		if(event.is_mouse)
+			outfile << ",\"type\":\"mouse\",\"event\":" << event.mouse_event << ",\"x\":" << event.x << ",\"y\":" << event.y;
+		else
+			outfile << ",\"type\":\"key\",\"key\":" << event.key;
+		outfile << ",\"ms\":" << step_ms[e] << "}" << endl;
+	}
+	return outfile.good();
+}
+
+} // end of namespace
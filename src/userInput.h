@@ -0,0 +1,96 @@
+#ifndef USERINPUT_H
+#define USERINPUT_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <fstream>
+#include <chrono>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+namespace thesisUtilities
+{
+	// One event of an input script: a key press, or a mouse event delivered to the
+	// window's mouse callback
+	struct inputEvent_t
+	{
+		bool is_mouse;
+		int key;
+		int mouse_event, x, y, flags;
+		int line; // line of the script file
+	};
+
+	// The display window of an annotation tool together with its source of key
+	// presses and mouse events.
+	//
+	// Normally this is an OpenCV window, and the events of a session may be recorded
+	// to a script file. Alternatively the events of a script may be replayed without
+	// opening a window, so that a whole annotation session can be run (and timed)
+	// without a display or anyone at the keyboard.
+	//
+	// A script is a text file with one event per line:
+	//   key <code>                     a key code as returned by cv::waitKey (see opencvkeys.h)
+	//   mouse <event> <x> <y> <flags>  a cv::MouseEventTypes code, position and cv::MouseEventFlags
+	// Blank lines and lines starting with '#' are ignored.
+	//
+	// When replaying, the time taken by each event is recorded: for a key press from
+	// the point that it is returned by waitKey() until the next call to waitKey(),
+	// and for a mouse event the duration of the mouse callback
+	class UserInput
+	{
+		public:
+			UserInput();
+
+			// Take events from a script instead of a window (call before openWindow()).
+			// Returns false if the script cannot be read
+			bool replay(const std::string& script_filename);
+			bool replaying() const {return replay_mode;}
+
+			// Record the events of a live session in a script file. Mouse movements
+			// are not recorded as the tools do not respond to them
+			bool record(const std::string& script_filename);
+
+			// Create the window (unless replaying). The mouse callback may be null
+			void openWindow(const std::string& name, cv::MouseCallback on_mouse = nullptr);
+
+			// Display an image in the window (does nothing when replaying)
+			void show(const cv::Mat& image);
+
+			// Wait for the next key press. When replaying, any mouse events that come
+			// before it in the script are passed to the mouse callback first. If the
+			// script ends before the tool exits, an error is reported and Q_KEY is
+			// returned so that the tool quits without writing anything
+			int waitKey();
+
+			// Stop timing the last replayed event, once the tool has finished its work
+			// (including writing its output)
+			void endSession();
+
+			// Whether a replayed script was used up exactly (no events were missing)
+			bool scriptComplete() const {return !script_exhausted;}
+
+			// Print the number of replayed events and their total, median, p95 and maximum durations
+			void reportStepTimes(std::ostream& out) const;
+
+			// Write the duration of each replayed event, one JSON object per line
+			bool writeStepTimes(const std::string& filename) const;
+
+		private:
+			static void mouseCallback(int event, int x, int y, int flags, void* userdata);
+			void finishStep();
+
+			std::string window_name;
+			cv::MouseCallback on_mouse;
+			bool replay_mode, script_exhausted, step_running;
+			std::ofstream record_file;
+
+			std::vector<inputEvent_t> events;
+			size_t next_event;
+			std::vector<double> step_ms;
+			std::chrono::steady_clock::time_point step_start;
+	};
+}
+
+// inclusion guard
+#endif